@@ -0,0 +1,326 @@
+// bolt_bench drives the public DB/Tx/Bucket/Cursor API with a configurable
+// workload and reports throughput and latency percentiles.
+//
+//   bolt_bench --workload=put --order=rand --count=100000 --batch-size=1000
+//   bolt_bench --workload=get --readers=8 --json
+#include "bolt/bucket.h"
+#include "bolt/cursor.h"
+#include "bolt/db.h"
+#include "bolt/histogram.h"
+#include "bolt/tx.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::microseconds;
+
+const char *BenchBucketName = "bench";
+
+// Config holds the benchmark parameters parsed from the command line.
+struct Config {
+  std::string workload = "put"; // put, get, scan or mixed
+  std::string order = "seq";    // key order of puts: seq or rand
+  std::string path;             // database path, a temporary file if empty
+  std::int64_t count = 100000;  // number of keys written or read per thread
+  int batch_size = 1000;        // operations per transaction
+  int key_size = 8;             // bytes per key, at least 8
+  int value_size = 32;          // bytes per value
+  int scan_length = 100;        // keys visited per range scan
+  int readers = 1;              // reader threads for get, scan and mixed
+  int writers = 1;              // writer threads for put and mixed
+  double fill_percent = DefaultFillPercent;
+  bool in_memory = false;       // use an in-memory database, see Option::InMemory
+  bool json = false;
+};
+
+// Result aggregates what all threads of one phase measured.
+struct Result {
+  std::string name;
+  std::string unit; // what a latency sample measures
+  std::atomic<std::int64_t> ops{0};
+  LatencyHistogram latency;
+  double seconds = 0;
+};
+
+static void usage() {
+  std::cerr << "usage: bolt_bench [--workload=put|get|scan|mixed] [--order=seq|rand] [--path=PATH]\n"
+               "                  [--count=N] [--batch-size=N] [--key-size=N] [--value-size=N]\n"
+               "                  [--scan-length=N] [--readers=N] [--writers=N] [--fill-percent=F]\n"
+               "                  [--in-memory] [--json]\n";
+  std::exit(2);
+}
+
+static Config parse(int argc, char **argv) {
+  Config c;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto eq = arg.find('=');
+    std::string name = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    if (name == "--workload") {
+      c.workload = value;
+    } else if (name == "--order") {
+      c.order = value;
+    } else if (name == "--path") {
+      c.path = value;
+    } else if (name == "--count") {
+      c.count = std::atoll(value.c_str());
+    } else if (name == "--batch-size") {
+      c.batch_size = std::atoi(value.c_str());
+    } else if (name == "--key-size") {
+      c.key_size = std::atoi(value.c_str());
+    } else if (name == "--value-size") {
+      c.value_size = std::atoi(value.c_str());
+    } else if (name == "--scan-length") {
+      c.scan_length = std::atoi(value.c_str());
+    } else if (name == "--readers") {
+      c.readers = std::atoi(value.c_str());
+    } else if (name == "--writers") {
+      c.writers = std::atoi(value.c_str());
+    } else if (name == "--fill-percent") {
+      c.fill_percent = std::atof(value.c_str());
+    } else if (name == "--in-memory") {
+      c.in_memory = true;
+    } else if (name == "--json") {
+      c.json = true;
+    } else {
+      usage();
+    }
+  }
+  if (c.workload != "put" && c.workload != "get" && c.workload != "scan" && c.workload != "mixed") {
+    usage();
+  }
+  if (c.order != "seq" && c.order != "rand") {
+    usage();
+  }
+  if (c.key_size < 8 || c.batch_size <= 0 || c.count <= 0 || c.readers < 0 || c.writers < 0) {
+    usage();
+  }
+  return c;
+}
+
+// make_key encodes n big-endian into the first 8 bytes of a key so that
+// sequential ids are also sequential in key order.
+static std::string make_key(std::uint64_t n, int size) {
+  std::string key(size, '\0');
+  for (int i = 0; i < 8; i++) {
+    key[i] = static_cast<char>(n >> (56 - 8 * i));
+  }
+  return key;
+}
+
+// put writes count keys per writer in transactions of batch_size keys. Writer
+// w owns the ids [w * count, (w + 1) * count).
+static void put(DB *db, const Config &c, bool random, Result &r) {
+  auto worker = [&](int w) {
+    std::mt19937_64 rng(w);
+    std::string value(c.value_size, 'v');
+    std::uint64_t base = static_cast<std::uint64_t>(w) * c.count;
+    for (std::int64_t i = 0; i < c.count;) {
+      auto start = Clock::now();
+      Tx *tx = db->begin(true);
+      Bucket *b = tx->create_bucket_if_not_exists(BenchBucketName);
+      b->fillPercent = c.fill_percent;
+
+      // Keys must outlive the transaction until it commits. Short keys are
+      // stored inside the strings, so the vector must not reallocate.
+      std::vector<std::string> keys;
+      keys.reserve(c.batch_size);
+      for (int j = 0; j < c.batch_size && i < c.count; j++, i++) {
+        keys.push_back(make_key(random ? rng() : base + i, c.key_size));
+        b->put(Slice(keys.back().data(), keys.back().size()), Slice(value.data(), value.size()));
+      }
+      tx->commit();
+      delete tx;
+      r.latency.record(std::chrono::duration_cast<microseconds>(Clock::now() - start));
+      r.ops += keys.size();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int w = 0; w < c.writers; w++) {
+    threads.emplace_back(worker, w);
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+// get looks up random keys among the first count ids, batch_size per read
+// transaction, until stop is set or every reader did the given number of
+// lookups.
+static void get(DB *db, const Config &c, std::int64_t lookups, std::atomic<bool> &stop, Result &r) {
+  auto worker = [&](int w) {
+    std::mt19937_64 rng(1000 + w);
+    for (std::int64_t i = 0; i < lookups && !stop;) {
+      Tx *tx = db->begin(false);
+      Bucket *b = tx->bucket(BenchBucketName);
+      int j = 0;
+      for (; j < c.batch_size && i < lookups; j++, i++) {
+        std::string key = make_key(rng() % c.count, c.key_size);
+        auto start = Clock::now();
+        b->get(Slice(key.data(), key.size()));
+        r.latency.record(std::chrono::duration_cast<microseconds>(Clock::now() - start));
+      }
+      tx->rollback();
+      delete tx;
+      r.ops += j;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int w = 0; w < c.readers; w++) {
+    threads.emplace_back(worker, w);
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+// scan seeks to a random key and visits the next scan_length keys, count
+// times per reader.
+static void scan(DB *db, const Config &c, Result &r) {
+  auto worker = [&](int w) {
+    std::mt19937_64 rng(2000 + w);
+    Tx *tx = db->begin(false);
+    Cursor *cur = tx->bucket(BenchBucketName)->cursor();
+    for (std::int64_t i = 0; i < c.count; i++) {
+      std::string key = make_key(rng() % c.count, c.key_size);
+      auto start = Clock::now();
+      int n = 0;
+      for (auto kv = cur->seek(Slice(key.data(), key.size())); kv.first && n < c.scan_length; kv = cur->next()) {
+        n++;
+      }
+      r.latency.record(std::chrono::duration_cast<microseconds>(Clock::now() - start));
+      r.ops += n;
+    }
+    delete cur;
+    tx->rollback();
+    delete tx;
+  };
+
+  std::vector<std::thread> threads;
+  for (int w = 0; w < c.readers; w++) {
+    threads.emplace_back(worker, w);
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+// timed runs fn and records its wall clock time into r.
+template <class F> static void timed(Result &r, F fn) {
+  auto start = Clock::now();
+  fn();
+  r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void report(const Config &c, const std::vector<Result *> &results) {
+  if (c.json) {
+    std::printf("{\"config\":{\"workload\":\"%s\",\"order\":\"%s\",\"count\":%lld,\"batch_size\":%d,"
+                "\"key_size\":%d,\"value_size\":%d,\"scan_length\":%d,\"readers\":%d,\"writers\":%d,"
+                "\"fill_percent\":%g,\"in_memory\":%s},\"results\":[",
+                c.workload.c_str(), c.order.c_str(), static_cast<long long>(c.count), c.batch_size, c.key_size,
+                c.value_size, c.scan_length, c.readers, c.writers, c.fill_percent, c.in_memory ? "true" : "false");
+  }
+  for (size_t i = 0; i < results.size(); i++) {
+    Result &r = *results[i];
+    LatencySnapshot s = r.latency.snapshot();
+    double rate = r.seconds > 0 ? r.ops / r.seconds : 0;
+    if (c.json) {
+      std::printf("%s{\"name\":\"%s\",\"ops\":%lld,\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"latency_unit\":\"%s\","
+                  "\"latency_us\":{\"count\":%llu,\"p50\":%lld,\"p99\":%lld,\"p999\":%lld,\"max\":%lld}}",
+                  i ? "," : "", r.name.c_str(), static_cast<long long>(r.ops.load()), r.seconds, rate,
+                  r.unit.c_str(), static_cast<unsigned long long>(s.count), static_cast<long long>(s.p50.count()),
+                  static_cast<long long>(s.p99.count()), static_cast<long long>(s.p999.count()),
+                  static_cast<long long>(s.max.count()));
+    } else {
+      std::printf("%-10s %12lld ops %10.3fs %12.1f ops/s   %s latency(us) p50=%lld p99=%lld p999=%lld max=%lld\n",
+                  r.name.c_str(), static_cast<long long>(r.ops.load()), r.seconds, rate, r.unit.c_str(),
+                  static_cast<long long>(s.p50.count()), static_cast<long long>(s.p99.count()),
+                  static_cast<long long>(s.p999.count()), static_cast<long long>(s.max.count()));
+    }
+  }
+  if (c.json) {
+    std::printf("]}\n");
+  }
+}
+
+int main(int argc, char **argv) {
+  Config c = parse(argc, argv);
+
+  bool temp = c.path.empty() && !c.in_memory;
+  if (temp) {
+    char name[] = "/tmp/bolt-bench-XXXXXX";
+    int fd = ::mkstemp(name);
+    ::close(fd);
+    ::unlink(name);
+    c.path = name;
+  }
+  Option option = DefaultOption;
+  option.InMemory = c.in_memory;
+  DB *db = new DB(c.path.empty() ? "bolt-bench" : c.path, 0666, &option);
+
+  std::vector<Result *> results;
+  Result load, run, writes;
+  bool random = c.order == "rand";
+  if (c.workload == "put") {
+    load.name = std::string("put-") + c.order;
+    load.unit = "tx";
+    timed(load, [&] { put(db, c, random, load); });
+    results.push_back(&load);
+  } else {
+    // Load the keys the readers look for with a single sequential writer.
+    Config lc = c;
+    lc.writers = 1;
+    load.name = "load";
+    load.unit = "tx";
+    timed(load, [&] { put(db, lc, false, load); });
+    results.push_back(&load);
+
+    run.name = c.workload;
+    if (c.workload == "get") {
+      std::atomic<bool> stop(false);
+      run.unit = "op";
+      timed(run, [&] { get(db, c, c.count, stop, run); });
+      results.push_back(&run);
+    } else if (c.workload == "scan") {
+      run.unit = "scan";
+      timed(run, [&] { scan(db, c, run); });
+      results.push_back(&run);
+    } else {
+      // Readers run until the writers are done.
+      writes.name = "mixed-put";
+      writes.unit = "tx";
+      run.name = "mixed-get";
+      run.unit = "op";
+      std::atomic<bool> stop(false);
+      timed(run, [&] {
+        std::thread readers([&] { get(db, c, std::numeric_limits<std::int64_t>::max(), stop, run); });
+        timed(writes, [&] { put(db, c, random, writes); });
+        stop = true;
+        readers.join();
+      });
+      results.push_back(&writes);
+      results.push_back(&run);
+    }
+  }
+
+  report(c, results);
+  delete db;
+  if (temp) {
+    ::unlink(c.path.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,433 @@
+// bolt_microbench measures the hot primitives of the engine in isolation and
+// reports ns/op and heap allocations per op for each of them, so that a
+// regression in a kernel shows up before it turns into end-to-end latency.
+//
+//   bolt_microbench [--filter=SUBSTRING] [--min-time=MS]
+#include "bolt/bucket.h"
+#include "bolt/db.h"
+#include "bolt/freelist.h"
+#include "bolt/node.h"
+#include "bolt/page.h"
+#include "bolt/page_pool.h"
+#include "bolt/slice.h"
+#include "bolt/tx.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Every heap allocation made by the process is counted so that benchmarks can
+// report allocations per op.
+static std::atomic<std::uint64_t> allocs(0);
+
+void *operator new(std::size_t n) {
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(n ? n : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t n) { return operator new(n); }
+void *operator new(std::size_t n, const std::nothrow_t &) noexcept {
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(n ? n : 1);
+}
+void *operator new[](std::size_t n, const std::nothrow_t &tag) noexcept { return operator new(n, tag); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+// B is handed to a benchmark function, which must run the measured operation
+// n times. Setup that should not be measured is bracketed by stop_timer() and
+// start_timer(), or followed by reset_timer().
+class B {
+public:
+  explicit B(std::int64_t n) : n(n), elapsed_(0), allocs_(0), running_(false) {}
+
+  const std::int64_t n;
+
+  void start_timer() {
+    if (!this->running_) {
+      this->start_ = Clock::now();
+      this->start_allocs_ = allocs.load(std::memory_order_relaxed);
+      this->running_ = true;
+    }
+  }
+
+  void stop_timer() {
+    if (this->running_) {
+      this->elapsed_ += Clock::now() - this->start_;
+      this->allocs_ += allocs.load(std::memory_order_relaxed) - this->start_allocs_;
+      this->running_ = false;
+    }
+  }
+
+  void reset_timer() {
+    this->elapsed_ = Clock::duration(0);
+    this->allocs_ = 0;
+    if (this->running_) {
+      this->start_ = Clock::now();
+      this->start_allocs_ = allocs.load(std::memory_order_relaxed);
+    }
+  }
+
+  Clock::duration elapsed() const { return this->elapsed_; }
+  std::uint64_t allocations() const { return this->allocs_; }
+
+private:
+  Clock::duration elapsed_;
+  std::uint64_t allocs_;
+  Clock::time_point start_;
+  std::uint64_t start_allocs_;
+  bool running_;
+};
+
+struct Benchmark {
+  std::string name;
+  std::function<void(B &)> fn;
+};
+
+// run grows the iteration count until the benchmark runs for at least
+// min_time and reports the last run.
+static void run(const Benchmark &bm, Clock::duration min_time) {
+  std::int64_t n = 1;
+  for (;;) {
+    B b(n);
+    b.start_timer();
+    bm.fn(b);
+    b.stop_timer();
+
+    auto elapsed = b.elapsed();
+    if (elapsed >= min_time || n >= 1000000000) {
+      double ns = std::chrono::duration<double, std::nano>(elapsed).count() / n;
+      double per_op = static_cast<double>(b.allocations()) / n;
+      std::printf("%-40s %12lld %12.1f ns/op %10.2f allocs/op\n", bm.name.c_str(), static_cast<long long>(n), ns,
+                  per_op);
+      return;
+    }
+
+    // Aim 20% past min_time, growing at most 100x per round.
+    double ns = std::max(1.0, std::chrono::duration<double, std::nano>(elapsed).count());
+    double goal = std::chrono::duration<double, std::nano>(min_time).count() * 1.2;
+    n = std::min<std::int64_t>(std::max<std::int64_t>(goal / ns * n, n + 1), n * 100);
+  }
+}
+
+// key returns a fixed-width key whose byte order matches the order of i.
+static std::string key(std::uint64_t i, int size = 16) {
+  std::string k(size, 'k');
+  for (int j = 0; j < 8 && j < size; j++) {
+    k[size - 1 - j] = static_cast<char>('0' + (i >> (4 * j)) % 16);
+  }
+  return k;
+}
+
+static std::vector<std::string> keys(int n) {
+  std::vector<std::string> ks;
+  ks.reserve(n);
+  for (int i = 0; i < n; i++) {
+    ks.push_back(key(i));
+  }
+  return ks;
+}
+
+// escape makes the compiler assume v is read and modified by unknown code, so
+// that neither the computation of v nor the loads feeding it are optimized
+// away or hoisted out of a benchmark loop.
+template <class T> static inline void escape(T &v) { asm volatile("" : : "g"(&v) : "memory"); }
+
+static Slice slice(const std::string &s) { return Slice(s.data(), s.size()); }
+
+static void slice_benchmarks(std::vector<Benchmark> *bms) {
+  for (int size : {8, 32, 256}) {
+    // The slices differ only in their last byte, the worst case for compare.
+    bms->push_back({"slice/compare/" + std::to_string(size), [size](B &b) {
+                      std::string x(size, 'a'), y(size, 'a');
+                      y[size - 1] = 'b';
+                      Slice a = slice(x), c = slice(y);
+                      int sum = 0;
+                      for (std::int64_t i = 0; i < b.n; i++) {
+                        escape(a);
+                        sum += a.compare(c);
+                        escape(sum);
+                      }
+                    }});
+    bms->push_back({"slice/less/" + std::to_string(size), [size](B &b) {
+                      std::string x(size, 'a'), y(size, 'a');
+                      y[size - 1] = 'b';
+                      Slice a = slice(x), c = slice(y);
+                      int sum = 0;
+                      for (std::int64_t i = 0; i < b.n; i++) {
+                        escape(a);
+                        sum += a < c;
+                        escape(sum);
+                      }
+                    }});
+  }
+}
+
+// Scratch gives standalone nodes a bucket in a writable transaction of an
+// in-memory database, which node operations reach for the meta and page size.
+struct Scratch {
+  Scratch() {
+    Option option = DefaultOption;
+    option.InMemory = true;
+    db = new DB("bolt-microbench", 0666, &option);
+    tx = db->begin(true);
+    bucket = new Bucket(tx);
+  }
+
+  ~Scratch() {
+    delete bucket;
+    tx->rollback();
+    delete tx;
+    delete db;
+  }
+
+  DB *db;
+  Tx *tx;
+  Bucket *bucket;
+};
+
+// The node benchmarks work on standalone leaf nodes of count inodes.
+static void node_benchmarks(std::vector<Benchmark> *bms) {
+  std::string value(32, 'v');
+  for (int count : {16, 256, 4096}) {
+    auto suffix = "/" + std::to_string(count);
+
+    bms->push_back({"node/put" + suffix, [count, value](B &b) {
+                      Scratch s;
+                      Node n(s.bucket, true, nullptr);
+                      auto ks = keys(count);
+                      for (auto &k : ks) {
+                        n.put(slice(k), slice(k), slice(value), 0, 0);
+                      }
+                      b.reset_timer();
+
+                      // Overwrite existing keys so the node keeps its size.
+                      for (std::int64_t i = 0; i < b.n; i++) {
+                        auto &k = ks[(i * 7919) % count];
+                        n.put(slice(k), slice(k), slice(value), 0, 0);
+                      }
+                    }});
+
+    bms->push_back({"node/get" + suffix, [count, value](B &b) {
+                      Scratch s;
+                      Node n(s.bucket, true, nullptr);
+                      auto ks = keys(count);
+                      for (auto &k : ks) {
+                        n.put(slice(k), slice(k), slice(value), 0, 0);
+                      }
+                      std::string v;
+                      v.reserve(value.size());
+                      b.reset_timer();
+
+                      for (std::int64_t i = 0; i < b.n; i++) {
+                        n.get(slice(ks[(i * 7919) % count]), &v);
+                      }
+                    }});
+
+    // Each op deletes a key and inserts it again, which keeps the node at
+    // its size and measures the inode shifting of both directions.
+    bms->push_back({"node/del+put" + suffix, [count, value](B &b) {
+                      Scratch s;
+                      Node n(s.bucket, true, nullptr);
+                      auto ks = keys(count);
+                      for (auto &k : ks) {
+                        n.put(slice(k), slice(k), slice(value), 0, 0);
+                      }
+                      b.reset_timer();
+
+                      for (std::int64_t i = 0; i < b.n; i++) {
+                        auto &k = ks[(i * 7919) % count];
+                        n.del(slice(k));
+                        n.put(slice(k), slice(k), slice(value), 0, 0);
+                      }
+                    }});
+
+    bms->push_back({"node/write" + suffix, [count, value](B &b) {
+                      Scratch s;
+                      Node n(s.bucket, true, nullptr);
+                      auto ks = keys(count);
+                      for (auto &k : ks) {
+                        n.put(slice(k), slice(k), slice(value), 0, 0);
+                      }
+                      std::vector<char> buf(n.size());
+                      b.reset_timer();
+
+                      for (std::int64_t i = 0; i < b.n; i++) {
+                        Page *p = new (buf.data()) Page(1, 0);
+                        n.write(p);
+                      }
+                    }});
+
+    bms->push_back({"node/read" + suffix, [count, value](B &b) {
+                      Scratch s;
+                      Node n(s.bucket, true, nullptr);
+                      auto ks = keys(count);
+                      for (auto &k : ks) {
+                        n.put(slice(k), slice(k), slice(value), 0, 0);
+                      }
+                      std::vector<char> buf(n.size());
+                      Page *p = new (buf.data()) Page(1, 0);
+                      n.write(p);
+                      b.reset_timer();
+
+                      for (std::int64_t i = 0; i < b.n; i++) {
+                        Node m(s.bucket, true, nullptr);
+                        m.read(p);
+                      }
+                    }});
+  }
+
+  bms->push_back({"page/leaf_element", [value](B &b) {
+                    Scratch s;
+                    Node n(s.bucket, true, nullptr);
+                    auto ks = keys(256);
+                    for (auto &k : ks) {
+                      n.put(slice(k), slice(k), slice(value), 0, 0);
+                    }
+                    std::vector<char> buf(n.size());
+                    Page *p = new (buf.data()) Page(1, 0);
+                    n.write(p);
+                    b.reset_timer();
+
+                    std::size_t sum = 0;
+                    for (std::int64_t i = 0; i < b.n; i++) {
+                      sum += p->leafPageElement(i % 256)->key().size();
+                      escape(sum);
+                    }
+                  }});
+}
+
+static void freelist_benchmarks(std::vector<Benchmark> *bms) {
+  for (int size : {1, 4}) {
+    // Allocate runs of size pages out of a freelist where only every other
+    // run is free, so allocate has to skip over holes.
+    bms->push_back({"freelist/allocate/" + std::to_string(size), [size](B &b) {
+                      const int runs = 4096;
+                      FreeList f;
+                      for (std::int64_t i = 0; i < b.n;) {
+                        if (f.ids.empty()) {
+                          b.stop_timer();
+                          for (int r = 0; r < runs; r++) {
+                            for (int j = 0; j < size; j++) {
+                              f.ids.push_back(2 + r * (size + 1) + j);
+                            }
+                          }
+                          f.reindex();
+                          b.start_timer();
+                        }
+                        for (; i < b.n && !f.ids.empty(); i++) {
+                          f.allocate(1, size);
+                        }
+                      }
+                    }});
+  }
+
+  bms->push_back({"freelist/release", [](B &b) {
+                    // Each op releases one transaction worth of pending pages
+                    // into a freelist of a few thousand free pages.
+                    const int txs = 1024, pages = 16;
+                    FreeList f;
+                    txid_t txid = 0;
+                    pgid_t next = 2;
+                    for (std::int64_t i = 0; i < b.n; i++) {
+                      if (f.pending.empty()) {
+                        b.stop_timer();
+                        f.ids.clear();
+                        for (int j = 0; j < 4096; j++) {
+                          f.ids.push_back(next++);
+                        }
+                        for (int t = 0; t < txs; t++) {
+                          for (int j = 0; j < pages; j++) {
+                            f.pending[txid + t].push_back(next++);
+                          }
+                        }
+                        f.reindex();
+                        b.start_timer();
+                      }
+                      f.release(txid++);
+                    }
+                  }});
+}
+
+static void page_pool_benchmarks(std::vector<Benchmark> *bms) {
+  for (int threads : {1, 4, 16}) {
+    bms->push_back({"page_pool/get+put/threads=" + std::to_string(threads), [threads](B &b) {
+                      const int page_size = 4096;
+                      std::vector<char *> owned;
+                      std::mutex owned_mutex;
+                      PagePool pool([&]() {
+                        char *buf = static_cast<char *>(std::malloc(page_size));
+                        std::lock_guard<std::mutex> lock(owned_mutex);
+                        owned.push_back(buf);
+                        return Slice(buf, page_size);
+                      });
+
+                      std::vector<std::thread> ts;
+                      for (int t = 0; t < threads; t++) {
+                        std::int64_t n = b.n / threads + (t < b.n % threads);
+                        ts.emplace_back([&pool, n]() {
+                          for (std::int64_t i = 0; i < n; i++) {
+                            pool.put(pool.get());
+                          }
+                        });
+                      }
+                      for (auto &t : ts) {
+                        t.join();
+                      }
+
+                      b.stop_timer();
+                      for (auto buf : owned) {
+                        std::free(buf);
+                      }
+                    }});
+  }
+}
+
+static void usage() {
+  std::cerr << "usage: bolt_microbench [--filter=SUBSTRING] [--min-time=MS]\n";
+  std::exit(2);
+}
+
+int main(int argc, char **argv) {
+  std::string filter;
+  auto min_time = std::chrono::milliseconds(500);
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 9, "--filter=") == 0) {
+      filter = arg.substr(9);
+    } else if (arg.compare(0, 11, "--min-time=") == 0) {
+      min_time = std::chrono::milliseconds(std::atoi(arg.c_str() + 11));
+    } else {
+      usage();
+    }
+  }
+
+  std::vector<Benchmark> bms;
+  slice_benchmarks(&bms);
+  node_benchmarks(&bms);
+  freelist_benchmarks(&bms);
+  page_pool_benchmarks(&bms);
+
+  for (auto &bm : bms) {
+    if (filter.empty() || bm.name.find(filter) != std::string::npos) {
+      run(bm, min_time);
+    }
+  }
+  return 0;
+}
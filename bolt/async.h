@@ -0,0 +1,96 @@
+#ifndef __BOLT_ASYNC_H
+#define __BOLT_ASYNC_H
+
+// Awaitable versions of DB::begin(), DB::update() and Tx::commit() for C++20
+// coroutines, built on the callback API of DB and Tx:
+//
+//   Tx *tx = co_await co_begin(db, true, exec);
+//   ...
+//   co_await co_commit(tx, exec);
+//
+// A coroutine waiting for the writer lock or for a commit to reach the disk
+// is suspended instead of blocking its thread, and is resumed through exec.
+// The library itself is built as C++17, this header is only usable from
+// translation units compiled with coroutine support.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include "db.h"
+#include "tx.h"
+#include <coroutine>
+#include <exception>
+#include <functional>
+
+// BeginAwaiter is returned by co_begin().
+class BeginAwaiter {
+public:
+  BeginAwaiter(DB *db, bool writable, Executor exec) : db_(db), writable_(writable), exec_(exec), tx_(nullptr) {}
+
+  bool await_ready() { return false; }
+  void await_suspend(std::coroutine_handle<> h) {
+    db_->begin_async(writable_, exec_, [this, h](Tx *tx, std::exception_ptr err) {
+      tx_ = tx;
+      err_ = err;
+      h.resume();
+    });
+  }
+  Tx *await_resume() {
+    if (err_) {
+      std::rethrow_exception(err_);
+    }
+    return tx_;
+  }
+
+private:
+  DB *db_;
+  bool writable_;
+  Executor exec_;
+  Tx *tx_;
+  std::exception_ptr err_;
+};
+
+// DoneAwaiter is returned by co_commit() and co_update().
+class DoneAwaiter {
+public:
+  typedef std::function<void(Executor, std::function<void(std::exception_ptr)>)> Start;
+
+  DoneAwaiter(Start start, Executor exec) : start_(start), exec_(exec) {}
+
+  bool await_ready() { return false; }
+  void await_suspend(std::coroutine_handle<> h) {
+    start_(exec_, [this, h](std::exception_ptr err) {
+      err_ = err;
+      h.resume();
+    });
+  }
+  void await_resume() {
+    if (err_) {
+      std::rethrow_exception(err_);
+    }
+  }
+
+private:
+  Start start_;
+  Executor exec_;
+  std::exception_ptr err_;
+};
+
+// co_begin starts a transaction, see DB::begin_async().
+inline BeginAwaiter co_begin(DB *db, bool writable, Executor exec) { return BeginAwaiter(db, writable, exec); }
+
+// co_commit commits a transaction, see Tx::commit_async().
+inline DoneAwaiter co_commit(Tx *tx, Executor exec) {
+  return DoneAwaiter(
+      [tx](Executor exec, std::function<void(std::exception_ptr)> done) { tx->commit_async(exec, done); }, exec);
+}
+
+// co_update runs fn in a read-write transaction and commits it, see
+// DB::update_async().
+inline DoneAwaiter co_update(DB *db, std::function<void(Tx *)> fn, Executor exec) {
+  return DoneAwaiter(
+      [db, fn](Executor exec, std::function<void(std::exception_ptr)> done) { db->update_async(fn, exec, done); },
+      exec);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,117 @@
+#include "backup.h"
+#include "bolt_unix.h"
+#include "exception.h"
+#include "meta.h"
+#include "page.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <new>
+#include <system_error>
+#include <unistd.h>
+
+std::string meta_pages(const Meta &m, int page_size) {
+  std::string buf(2 * static_cast<size_t>(page_size), '\0');
+  for (int i = 0; i < 2; i++) {
+    char *data = &buf[i * page_size];
+    Page *p = new (data) Page(i, MetaPageFlag);
+    *p->meta() = m;
+    p->meta()->txid -= i;
+    p->meta()->checksum = p->meta()->sum64();
+  }
+  return buf;
+}
+
+// newest_meta returns the meta with the highest txid which passes validation.
+// Meta 1 is found through the page size recorded in meta 0.
+static Meta newest_meta(int fd) {
+  Meta m0;
+  pread_full(fd, reinterpret_cast<char *>(&m0), sizeof(m0), pageHeaderSize);
+  m0.validate();
+
+  Meta m1;
+  try {
+    pread_full(fd, reinterpret_cast<char *>(&m1), sizeof(m1), static_cast<std::int64_t>(m0.page_size) + pageHeaderSize);
+    m1.validate();
+  } catch (std::exception &e) {
+    return m0;
+  }
+  return m1.txid > m0.txid ? m1 : m0;
+}
+
+// apply_delta applies a single incremental backup to fd and returns the
+// txid it brings the file to.
+static txid_t apply_delta(int fd, const std::string &path, txid_t txid, int page_size) {
+  int dfd = ::open(path.c_str(), O_RDONLY);
+  if (dfd < 0) {
+    throw std::system_error(errno, std::system_category(), "fail to open incremental backup: " + path);
+  }
+
+  DeltaHeader h;
+  try {
+    std::int64_t off = 0;
+    pread_full(dfd, reinterpret_cast<char *>(&h), sizeof(h), off);
+    off += sizeof(h);
+    if (h.magic != DeltaMagic) {
+      throw DatabaseInvalidException();
+    } else if (h.page_size != static_cast<std::uint32_t>(page_size) || h.since != txid) {
+      throw DeltaMismatchException();
+    }
+
+    Meta m;
+    pread_full(dfd, reinterpret_cast<char *>(&m), sizeof(m), off);
+    off += sizeof(m);
+
+    // Copy the changed pages to their place in the file.
+    std::string buf;
+    for (std::uint64_t i = 0; i < h.count; i++) {
+      std::uint64_t run[2];
+      pread_full(dfd, reinterpret_cast<char *>(run), sizeof(run), off);
+      off += sizeof(run);
+      buf.resize(run[1] * page_size);
+      pread_full(dfd, &buf[0], buf.size(), off);
+      off += buf.size();
+      pwrite_full(fd, buf.data(), buf.size(), static_cast<std::int64_t>(run[0]) * page_size);
+    }
+
+    // Point the meta pages at the new tree and drop pages past the high
+    // water mark.
+    buf = meta_pages(m, page_size);
+    pwrite_full(fd, buf.data(), buf.size(), 0);
+    if (::ftruncate(fd, static_cast<off_t>(m.pgid) * page_size) != 0) {
+      throw std::system_error(errno, std::system_category(), "ftruncate failed");
+    }
+  } catch (...) {
+    ::close(dfd);
+    throw;
+  }
+  ::close(dfd);
+  return h.txid;
+}
+
+void apply_deltas(std::string path, const std::vector<std::string> &deltas) {
+  int fd = ::open(path.c_str(), O_RDWR);
+  if (fd < 0) {
+    throw std::system_error(errno, std::system_category(), "fail to open backup: " + path);
+  }
+
+  try {
+    // The newest valid meta carries the txid the backup was taken at.
+    Meta m = newest_meta(fd);
+    if (m.flags & MetaCompactedFlag) {
+      throw DeltaMismatchException();
+    }
+
+    txid_t txid = m.txid;
+    for (auto &delta : deltas) {
+      txid = apply_delta(fd, delta, txid, m.page_size);
+    }
+
+    if (::fdatasync(fd) != 0) {
+      throw std::system_error(errno, std::system_category(), "fdatasync failed");
+    }
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+}
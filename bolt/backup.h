@@ -0,0 +1,38 @@
+#ifndef __BOLT_BACKUP_H
+#define __BOLT_BACKUP_H
+
+#include "types.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Meta;
+
+// Represents a marker value to indicate that a file is an incremental backup.
+const std::uint32_t DeltaMagic = 0xED0CDA1D;
+
+// DeltaHeader starts an incremental backup written by Tx::write_delta().
+// It is followed by the meta of the transaction and then by count page runs,
+// each made of its first pgid, its number of pages and the page data.
+struct DeltaHeader {
+  std::uint32_t magic;
+  std::uint32_t page_size;
+  txid_t since;        // txid of the backup the delta applies to
+  txid_t txid;         // txid of the snapshot the delta brings the backup to
+  std::uint64_t count; // number of page runs
+};
+
+// meta_pages generates the two meta pages of a copy of the database. Meta 0
+// carries the given meta and meta 1 the same meta with the previous txid.
+std::string meta_pages(const Meta &m, int page_size);
+
+// apply_deltas brings the backup at path up to date by applying a chain of
+// incremental backups in order. The backup must have been taken with
+// Tx::write_to() or Tx::copy_file() at the txid the first delta starts from,
+// and every delta must start where the previous one ended. A compacted copy
+// can't be a base since its pages don't line up with the source's, so it is
+// rejected with DeltaMismatchException. The file is modified in place and
+// synced once all deltas are applied.
+void apply_deltas(std::string path, const std::vector<std::string> &deltas);
+
+#endif
@@ -1,12 +1,130 @@
 #include "bolt_unix.h"
 #include "db.h"
 
+#include <cerrno>
 #include <chrono>
 #include <cstring>
 #include <stdexcept>
 #include <sys/file.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <system_error>
 #include <thread>
+#include <unistd.h>
+
+void write_full(int fd, const char *buf, std::size_t n) {
+  while (n > 0) {
+    ssize_t r = ::write(fd, buf, n);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::system_category(), "write failed");
+    }
+    buf += r;
+    n -= r;
+  }
+}
+
+void pwrite_full(int fd, const char *buf, std::size_t n, std::int64_t off) {
+  while (n > 0) {
+    ssize_t r = ::pwrite(fd, buf, n, off);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::system_category(), "pwrite failed");
+    }
+    buf += r;
+    n -= r;
+    off += r;
+  }
+}
+
+void pread_full(int fd, char *buf, std::size_t n, std::int64_t off) {
+  while (n > 0) {
+    ssize_t r = ::pread(fd, buf, n, off);
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r <= 0) {
+      throw std::system_error(r < 0 ? errno : EIO, std::system_category(), "pread failed");
+    }
+    buf += r;
+    n -= r;
+    off += r;
+  }
+}
+
+void *mmap_aligned(std::size_t sz, int prot, int flags, int fd, std::size_t align) {
+  // Reserve enough address space to find an aligned start in, map over it
+  // and give the slop on both sides back.
+  std::size_t len = sz + align;
+  void *r = ::mmap(nullptr, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (r == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+  char *start = static_cast<char *>(r);
+  char *aligned = reinterpret_cast<char *>((reinterpret_cast<std::uintptr_t>(start) + align - 1) & ~(align - 1));
+  void *b = ::mmap(aligned, sz, prot, flags | MAP_FIXED, fd, 0);
+  if (b == MAP_FAILED) {
+    int err = errno;
+    ::munmap(r, len);
+    errno = err;
+    return MAP_FAILED;
+  }
+
+  std::size_t page = ::getpagesize();
+  char *end = aligned + (sz + page - 1) / page * page;
+  if (aligned > start) {
+    ::munmap(start, aligned - start);
+  }
+  if (start + len > end) {
+    ::munmap(end, start + len - end);
+  }
+  return b;
+}
+
+// unsupported returns whether errno reports that a zero-copy syscall can't be
+// used for a pair of files, as opposed to an I/O error.
+static bool unsupported(int err) {
+  return err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP;
+}
+
+std::int64_t copy_range(int src, std::int64_t *off, int dst, std::size_t n) {
+  for (;;) {
+    loff_t in = *off;
+    ssize_t r = ::copy_file_range(src, &in, dst, nullptr, n, 0);
+    if (r >= 0) {
+      *off = in;
+      return r;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (!unsupported(errno)) {
+      throw std::system_error(errno, std::system_category(), "copy_file_range failed");
+    }
+    break;
+  }
+
+  // sendfile(2) works on kernels and file systems without copy_file_range(2).
+  for (;;) {
+    off_t in = *off;
+    ssize_t r = ::sendfile(dst, src, &in, n);
+    if (r >= 0) {
+      *off = in;
+      return r;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (!unsupported(errno)) {
+      throw std::system_error(errno, std::system_category(), "sendfile failed");
+    }
+    return -1;
+  }
+}
 
 /*
 void mmap(DB *db, int sz) {
@@ -1,6 +1,9 @@
 #ifndef __BOLT_BOLT_UNIX_H
 #define __BOLT_BOLT_UNIX_H
 
+#include <cstddef>
+#include <cstdint>
+
 class DB;
 
 // mmap memory maps a DB's data file.
@@ -9,4 +12,26 @@ void mmap(DB* db, int sz);
 // munmap unmaps a DB's data file from memory.
 void munmap(DB* db);
 
-#endif
\ No newline at end of file
+// mmap_aligned maps fd like mmap(2) does, but at an address aligned to align
+// bytes so that the kernel can back the mapping with huge pages from its
+// first byte. Returns MAP_FAILED and sets errno on failure.
+void *mmap_aligned(std::size_t sz, int prot, int flags, int fd, std::size_t align);
+
+// write_full writes n bytes to the current offset of fd, retrying short writes.
+void write_full(int fd, const char *buf, std::size_t n);
+
+// pwrite_full writes n bytes to fd at a given offset, retrying short writes.
+void pwrite_full(int fd, const char *buf, std::size_t n, std::int64_t off);
+
+// pread_full reads exactly n bytes from fd at a given offset. Throws if the
+// file ends before that.
+void pread_full(int fd, char *buf, std::size_t n, std::int64_t off);
+
+// copy_range copies up to n bytes of src starting at *off to the current
+// offset of dst without passing the data through user space, using
+// copy_file_range(2) and falling back to sendfile(2). *off is advanced by the
+// number of bytes copied, which is returned. Returns -1 if the kernel can't
+// copy between these two files.
+std::int64_t copy_range(int src, std::int64_t *off, int dst, std::size_t n);
+
+#endif
@@ -1,20 +1,77 @@
 #include "bucket.h"
+#include "cursor.h"
+#include "db.h"
+#include "exception.h"
+#include "freelist.h"
+#include "node.h"
+#include "node_cache.h"
+#include "page.h"
 #include "tx.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <iostream>
+#include <new>
+#include <thread>
+#include <vector>
 
-Bucket::Bucket(Tx *tx) : fillPercent(DefaultFillPercent), tx_(tx) {}
+Bucket::Bucket(Tx *tx)
+    : fillPercent(DefaultFillPercent), rebalancePolicy(DefaultRebalancePolicy), bucket_(), tx_(tx), page(nullptr),
+      rootNode(nullptr) {}
+
+Bucket::~Bucket() {
+  for (auto &it : this->buckets_) {
+    delete it.second;
+  }
+  for (Node *n : this->owned_) {
+    delete n;
+  }
+}
 
 void Bucket::set_bucket(const struct bucket &b) {
   this->bucket_.root = b.root;
   this->bucket_.sequence = b.sequence;
+  this->bucket_.flags = b.flags;
+  this->bucket_.comparator = b.comparator;
 }
 
 bool Bucket::writable() { return tx_->writable(); }
 
 gsl::not_null<Tx *> Bucket::tx() { return tx_; }
 
-// TODO
-Node *Bucket::node(pgid_t id, const Node *parent) { return nullptr; }
+Node *Bucket::node(pgid_t id, const Node *parent) {
+  // Retrieve node if it's already been created.
+  auto search = this->nodes.find(id);
+  if (search != this->nodes.end()) {
+    return search->second;
+  }
+
+  // Otherwise create a node and cache it. The parent only records its
+  // materialized children, which doesn't change what it holds.
+  Node *n = this->new_node(false, const_cast<Node *>(parent));
+  if (parent == nullptr) {
+    this->rootNode = n;
+  } else {
+    const_cast<Node *>(parent)->children.push_back(n);
+  }
+
+  // Use the inline page if this is an inline bucket.
+  Page *p = this->page;
+  if (p == nullptr) {
+    p = this->tx_->page(id);
+  }
+
+  // Read the page into the node and cache it.
+  n->read(*this->tx_->decoded_page(p));
+  this->nodes[id] = n;
+  return n;
+}
+
+Node *Bucket::new_node(bool isLeaf, Node *parent) {
+  Node *n = new Node(this, isLeaf, parent);
+  this->owned_.push_back(n);
+  return n;
+}
 
 bool Bucket::inline_() { return this->bucket_.root == 0; }
 
@@ -43,17 +100,547 @@ std::pair<Page *, Node *> Bucket::page_node(pgid_t id) {
   return std::make_pair(this->tx_->page(id), nullptr);
 }
 
-Bucket *Bucket::create_bucket(Slice name) { return nullptr; }
+Bucket *Bucket::create_bucket(Slice key, std::uint32_t flags, std::uint32_t comparator) {
+  if (this->tx_->db() == nullptr) {
+    throw TxClosedException();
+  } else if (!this->writable()) {
+    throw TxNotWritableException();
+  } else if (key.size() == 0) {
+    throw BucketNameRequiredException();
+  } else if (key.size() > MaxKeySize) {
+    throw KeyTooLargeException();
+  }
+
+  // Move cursor to correct position.
+  Cursor c(this);
+  auto [k, v, kflags] = with_comparator(this->comparator(), [&](auto cmp) { return c.seek_<decltype(cmp)>(key); });
+
+  // Return an error if there is an existing key.
+  if (k && with_comparator(this->comparator(), [&](auto cmp) { return decltype(cmp)::compare(*k, key) == 0; })) {
+    if (kflags & BucketLeafFlag) {
+      throw BucketExistsException();
+    }
+    throw IncompatibleValueException();
+  }
+
+  // Create an empty, inline bucket: the header followed by an empty leaf.
+  struct bucket b = {0, 0, flags, comparator};
+  size_t size = sizeof(b) + pageHeaderSize;
+  char *value = this->tx_->alloc(size);
+  std::memcpy(value, &b, sizeof(b));
+  new (value + sizeof(b)) Page(0, (flags & BucketU64KeysFlag) ? LeafPageFlag | U64KeyPageFlag : LeafPageFlag);
+
+  // Insert into node.
+  c.node()->put(key, key, Slice(value, size), 0, BucketLeafFlag);
+
+  // Since subbuckets are not allowed on inline buckets, we need to
+  // dereference the inline page, if it exists. This will cause the bucket
+  // to be treated as a regular, non-inline bucket for the rest of the tx.
+  this->page = nullptr;
+
+  return this->bucket(key);
+}
+
+Bucket *Bucket::create_bucket_if_not_exists(Slice key) {
+  try {
+    return this->create_bucket(key);
+  } catch (BucketExistsException &) {
+    return this->bucket(key);
+  }
+}
+
+Bucket *Bucket::bucket(Slice name) {
+  auto search = this->buckets_.find(name.ToString());
+  if (search != this->buckets_.end()) {
+    return search->second;
+  }
+
+  // Move cursor to key.
+  Cursor c(this);
+  auto [k, v, flags] = with_comparator(this->comparator(), [&](auto cmp) { return c.seek_<decltype(cmp)>(name); });
+
+  // Return nil if the key doesn't exist or it is not a bucket.
+  if (!k || !(flags & BucketLeafFlag) ||
+      with_comparator(this->comparator(), [&](auto cmp) { return decltype(cmp)::compare(*k, name) != 0; })) {
+    return nullptr;
+  }
+
+  // Otherwise create a bucket and cache it.
+  Bucket *child = this->open_bucket(*v);
+  this->buckets_[name.ToString()] = child;
+  return child;
+}
+
+Bucket *Bucket::open_bucket(Slice value) {
+  Bucket *child = new Bucket(this->tx_);
+
+  // The header may be unaligned inside the page, so it is copied out.
+  struct bucket b;
+  std::memcpy(&b, value.data(), sizeof(b));
+  child->set_bucket(b);
+
+  // Save a reference to the inline page if the bucket is inline.
+  if (child->inline_()) {
+    child->page = reinterpret_cast<Page *>(const_cast<char *>(value.data()) + sizeof(b));
+  }
+  return child;
+}
+
+Cursor *Bucket::cursor() { return new Cursor(this); }
+
+Slice Bucket::get(Slice key) const {
+  Cursor c(const_cast<Bucket *>(this));
+  auto [k, v, flags] = with_comparator(this->comparator(), [&](auto cmp) {
+    using Cmp = decltype(cmp);
+    auto kvf = c.seek_<Cmp>(key);
+    if (std::get<0>(kvf) && Cmp::compare(*std::get<0>(kvf), key) != 0) {
+      std::get<0>(kvf).reset();
+    }
+    return kvf;
+  });
+
+  // Return nothing if this is a bucket or if the key doesn't match.
+  if (!k || (flags & BucketLeafFlag)) {
+    return Slice();
+  }
+  return *v;
+}
+
+void Bucket::put(Slice key, Slice value) {
+  if (this->tx_->db() == nullptr) {
+    throw TxClosedException();
+  } else if (!this->writable()) {
+    throw TxNotWritableException();
+  } else if (key.size() == 0) {
+    throw KeyRequiredException();
+  } else if (key.size() > MaxKeySize) {
+    throw KeyTooLargeException();
+  } else if (value.size() > MaxValueSize) {
+    throw ValueTooLargeException();
+  }
+
+  // Move cursor to correct position.
+  Cursor c(this);
+  auto [k, v, flags] = with_comparator(this->comparator(), [&](auto cmp) { return c.seek_<decltype(cmp)>(key); });
+
+  // Return an error if there is an existing key with a bucket value.
+  if (k && (flags & BucketLeafFlag) &&
+      with_comparator(this->comparator(), [&](auto cmp) { return decltype(cmp)::compare(*k, key) == 0; })) {
+    throw IncompatibleValueException();
+  }
+
+  // Insert into node.
+  c.node()->put(key, key, value, 0, 0);
+}
+
+void Bucket::delete_range(Slice begin, Slice end) {
+  if (this->tx_->db() == nullptr) {
+    throw TxClosedException();
+  } else if (!this->writable()) {
+    throw TxNotWritableException();
+  }
+  bool empty = with_comparator(this->comparator(), [&](auto cmp) { return decltype(cmp)::compare(begin, end) >= 0; });
+  if (empty) {
+    return;
+  }
+  this->node(this->root(), nullptr)->delete_range(begin, end);
+}
+
+void Bucket::put_batch(gsl::span<KV> kvs) {
+  if (this->tx_->db() == nullptr) {
+    throw TxClosedException();
+  } else if (!this->writable()) {
+    throw TxNotWritableException();
+  }
+  for (auto &kv : kvs) {
+    if (kv.key.size() == 0) {
+      throw KeyRequiredException();
+    } else if (kv.key.size() > MaxKeySize) {
+      throw KeyTooLargeException();
+    } else if (kv.value.size() > MaxValueSize) {
+      throw ValueTooLargeException();
+    }
+  }
+
+  Cursor c(this);
+  c.put_batch(kvs);
+}
+
+void Bucket::get_many(gsl::span<const Slice> keys, std::vector<std::optional<Slice>> *values) {
+  Cursor c(this);
+  c.get_many(keys, values);
+}
 
-Cursor *Bucket::cursor() { return nullptr; }
+void Bucket::delete_bucket(Slice key) {
+  if (this->tx_->db() == nullptr) {
+    throw TxClosedException();
+  } else if (!this->writable()) {
+    throw TxNotWritableException();
+  }
 
-Bucket *Bucket::bucket(Slice name) { return nullptr; }
+  // Move cursor to correct position.
+  Cursor c(this);
+  auto [k, v, flags] = with_comparator(this->comparator(), [&](auto cmp) {
+    using Cmp = decltype(cmp);
+    auto kvf = c.seek_<Cmp>(key);
+    if (!std::get<0>(kvf) || Cmp::compare(*std::get<0>(kvf), key) != 0) {
+      throw BucketNotFoundException();
+    }
+    return kvf;
+  });
+  if (!(flags & BucketLeafFlag)) {
+    throw IncompatibleValueException();
+  }
 
-Bucket *Bucket::create_bucket_if_not_exists(Slice key) { return nullptr; }
+  // Drop the cached bucket so that its nodes are not spilled. Along with
+  // them go the pages it deleted from, which its committed tree still holds.
+  auto cached = this->buckets_.find(k->ToString());
+  if (cached != this->buckets_.end()) {
+    delete cached->second;
+    this->buckets_.erase(cached);
+  }
 
-void Bucket::delete_bucket(Slice key) {}
+  // Unlink the bucket and leave its pages, and those of its nested buckets,
+  // to the commits, instead of walking a possibly huge tree while holding
+  // the writer lock. An inline bucket has no pages of its own.
+  struct bucket b;
+  std::memcpy(&b, v->data(), sizeof(b));
+  if (b.root != 0) {
+    this->orphaned_.push_back(b.root);
+  }
+  c.node()->del(key);
+}
 
-void Bucket::delete_by_key(Slice key) {}
+void Bucket::rebalance() {
+  // Merging may drop nodes from the cache, which must not be rebalanced
+  // afterwards, so go over a copy and skip those.
+  std::vector<std::pair<pgid_t, Node *>> nodes(this->nodes.begin(), this->nodes.end());
+  for (auto &[id, n] : nodes) {
+    auto search = this->nodes.find(id);
+    if (search != this->nodes.end() && search->second == n) {
+      n->rebalance();
+    }
+  }
+  for (auto &it : this->buckets_) {
+    it.second->rebalance();
+  }
+}
+
+void Bucket::spill() {
+  this->free_deleted();
+
+  // Spill all child buckets first.
+  for (auto &it : this->buckets_) {
+    Bucket *child = it.second;
+    Slice name(it.first.data(), it.first.size());
+
+    // If the child bucket is small enough and it has no child buckets then
+    // write it inline into the parent bucket's page. Otherwise spill it
+    // like a normal bucket and make the parent value a pointer to the page.
+    Slice value;
+    if (child->inlineable()) {
+      child->free_deleted();
+      child->free();
+      value = child->write();
+    } else {
+      child->spill();
+
+      // Update the child bucket header in this bucket.
+      char *header = this->tx_->alloc(sizeof(struct bucket));
+      std::memcpy(header, &child->bucket_, sizeof(struct bucket));
+      value = Slice(header, sizeof(struct bucket));
+    }
+
+    // Skip writing the bucket if there are no materialized nodes.
+    if (!child->rootNode) {
+      continue;
+    }
+
+    // Update parent node.
+    Cursor c(this);
+    auto [k, v, flags] = with_comparator(this->comparator(), [&](auto cmp) { return c.seek_<decltype(cmp)>(name); });
+    if (!k || k->compare(name) != 0) {
+      std::cerr << "misplaced bucket header: " << (k ? k->ToString(true) : "") << " -> " << name.ToString(true)
+                << "\n";
+      std::exit(1);
+    }
+    if (!(flags & BucketLeafFlag)) {
+      std::cerr << "unexpected bucket header flag: " << flags << "\n";
+      std::exit(1);
+    }
+    c.node()->put(name, name, value, 0, BucketLeafFlag);
+  }
+
+  // Ignore if there's not a materialized root node.
+  if (!this->rootNode) {
+    return;
+  }
+
+  // Spill nodes.
+  this->rootNode->spill();
+  this->rootNode = this->rootNode->root();
+
+  // Update the root node for this bucket.
+  if (this->rootNode->id() >= this->tx_->meta()->pgid) {
+    std::cerr << "pgid (" << this->rootNode->id() << ") above high water mark (" << this->tx_->meta()->pgid
+              << ")\n";
+    std::exit(1);
+  }
+  this->bucket_.root = this->rootNode->id();
+}
+
+void Bucket::free_deleted() {
+  FreeList *f = this->tx_->db()->freelist_;
+  for (pgid_t id : this->freed_) {
+    f->free(this->tx_->meta()->txid, this->tx_->page(id));
+  }
+  for (pgid_t root : this->orphaned_) {
+    f->orphan(root);
+  }
+  this->freed_.clear();
+  this->orphaned_.clear();
+}
+
+bool Bucket::inlineable() const {
+  Node *n = this->rootNode;
+
+  // Bucket must only contain a single leaf node.
+  if (!n || !n->isLeaf()) {
+    return false;
+  }
+
+  // Bucket is not inlineable if it contains subbuckets or if it goes beyond
+  // our threshold for inline bucket size.
+  int size = pageHeaderSize;
+  for (auto &inode : n->inodes) {
+    size += leafPageElementSize + inode.key.size() + inode.value.size();
+    if (inode.flags & BucketLeafFlag) {
+      return false;
+    } else if (size > this->max_inline_bucket_size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int Bucket::max_inline_bucket_size() const { return this->tx_->db()->page_size() / 4; }
+
+Slice Bucket::write() {
+  // Allocate the appropriate size.
+  Node *n = this->rootNode;
+  size_t size = sizeof(struct bucket) + n->size();
+  char *value = this->tx_->alloc(size);
+
+  // Write a bucket header.
+  std::memcpy(value, &this->bucket_, sizeof(struct bucket));
+
+  // Convert byte slice to a fake page and write the root node.
+  Page *p = new (value + sizeof(struct bucket)) Page(0, 0);
+  n->write(p);
+  return Slice(value, size);
+}
+
+void Bucket::free() {
+  if (this->bucket_.root == 0) {
+    return;
+  }
+
+  Tx *tx = this->tx_;
+  this->for_each_page_node(this->bucket_.root, [tx](Page *p, Node *n) {
+    if (p) {
+      tx->db()->freelist_->free(tx->meta()->txid, p);
+    } else {
+      n->free();
+    }
+  });
+  this->bucket_.root = 0;
+}
+
+void Bucket::for_each_page_node(pgid_t id, std::function<void(Page *, Node *)> fn) {
+  auto [p, n] = this->page_node(id);
+  fn(p, n);
+
+  // Recursively loop over children.
+  if (p && (p->flags() & BranchPageFlag)) {
+    for (std::uint32_t i = 0; i < p->count(); i++) {
+      this->for_each_page_node(p->branchPageElement(i)->id, fn);
+    }
+  } else if (n && !n->isLeaf()) {
+    for (auto &inode : n->inodes) {
+      this->for_each_page_node(inode.id, fn);
+    }
+  }
+}
+
+void Bucket::delete_by_key(Slice key) {
+  if (this->tx_->db() == nullptr) {
+    throw TxClosedException();
+  } else if (!this->writable()) {
+    throw TxNotWritableException();
+  }
+
+  // Move cursor to correct position.
+  Cursor c(this);
+  auto [k, v, flags] = with_comparator(this->comparator(), [&](auto cmp) { return c.seek_<decltype(cmp)>(key); });
+
+  // Return an error if there is already existing bucket value.
+  if (k && (flags & BucketLeafFlag) &&
+      with_comparator(this->comparator(), [&](auto cmp) { return decltype(cmp)::compare(*k, key) == 0; })) {
+    throw IncompatibleValueException();
+  }
+
+  // Delete the node if we have a matching key.
+  c.node()->del(key);
+}
+
+std::uint64_t Bucket::sequence() { return this->bucket_.sequence; }
+
+void Bucket::set_sequence(std::uint64_t v) {
+  if (this->tx_->db() == nullptr) {
+    throw TxClosedException();
+  } else if (!this->writable()) {
+    throw TxNotWritableException();
+  }
+
+  // Materialize the root node if it hasn't been already so that the
+  // bucket will be saved during commit.
+  if (!this->rootNode) {
+    this->node(this->root(), nullptr);
+  }
+
+  // Set the sequence.
+  this->bucket_.sequence = v;
+}
+
+std::uint64_t Bucket::next_sequence() {
+  this->set_sequence(this->bucket_.sequence + 1);
+  return this->bucket_.sequence;
+}
 
 void Bucket::for_each(std::function<void(Slice key, Slice value)> fn) {
+  Cursor c(this);
+  for (auto [k, v] = c.first(); k; std::tie(k, v) = c.next()) {
+    fn(*k, v ? *v : Slice());
+  }
+}
+
+static BucketStats nested_stats(Tx *tx, Slice value);
+
+// leaf_stats accounts for the elements of a leaf page, including the nested
+// buckets stored in it.
+static void leaf_stats(Tx *tx, Page *p, BucketStats *s) {
+  std::int64_t used = pageHeaderSize + p->count() * leafPageElementSize;
+  for (std::uint32_t i = 0; i < p->count(); i++) {
+    LeafPageElement *elem = p->leafPageElement(i);
+    used += elem->ksize + elem->vsize;
+    if (elem->flags & BucketLeafFlag) {
+      *s += nested_stats(tx, elem->value());
+    }
+  }
+  s->key_n += p->count();
+  s->leaf_inuse += used;
+}
+
+// tree_stats accounts for a page at the given depth and every page below it.
+static void tree_stats(Tx *tx, pgid_t id, int depth, BucketStats *s) {
+  Page *p = tx->page(id);
+  s->depth = std::max(s->depth, depth);
+  if (p->flags() & LeafPageFlag) {
+    s->leaf_page_n++;
+    s->leaf_overflow_n += p->overflow();
+    leaf_stats(tx, p, s);
+    return;
+  }
+
+  s->branch_page_n++;
+  s->branch_overflow_n += p->overflow();
+  std::int64_t used = pageHeaderSize + p->count() * branchPageElementSize;
+  for (std::uint32_t i = 0; i < p->count(); i++) {
+    BranchPageElement *elem = p->branchPageElement(i);
+    used += elem->ksize;
+    tree_stats(tx, elem->id, depth + 1, s);
+  }
+  s->branch_inuse += used;
+}
+
+// nested_stats computes the stats of a nested bucket from its value.
+static BucketStats nested_stats(Tx *tx, Slice value) {
+  BucketStats s = {};
+  s.bucket_n = 1;
+
+  struct bucket b;
+  std::memcpy(&b, value.data(), sizeof(b));
+  if (b.root != 0) {
+    tree_stats(tx, b.root, 1, &s);
+    return s;
+  }
+
+  // An inline bucket's page follows its header in the value and is already
+  // accounted for in the parent's leaf.
+  Page *p = reinterpret_cast<Page *>(const_cast<char *>(value.data()) + sizeof(b));
+  s.depth = 1;
+  s.inline_bucket_n = 1;
+  leaf_stats(tx, p, &s);
+  s.inline_bucket_inuse = s.leaf_inuse;
+  s.leaf_inuse = 0;
+  return s;
+}
+
+BucketStats Bucket::stats(int threads) {
+  BucketStats s = {};
+  s.bucket_n = 1;
+  Tx *tx = this->tx_;
+
+  if (this->inline_()) {
+    s.depth = 1;
+    s.inline_bucket_n = 1;
+    if (this->page) {
+      leaf_stats(tx, this->page, &s);
+      s.inline_bucket_inuse = s.leaf_inuse;
+      s.leaf_inuse = 0;
+    }
+    return s;
+  }
+
+  Page *root = tx->page(this->bucket_.root);
+  int children = (root->flags() & BranchPageFlag) ? root->count() : 0;
+  if (threads <= 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  int workers = std::min(threads, children);
+  if (children < ParallelStatsMinChildren || workers < 2) {
+    tree_stats(tx, this->bucket_.root, 1, &s);
+  } else {
+    // Account for the root here and hand its subtrees out to the workers.
+    // Pages are only read, so the walks don't need any locking.
+    s.depth = 1;
+    s.branch_page_n = 1;
+    s.branch_overflow_n = root->overflow();
+    s.branch_inuse = pageHeaderSize + children * branchPageElementSize;
+    for (int i = 0; i < children; i++) {
+      s.branch_inuse += root->branchPageElement(i)->ksize;
+    }
+
+    std::atomic<int> next(0);
+    std::vector<BucketStats> partial(workers, BucketStats());
+    std::vector<std::thread> walkers;
+    for (int w = 0; w < workers; w++) {
+      walkers.emplace_back([&, w] {
+        for (int i = next++; i < children; i = next++) {
+          tree_stats(tx, root->branchPageElement(i)->id, 2, &partial[w]);
+        }
+      });
+    }
+    for (auto &t : walkers) {
+      t.join();
+    }
+    for (auto &p : partial) {
+      s += p;
+    }
+  }
+
+  int page_size = tx->db()->page_size();
+  s.branch_alloc = static_cast<std::int64_t>(s.branch_page_n + s.branch_overflow_n) * page_size;
+  s.leaf_alloc = static_cast<std::int64_t>(s.leaf_page_n + s.leaf_overflow_n) * page_size;
+  return s;
 }
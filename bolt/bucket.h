@@ -2,21 +2,72 @@
 #define __BOLT_BUCKET_H
 
 #include <gsl/gsl>
+#include "comparator.h"
 #include "types.h"
 #include <cstdint>
+#include <functional>
 #include <map>
+#include <optional>
 #include <string>
+#include <vector>
 #include "slice.h"
+#include "stats.h"
 
 class Node;
 class Tx;
 class Page;
 class Cursor;
 
+// MaxKeySize is the maximum length of a key, in bytes.
+const size_t MaxKeySize = 32768;
+
+// MaxValueSize is the maximum length of a value, in bytes.
+const size_t MaxValueSize = (1u << 31) - 2;
+
+// Buckets whose root has at least this many children are walked by several
+// threads in stats().
+const int ParallelStatsMinChildren = 64;
+
 // DefaultFillPercent is the percentage that split pages are filled.
 // This value can be changed by setting Bucket.FillPercent.
 const double DefaultFillPercent = 0.5;
 
+// MinFillPercent and MaxFillPercent bound Bucket::fillPercent.
+const double MinFillPercent = 0.1;
+const double MaxFillPercent = 1.0;
+
+// RebalancePolicy controls when the nodes of a bucket are merged after
+// deletions. Splits are controlled by Bucket::fillPercent.
+struct RebalancePolicy {
+  // MergePercent is the fill, as a fraction of the page size, below which a
+  // node is merged with a sibling. Nodes with too few keys are always merged.
+  double MergePercent;
+
+  // MaxMergePercent skips merges that would produce a node fuller than this
+  // fraction of the page size. Keeping it below fillPercent leaves a gap
+  // between the two thresholds, so alternating inserts and deletes don't
+  // split and merge the same page over and over.
+  //
+  // If <= 0, nodes are merged whatever their combined size.
+  double MaxMergePercent;
+
+  // Lazy defers merges to a later commit: a node is only merged if it was
+  // already below MergePercent when the transaction read it. A page that a
+  // queue drains over several commits is then merged once, not rewritten
+  // together with its sibling by every commit.
+  bool Lazy;
+};
+
+// DefaultRebalancePolicy merges nodes below a quarter page right away.
+const RebalancePolicy DefaultRebalancePolicy = {/* .MergePercent */ 0.25, /* .MaxMergePercent */ 0,
+                                                /* .Lazy */ false};
+
+// KV is a key/value pair written by Bucket::put_batch().
+struct KV {
+  Slice key;
+  Slice value;
+};
+
 // bucket represents the on-file representation of a bucket.
 // This is stored as the "value" of a bucket key. If the bucket is small enough,
 // then its root page can be stored inline in the "value", after the bucket
@@ -24,23 +75,43 @@ const double DefaultFillPercent = 0.5;
 struct bucket {
   pgid_t root;
   std::uint64_t sequence;
+  std::uint32_t flags;
+  std::uint32_t comparator; // id of the comparator ordering the keys
 };
 
+// BucketU64KeysFlag marks a bucket whose keys are all 8-byte big-endian
+// integers, see encode_u64_key(). Its pages pack the keys into an integer
+// array that lookups search without comparing slices.
+const std::uint32_t BucketU64KeysFlag = 0x01;
+
 // Bucket represents a collection of key/value pairs inside the database.
 class Bucket {
 public:
   Bucket(Tx *tx);
+  ~Bucket();
+
+  Bucket(const Bucket &) = delete;
+  Bucket &operator=(const Bucket &) = delete;
 
   void set_bucket(const struct bucket &b);
   // node creates a node from a page and associates it with a given parent.
   Node *node(pgid_t id, const Node *parent);
 
+  // new_node allocates a node that lives as long as the bucket.
+  Node *new_node(bool isLeaf, Node *parent);
+
   gsl::not_null<Tx *> tx();
   //  { return tx_; }
 
   // root returns the root of the bucket.
   pgid_t root() { return bucket_.root; }
 
+  // u64_keys returns whether the bucket was created with BucketU64KeysFlag.
+  bool u64_keys() const { return bucket_.flags & BucketU64KeysFlag; }
+
+  // comparator returns the id of the comparator that orders the keys.
+  std::uint32_t comparator() const { return bucket_.comparator; }
+
   // writable returns whether the bucket is writable.
   bool writable();
 
@@ -60,18 +131,69 @@ public:
   // if the
   // bucket name is too long.
   // The bucket instance is only valid for the lifetime of the transaction.
-  Bucket *create_bucket(Slice key);
+  // flags is a combination of bucket flags such as BucketU64KeysFlag, and
+  // comparator the id of the comparator that orders the keys of the bucket.
+  // BucketU64KeysFlag requires the BytewiseComparator.
+  Bucket *create_bucket(Slice key, std::uint32_t flags = 0, std::uint32_t comparator = BytewiseComparator::id);
+
+  // create_bucket<Cmp> creates a bucket whose keys are ordered by Cmp.
+  template <class Cmp> Bucket *create_bucket(Slice key, std::uint32_t flags = 0) {
+    return this->create_bucket(key, flags, Cmp::id);
+  }
 
+  // create_bucket_if_not_exists creates a new bucket if it doesn't already
+  // exist and returns a reference to it.
+  // Throws if the bucket name is blank, or if the bucket name is too long.
+  // The bucket instance is only valid for the lifetime of the transaction.
   Bucket *create_bucket_if_not_exists(Slice key);
 
+  // delete_bucket deletes a nested bucket at the given key. The key is
+  // removed right away and the bucket's pages are freed by this and later
+  // commits, so deleting a large bucket takes constant time. Throws
+  // BucketNotFoundException if the key doesn't exist and
+  // IncompatibleValueException if it isn't a bucket.
   void delete_bucket(Slice key);
 
+  // get retrieves the value for a key in the bucket.
+  // Returns an empty slice if the key does not exist or if the key is a
+  // nested bucket. The returned value is only valid for the life of the
+  // transaction.
   Slice get(Slice key) const;
 
+  // get_many looks up several keys at once and stores the value of keys[i]
+  // in (*values)[i], or nullopt if the key doesn't exist or is a nested
+  // bucket. The keys are looked up in sorted order by a single cursor, so
+  // pages shared by neighbouring keys are only searched once.
+  void get_many(gsl::span<const Slice> keys, std::vector<std::optional<Slice>> *values);
+
+  // put sets the value for a key in the bucket. If the key exist then its
+  // previous value will be overwritten. The key and value are not copied and
+  // must stay valid until the transaction ends.
+  // Throws if the bucket was created from a read-only transaction, if the key
+  // is blank, if the key is too large, or if the value is too large.
   void put(Slice key, Slice value);
 
+  // put_batch sets the values of several keys. The batch is sorted and each
+  // run of keys that falls into the same leaf is merged into it in a single
+  // pass, instead of inserting the keys into the leaf one by one. If a key
+  // appears more than once the last value wins. kvs is reordered and, like
+  // with put(), the keys and values must stay valid until the transaction
+  // ends.
+  void put_batch(gsl::span<KV> kvs);
+
+  // delete_by_key removes a key from the bucket. If the key does not exist
+  // then nothing is done.
+  // Throws if the bucket was created from a read-only transaction or if the
+  // key is a nested bucket.
   void delete_by_key(Slice key);
 
+  // delete_range removes every key in [begin, end). Subtrees that lie
+  // entirely inside the range are freed page by page when the bucket is
+  // committed, without being read into nodes; only the nodes along the paths
+  // to begin and end are edited. Throws IncompatibleValueException if the range
+  // holds a nested bucket, after which the transaction must be rolled back.
+  void delete_range(Slice begin, Slice end);
+
   // sequence returns the current integer for the bucket without incrementing
   // it.
   std::uint64_t sequence();
@@ -89,6 +211,11 @@ public:
   // inline_ checks whether the bucket is inline
   bool inline_();
 
+  // stats retrieves stats on a bucket, including its nested buckets.
+  // The subtrees of a large bucket are walked in parallel by up to threads
+  // threads, one per hardware thread if threads is 0.
+  BucketStats stats(int threads = 0);
+
   // Sets the threshold for filling nodes when they split. By default,
   // the bucket will fill to 50% but it can be useful to increase this
   // amount if you know that your write workloads are mostly append-only.
@@ -97,6 +224,12 @@ public:
   // Tx.
   double fillPercent;
 
+  // rebalancePolicy controls when nodes are merged after deletions. Like
+  // fillPercent it is not persisted and must be set in every Tx.
+  RebalancePolicy rebalancePolicy;
+
+  // for_each executes a function for each key/value pair in the bucket.
+  // Nested buckets are passed with an empty value.
   void for_each(std::function<void(Slice key, Slice value)> fn);
 
 private:
@@ -104,12 +237,56 @@ private:
   // a parent into a Bucket.
   Bucket *open_bucket(Slice value);
 
+  // rebalance attempts to balance all nodes.
+  void rebalance();
+
+  // spill writes all the nodes for this bucket to dirty pages.
+  void spill();
+
+  // inlineable returns true if a bucket is small enough to be written inline
+  // and if it contains no subbuckets. Otherwise returns false.
+  bool inlineable() const;
+
+  // max_inline_bucket_size returns the maximum total size of a bucket to
+  // make it a candidate for inlining.
+  int max_inline_bucket_size() const;
+
+  // write allocates and writes a bucket to a byte slice owned by the
+  // transaction.
+  Slice write();
+
+  // free recursively frees all pages in the bucket.
+  void free();
+
+  // free_deleted hands the pages dropped by delete_range and the trees of
+  // the nested buckets deleted from this bucket to the freelist.
+  void free_deleted();
+
+  // for_each_page_node iterates over every page (or node) under a given
+  // page, passing the page if it isn't materialized and the node otherwise.
+  void for_each_page_node(pgid_t id, std::function<void(Page *, Node *)> fn);
+
   struct bucket bucket_;
   gsl::not_null<Tx *> tx_;                  // the associated transaction
   std::map<std::string, Bucket *> buckets_; // subbucket cache
   Page *page;                               // inline page reference
   Node *rootNode;                           // materialized node for the root page
   std::map<pgid_t, Node *> nodes;           // node cache
+
+  // Every node allocated for the bucket. Rebalancing and splitting add and
+  // drop nodes from the cache while they may still be referenced, so they
+  // are all freed with the bucket instead.
+  std::vector<gsl::owner<Node *>> owned_;
+
+  // Pages dropped by delete_range and roots of deleted nested buckets. The
+  // committed tree of this bucket still refers to them, so they are only
+  // freed when the bucket is spilled: if the bucket itself is deleted first,
+  // its own tree is orphaned instead and they must not be freed twice.
+  std::vector<pgid_t> freed_;
+  std::vector<pgid_t> orphaned_;
+
+  friend class Node;
+  friend class Tx;
 };
 
 #endif
\ No newline at end of file
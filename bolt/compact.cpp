@@ -0,0 +1,151 @@
+#include "compact.h"
+#include "bucket.h"
+#include "db.h"
+#include "meta.h"
+#include "page.h"
+#include "tx.h"
+#include <cstring>
+#include <iostream>
+#include <new>
+
+Compactor::Compactor(Tx *tx, os::File *dst)
+    : tx_(tx), dst_(dst), page_size_(tx->db()->page_size()), next_(3) {}
+
+std::int64_t Compactor::run() {
+  // Pages 0 and 1 hold the meta pages and page 2 the (empty) freelist.
+  const struct bucket *rootBucket = &this->tx_->meta()->root;
+  pgid_t root = this->compact_bucket(rootBucket->root, rootBucket->flags & BucketU64KeysFlag);
+  this->write_meta(root);
+  return static_cast<std::int64_t>(this->next_) * this->page_size_;
+}
+
+pgid_t Compactor::compact_bucket(pgid_t root, bool u64Keys) {
+  Level leaves = {true, u64Keys, static_cast<int>(pageHeaderSize), {}, {}};
+  this->walk(root, leaves);
+  this->flush(leaves);
+
+  // Always write a leaf, even for an empty bucket.
+  if (leaves.refs.empty()) {
+    leaves.refs.push_back({0, this->write_page(leaves, pageHeaderSize), Slice(), Slice()});
+  }
+
+  // Build branch levels until a single page covers the whole tree.
+  std::vector<INode> refs = std::move(leaves.refs);
+  while (refs.size() > 1) {
+    Level branches = {false, u64Keys, static_cast<int>(pageHeaderSize), {}, {}};
+    for (auto &ref : refs) {
+      this->append(branches, ref);
+    }
+    this->flush(branches);
+    refs = std::move(branches.refs);
+  }
+
+  // Nested buckets go after the whole tree so that its pages stay contiguous.
+  // Each one's header is patched with its new root once it is written.
+  std::vector<Nested> nested = std::move(this->nested_);
+  this->nested_.clear();
+  for (auto &n : nested) {
+    n.b.root = this->compact_bucket(n.b.root, n.b.flags & BucketU64KeysFlag);
+    std::string buf(reinterpret_cast<const char *>(&n.b), sizeof(n.b));
+    this->dst_->write_at(buf, n.off);
+  }
+  return refs[0].id;
+}
+
+void Compactor::walk(pgid_t id, Level &leaves) {
+  Page *p = this->tx_->page(id);
+  if (p->flags() & BranchPageFlag) {
+    for (std::uint32_t i = 0; i < p->count(); i++) {
+      this->walk(p->branchPageElement(i)->id, leaves);
+    }
+    return;
+  }
+
+  for (std::uint32_t i = 0; i < p->count(); i++) {
+    LeafPageElement *elem = p->leafPageElement(i);
+    Slice key = (p->flags() & U64KeyPageFlag) ? p->u64Key(i) : elem->key();
+    this->append(leaves, {elem->flags, 0, key, elem->value()});
+  }
+}
+
+void Compactor::append(Level &level, const INode &inode) {
+  int elsz = level.isLeaf ? leafPageElementSize : branchPageElementSize;
+  int sz = elsz + inode.key.size() + inode.value.size();
+  if (!level.inodes.empty() && level.size + sz > this->page_size_) {
+    this->flush(level);
+  }
+  level.inodes.push_back(inode);
+  level.size += sz;
+}
+
+void Compactor::flush(Level &level) {
+  if (level.inodes.empty()) {
+    return;
+  }
+  INode ref = {0, this->write_page(level, level.size), level.inodes[0].key, Slice()};
+  level.refs.push_back(ref);
+  level.inodes.clear();
+  level.size = pageHeaderSize;
+}
+
+pgid_t Compactor::write_page(const Level &level, int size) {
+  if (level.inodes.size() > 0xffff) {
+    std::cerr << "compact: page's count is overflow\n";
+    std::exit(1);
+  }
+
+  // Allocate enough contiguous pages to hold the elements.
+  int count = (size + this->page_size_ - 1) / this->page_size_;
+  pgid_t id = this->next_;
+  this->next_ += count;
+
+  std::string buf(static_cast<size_t>(count) * this->page_size_, '\0');
+  char *data = &buf[0];
+  Page *p = new (data) Page(id, 0);
+  p->setOverflow(count - 1);
+  write_inodes(p, level.inodes, level.isLeaf, level.u64Keys);
+
+  // Queue the nested buckets to be compacted after this tree. Inline buckets
+  // are position independent and copied as is.
+  std::int64_t off = static_cast<std::int64_t>(id) * this->page_size_;
+  for (std::uint32_t i = 0; level.isLeaf && i < p->count(); i++) {
+    LeafPageElement *elem = p->leafPageElement(i);
+    if (elem->flags & BucketLeafFlag) {
+      Nested n;
+      std::memcpy(&n.b, elem->value().data(), sizeof(n.b));
+      if (n.b.root != 0) {
+        n.off = off + (elem->value().data() - data);
+        this->nested_.push_back(n);
+      }
+    }
+  }
+
+  this->dst_->write_at(buf, off);
+  return id;
+}
+
+void Compactor::write_meta(pgid_t root) {
+  std::string buf(3 * static_cast<size_t>(this->page_size_), '\0');
+
+  // Write an empty freelist at page 2.
+  char *data = &buf[2 * this->page_size_];
+  Page *p = new (data) Page(2, FreelistPageFlag);
+  p->setCount(0);
+
+  // Both meta pages describe the compacted tree. The source txid goes on the
+  // page Meta::write() picks for it and the previous txid on the other one, so
+  // the copy is never newer than the snapshot it was taken from.
+  for (int i = 0; i < 2; i++) {
+    Meta m = *this->tx_->meta();
+    m.root.root = root;
+    m.flags |= MetaCompactedFlag;
+    m.freelist = 2;
+    m.pgid = this->next_;
+    m.txid -= i;
+
+    data = &buf[(m.txid % 2) * this->page_size_];
+    p = new (data) Page(0, 0);
+    m.write(p);
+  }
+  this->dst_->write_at(buf, 0);
+}
@@ -0,0 +1,76 @@
+#ifndef __BOLT_COMPACT_H
+#define __BOLT_COMPACT_H
+
+#include "molly/os/file.h"
+#include "bucket.h"
+#include "node.h"
+#include "types.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Tx;
+
+namespace os = molly::os;
+
+// Compactor rewrites every bucket visible to a transaction into a fresh file.
+// Instead of copying pages verbatim, the leaves of each bucket are laid out in
+// key order on full pages followed by the branch levels above them and then by
+// its nested buckets, and the new file has no free pages. Only the source transaction's pages are read, so
+// a read-only transaction is enough and writers can continue meanwhile.
+class Compactor {
+public:
+  Compactor(Tx *tx, os::File *dst);
+
+  // run writes the compacted database and returns its size in bytes.
+  std::int64_t run();
+
+private:
+  // Level collects the elements of one tree level and packs them into pages.
+  struct Level {
+    bool isLeaf;
+    bool u64Keys;              // pages pack their keys, see U64KeyPageFlag
+    int size;                  // serialized size of the pending page
+    std::vector<INode> inodes; // elements of the pending page
+    std::vector<INode> refs;   // first key and pgid of every written page
+  };
+
+  // Nested is a nested bucket found while writing a leaf page. Its header is
+  // written with the source root and patched once the bucket is compacted.
+  struct Nested {
+    std::int64_t off; // file offset of the bucket header
+    struct bucket b;  // bucket header in the source
+  };
+
+  // compact_bucket rewrites the tree rooted at a source page, then its nested
+  // buckets, and returns the pgid of its new root. u64Keys is set for buckets
+  // with BucketU64KeysFlag.
+  pgid_t compact_bucket(pgid_t root, bool u64Keys);
+
+  // walk appends the leaf elements under a source page to the leaf level in
+  // key order.
+  void walk(pgid_t id, Level &leaves);
+
+  // append adds an element to a level, writing out the pending page first if
+  // the element does not fit.
+  void append(Level &level, const INode &inode);
+
+  // flush writes out the pending page of a level.
+  void flush(Level &level);
+
+  // write_page serializes the pending elements of a level onto newly
+  // allocated pages and returns the pgid of the first one. Nested buckets of a
+  // leaf level are queued on nested_.
+  pgid_t write_page(const Level &level, int size);
+
+  // write_meta writes the meta pages and the empty freelist page.
+  void write_meta(pgid_t root);
+
+  Tx *tx_;
+  os::File *dst_;
+  int page_size_;
+  pgid_t next_;                // next pgid to allocate in the new file
+  std::vector<Nested> nested_; // nested buckets of the tree being written
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef __BOLT_COMPARATOR_H
+#define __BOLT_COMPARATOR_H
+
+#include "slice.h"
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// A comparator orders the keys of a bucket. It is a type rather than an
+// object so that searches templated on it get the comparison inlined:
+//
+//   struct Comparator {
+//     static constexpr std::uint32_t id;                  // stored in the bucket header
+//     static int compare(const Slice &a, const Slice &b); // <0, 0 or >0 like Slice::compare
+//   };
+//
+// The id is persisted, so the comparator of an existing bucket can never
+// change and ids are never reused.
+
+// BytewiseComparator orders keys by memcmp. It is the default.
+struct BytewiseComparator {
+  static constexpr std::uint32_t id = 0;
+  static int compare(const Slice &a, const Slice &b) { return a.compare(b); }
+};
+
+// ReverseBytewiseComparator orders keys by memcmp, largest first.
+struct ReverseBytewiseComparator {
+  static constexpr std::uint32_t id = 1;
+  static int compare(const Slice &a, const Slice &b) { return b.compare(a); }
+};
+
+// CaseInsensitiveComparator orders keys by memcmp with ASCII letters folded
+// to lower case, so "Key" and "key" are the same key.
+struct CaseInsensitiveComparator {
+  static constexpr std::uint32_t id = 2;
+  static int compare(const Slice &a, const Slice &b) {
+    size_t n = a.size() < b.size() ? a.size() : b.size();
+    for (size_t i = 0; i < n; i++) {
+      int x = std::tolower(static_cast<unsigned char>(a[i]));
+      int y = std::tolower(static_cast<unsigned char>(b[i]));
+      if (x != y) {
+        return x < y ? -1 : 1;
+      }
+    }
+    return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+  }
+};
+
+// NativeU64Comparator orders 8-byte keys holding integers in host byte order
+// by their value, so keys need no encoding. Keys of any other size sort
+// bytewise.
+struct NativeU64Comparator {
+  static constexpr std::uint32_t id = 3;
+  static int compare(const Slice &a, const Slice &b) {
+    if (a.size() != sizeof(std::uint64_t) || b.size() != sizeof(std::uint64_t)) {
+      return a.compare(b);
+    }
+    std::uint64_t x, y;
+    std::memcpy(&x, a.data(), sizeof(x));
+    std::memcpy(&y, b.data(), sizeof(y));
+    return x < y ? -1 : (x > y ? 1 : 0);
+  }
+};
+
+// with_comparator calls fn with the comparator of the given id, so that a
+// runtime id picks a search instantiated for it once per operation instead of
+// paying an indirect call per comparison.
+template <class F> auto with_comparator(std::uint32_t id, F &&fn) {
+  switch (id) {
+  case BytewiseComparator::id:
+    return fn(BytewiseComparator());
+  case ReverseBytewiseComparator::id:
+    return fn(ReverseBytewiseComparator());
+  case CaseInsensitiveComparator::id:
+    return fn(CaseInsensitiveComparator());
+  case NativeU64Comparator::id:
+    return fn(NativeU64Comparator());
+  }
+  std::cerr << "unknown comparator: " << id << "\n";
+  std::exit(1);
+}
+
+// lower_bound_by returns the index of the first of n items whose key is not
+// less than key, where key_of(i) returns the key of item i.
+template <class Cmp, class KeyOf> size_t lower_bound_by(size_t n, const Slice &key, KeyOf key_of) {
+  size_t lo = 0;
+  while (n > 0) {
+    size_t half = n / 2;
+    if (Cmp::compare(key_of(lo + half), key) < 0) {
+      lo += half + 1;
+      n -= half + 1;
+    } else {
+      n = half;
+    }
+  }
+  return lo;
+}
+
+#endif
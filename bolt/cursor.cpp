@@ -1,10 +1,14 @@
 #include "cursor.h"
 #include "bucket.h"
+#include "exception.h"
 #include "node.h"
+#include "node_cache.h"
 #include "page.h"
 #include "stdexcept"
 #include "tx.h"
+#include <algorithm>
 #include <cassert>
+#include <numeric>
 #include <utility>
 #include <variant>
 
@@ -22,6 +26,26 @@ int elemRef::count() {
   return static_cast<int>(this->page->count());
 }
 
+Slice elemRef::key(int index) {
+  if (this->node) {
+    return this->node->inodes[index].key;
+  }
+  if (this->page->flags() & U64KeyPageFlag) {
+    return this->page->u64Key(index);
+  }
+  if (this->page->flags() & LeafPageFlag) {
+    return this->page->leafPageElement(index)->key();
+  }
+  return this->page->branchPageElement(index)->key();
+}
+
+pgid_t elemRef::child(int index) {
+  if (this->node) {
+    return this->node->inodes[index].id;
+  }
+  return this->page->branchPageElement(index)->id;
+}
+
 std::pair<std::optional<Slice>, std::optional<Slice>> Cursor::first() {
   assert(this->bucket_->tx()->db() != nullptr);
   this->stack_.clear();
@@ -118,7 +142,8 @@ Cursor::keyValue() {
 
   // or retrieve value from page
   LeafPageElement *elem = ref.page->leafPageElement(ref.index);
-  return std::make_tuple(elem->key(), elem->value(), elem->flags);
+  Slice key = (ref.page->flags() & U64KeyPageFlag) ? ref.page->u64Key(ref.index) : elem->key();
+  return std::make_tuple(key, elem->value(), elem->flags);
 }
 
 void Cursor::first_() {
@@ -199,7 +224,14 @@ Cursor::next_() {
 
 std::pair<std::optional<Slice>, std::optional<Slice>>
 Cursor::seek(const Slice &seek) {
-  auto[k, v, flags] = this->seek_(seek);
+  return with_comparator(this->bucket_->comparator(), [&](auto cmp) { return this->seek<decltype(cmp)>(seek); });
+}
+
+template <class Cmp> std::pair<std::optional<Slice>, std::optional<Slice>> Cursor::seek(const Slice &seek) {
+  if (Cmp::id != this->bucket_->comparator()) {
+    throw ComparatorMismatchException();
+  }
+  auto[k, v, flags] = this->seek_<Cmp>(seek);
 
   // If we ended up after the last element of a page then move to the next one.
   auto &ref = this->stack_.back();
@@ -210,7 +242,7 @@ Cursor::seek(const Slice &seek) {
     flags = std::get<2>(_next);
   }
 
-  if (k) {
+  if (!k) {
     return std::make_pair(std::optional<Slice>(), std::optional<Slice>());
   } else if (flags & BucketLeafFlag) {
     return std::make_pair(k, std::optional<Slice>());
@@ -218,13 +250,13 @@ Cursor::seek(const Slice &seek) {
   return std::make_pair(k, v);
 }
 
-std::tuple<std::optional<Slice>, std::optional<Slice>, std::uint32_t>
-Cursor::seek_(const Slice &seek) {
+template <class Cmp>
+std::tuple<std::optional<Slice>, std::optional<Slice>, std::uint32_t> Cursor::seek_(const Slice &seek) {
   assert(this->bucket_->tx()->db() != nullptr);
 
   // Start from root page/node and traverse to corrent page.
   this->stack_.clear();
-  this->search(seek, this->bucket_->root());
+  this->search<Cmp>(seek, this->bucket_->root());
   auto &ref = this->stack_.back();
 
   // If the cursor is pointing to the end of page/node then return nil.
@@ -236,7 +268,7 @@ Cursor::seek_(const Slice &seek) {
   return this->keyValue();
 }
 
-void Cursor::search(const Slice &key, pgid_t id) {
+template <class Cmp> void Cursor::search(const Slice &key, pgid_t id) {
   auto[p, n] = this->bucket_->page_node(id);
   if (p && (p->flags() & (BranchPageFlag | LeafPageFlag)) == 0) {
     std::cerr << "invalid page type: " << p->id() << " " << p->flags() << "\n";
@@ -251,37 +283,34 @@ void Cursor::search(const Slice &key, pgid_t id) {
 
   // If we're on a leaf page/node then find the specific node.
   if (elem.isLeaf()) {
-    this->nsearch(key);
+    this->nsearch<Cmp>(key);
     return;
   }
 
   if (n) {
-    this->searchNode(key, n);
+    this->searchNode<Cmp>(key, n);
     return;
   }
-  this->searchPage(key, p);
+  this->searchPage<Cmp>(key, p);
 }
 
-void Cursor::searchNode(const Slice &key, Node *n) {
-  auto first = std::lower_bound(n->inodes.begin(), n->inodes.end(), key);
-  bool exact = first != n->inodes.end() && (*first == key);
-  int index = first - n->inodes.begin();
+template <class Cmp> void Cursor::searchNode(const Slice &key, Node *n) {
+  auto [index, exact] = search_inodes<Cmp>(n->inodes, key);
   if (!exact && index > 0) {
     index--;
   }
   this->stack_.back().index = index;
 
   // Recursively search to the next page.
-  this->search(key, n->inodes[index].id);
+  this->search<Cmp>(key, n->inodes[index].id);
 }
 
-void Cursor::searchPage(const Slice &key, Page *p) {
+template <class Cmp> void Cursor::searchPage(const Slice &key, Page *p) {
   // Binary search for the correct range.
-  auto inodes = p->branchPageElements();
+  auto decoded = this->bucket_->tx()->decoded_page(p);
+  auto &inodes = decoded->inodes;
 
-  auto first = std::lower_bound(inodes.begin(), inodes.end(), key);
-  bool exact = (first != inodes.end()) && (*first == key);
-  int index = first - inodes.begin();
+  auto [index, exact] = decoded->search<Cmp>(key);
 
   if (!exact && index > 0) {
     index--;
@@ -290,29 +319,126 @@ void Cursor::searchPage(const Slice &key, Page *p) {
   this->stack_.back().index = index;
 
   // Recursively search to the next page.
-  this->search(key, inodes[index].id);
+  this->search<Cmp>(key, inodes[index].id);
 }
 
-void Cursor::nsearch(const Slice &key) {
+template <class Cmp> void Cursor::nsearch(const Slice &key) {
   auto &ref = this->stack_.back();
   Page *p = ref.page;
   Node *n = ref.node;
 
   // If we have a node then search its inodes.
   if (n) {
-    auto first = std::lower_bound(n->inodes.begin(), n->inodes.end(), key);
-    int index = first - n->inodes.begin();
-    ref.index = index;
+    ref.index = search_inodes<Cmp>(n->inodes, key).first;
     return;
   }
 
   // If we have a page then search its leaf elements.
-  auto inodes = p->leafPageElements();
-  auto first = std::lower_bound(inodes.begin(), inodes.end(), key);
-  int index = first - inodes.begin();
-  ref.index = index;
+  auto decoded = this->bucket_->tx()->decoded_page(p);
+  ref.index = decoded->search<Cmp>(key).first;
 }
 
+template <class Cmp>
+std::tuple<std::optional<Slice>, std::optional<Slice>, std::uint32_t> Cursor::reseek_(const Slice &key) {
+  if (this->stack_.empty()) {
+    return this->seek_<Cmp>(key);
+  }
+
+  // The range of a child ends at the next key of its parent, or at the end
+  // of the parent's own range if it is the parent's last child. Every range
+  // starts at or before key since keys come in order.
+  size_t depth = this->stack_.size() - 1;
+  for (size_t i = this->stack_.size() - 1; i > 0; i--) {
+    elemRef &parent = this->stack_[i - 1];
+    if (parent.index + 1 < parent.count()) {
+      if (Cmp::compare(key, parent.key(parent.index + 1)) < 0) {
+        break;
+      }
+      depth = i - 1;
+    }
+  }
+
+  pgid_t id = depth == 0 ? this->bucket_->root() : this->stack_[depth - 1].child(this->stack_[depth - 1].index);
+  this->stack_.resize(depth);
+  this->search<Cmp>(key, id);
+
+  auto &ref = this->stack_.back();
+  if (ref.index >= ref.count()) {
+    return std::make_tuple(std::optional<Slice>(), std::optional<Slice>(), 0);
+  }
+  return this->keyValue();
+}
+
+void Cursor::put_batch(gsl::span<KV> kvs) {
+  with_comparator(this->bucket_->comparator(), [&](auto cmp) {
+    using Cmp = decltype(cmp);
+    auto less = [](const KV &a, const KV &b) { return Cmp::compare(a.key, b.key) < 0; };
+    std::stable_sort(kvs.begin(), kvs.end(), less);
+
+    // Keep only the last value of every key.
+    size_t n = 0;
+    for (size_t i = 0; i < kvs.size(); i++) {
+      if (i + 1 < kvs.size() && !less(kvs[i], kvs[i + 1])) {
+        continue;
+      }
+      kvs[n++] = kvs[i];
+    }
+
+    this->stack_.clear();
+    for (size_t i = 0; i < n;) {
+      this->reseek_<Cmp>(kvs[i].key);
+
+      // The leaf covers keys up to the next key of the nearest ancestor that
+      // has one, or all remaining keys if there is none.
+      std::optional<Slice> bound;
+      for (size_t d = this->stack_.size() - 1; d > 0 && !bound; d--) {
+        elemRef &parent = this->stack_[d - 1];
+        if (parent.index + 1 < parent.count()) {
+          bound = parent.key(parent.index + 1);
+        }
+      }
+      size_t j = i + 1;
+      while (j < n && (!bound || Cmp::compare(kvs[j].key, *bound) < 0)) {
+        j++;
+      }
+
+      this->node()->merge(&kvs[i], j - i);
+      i = j;
+    }
+  });
+}
+
+void Cursor::get_many(gsl::span<const Slice> keys, std::vector<std::optional<Slice>> *values) {
+  values->assign(keys.size(), std::optional<Slice>());
+  this->stack_.clear();
+  with_comparator(this->bucket_->comparator(), [&](auto cmp) {
+    using Cmp = decltype(cmp);
+
+    // Look the keys up in order so that each search starts where the
+    // previous one ended.
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return Cmp::compare(keys[a], keys[b]) < 0; });
+
+    for (size_t i : order) {
+      auto [k, v, flags] = this->reseek_<Cmp>(keys[i]);
+      if (k && Cmp::compare(*k, keys[i]) == 0 && !(flags & BucketLeafFlag)) {
+        (*values)[i] = v;
+      }
+    }
+  });
+}
+
+// The comparators a bucket header can name, see with_comparator().
+template std::pair<std::optional<Slice>, std::optional<Slice>>
+Cursor::seek<BytewiseComparator>(const Slice &);
+template std::pair<std::optional<Slice>, std::optional<Slice>>
+Cursor::seek<ReverseBytewiseComparator>(const Slice &);
+template std::pair<std::optional<Slice>, std::optional<Slice>>
+Cursor::seek<CaseInsensitiveComparator>(const Slice &);
+template std::pair<std::optional<Slice>, std::optional<Slice>>
+Cursor::seek<NativeU64Comparator>(const Slice &);
+
 void Cursor::deleteCurrent() {
   if (this->bucket_->tx()->db() == nullptr) {
     throw std::runtime_error("transaction was closed");
@@ -333,7 +459,7 @@ void Cursor::deleteCurrent() {
 }
 
 Node *Cursor::node() {
-  assert(this->stack_.size() > 9);
+  assert(this->stack_.size() > 0);
 
   // If the top of the stack is a leaf node then just return it.
   // we can use semicolon statement like go since c++17
@@ -344,14 +470,12 @@ Node *Cursor::node() {
 
   // Start from root and traverse down the hierarchy.
   Node *n = this->stack_[0].node;
-  if (n) {
+  if (!n) {
     n = this->bucket_->node(this->stack_[0].page->id(), nullptr);
   }
-  if (this->stack_.size() > 1) {
-    for (std::size_t i = this->stack_.size() - 1; i >= 0; i--) {
-      assert(!n->isLeaf());
-      n = n->childAt(this->stack_[i].index);
-    }
+  for (std::size_t i = 0; i + 1 < this->stack_.size(); i++) {
+    assert(!n->isLeaf());
+    n = n->childAt(this->stack_[i].index);
   }
 
   assert(n->isLeaf());
@@ -3,6 +3,7 @@
 
 #include "slice.h"
 #include "types.h"
+#include <gsl/gsl>
 #include <optional>
 #include <tuple>
 #include <utility>
@@ -11,6 +12,7 @@
 class Bucket;
 class Page;
 class Node;
+struct KV;
 
 // Cursor represents an iterator that can traverse over all key/value pairs in a
 // bucket in sorted order.
@@ -26,6 +28,8 @@ class Node;
 // after mutating data.
 class Cursor {
 public:
+  explicit Cursor(Bucket *bucket) : bucket_(bucket) {}
+
   // bucket returns the bucket that this cursor was created from.
   Bucket *bucket() { return bucket_; }
 
@@ -57,6 +61,12 @@ public:
   // The returned key and value are only valid for the life of the transaction.
   std::pair<std::optional<Slice>, std::optional<Slice>> seek(const Slice &seek);
 
+  // seek<Cmp> is seek() for a bucket whose keys are ordered by Cmp, one of
+  // the comparators in comparator.h, with the comparison inlined into the
+  // search. Throws ComparatorMismatchException if the bucket uses another
+  // comparator.
+  template <class Cmp> std::pair<std::optional<Slice>, std::optional<Slice>> seek(const Slice &seek);
+
   // keyValue returns the key and value of the current leaf element.
   std::tuple<std::optional<Slice>, std::optional<Slice>, std::uint32_t>
   keyValue();
@@ -82,27 +92,40 @@ private:
 
   // seek_ moves the cursor to a given key and returns it.
   // If the key down not exist then the next key is used.
-  std::tuple<std::optional<Slice>, std::optional<Slice>, std::uint32_t>
-  seek_(const Slice &seek);
+  template <class Cmp> std::tuple<std::optional<Slice>, std::optional<Slice>, std::uint32_t> seek_(const Slice &seek);
 
   // search recursively performs a binary search against a given  page/node
-  // until it finds a given key.
-  void search(const Slice &key, pgid_t id);
+  // until it finds a given key. Keys are compared with Cmp.
+  template <class Cmp> void search(const Slice &key, pgid_t id);
 
-  void searchNode(const Slice &key, Node *n);
-  void searchPage(const Slice &key, Page *p);
+  template <class Cmp> void searchNode(const Slice &key, Node *n);
+  template <class Cmp> void searchPage(const Slice &key, Page *p);
   // nsearch searches the leaf node on the top of the stack for a key.
-  void nsearch(const Slice &key);
+  template <class Cmp> void nsearch(const Slice &key);
 
   // node returns the code that the cursor is currently positioned on.
   Node *node();
 
+  // reseek_ is seek_() for a key that sorts at or after the key of the
+  // previous search. Instead of starting over at the root, it climbs only to
+  // the deepest page/node on the stack whose range still covers key.
+  template <class Cmp>
+  std::tuple<std::optional<Slice>, std::optional<Slice>, std::uint32_t> reseek_(const Slice &key);
+
+  // put_batch implements Bucket::put_batch().
+  void put_batch(gsl::span<KV> kvs);
+
+  // get_many implements Bucket::get_many().
+  void get_many(gsl::span<const Slice> keys, std::vector<std::optional<Slice>> *values);
+
   Bucket *bucket_;
 
   // stack stores the ref of the elements on the path.
   // ref0 -> ref1 -> ref2 -> ... -> refN
   // refJ is in the refJ-1.inodes[refJ-1.index]
   std::vector<struct elemRef> stack_;
+
+  friend class Bucket;
 };
 
 // elemRef represents a reference to an element on a given page/node.
@@ -116,6 +139,12 @@ struct elemRef {
 
   // count returns the number of inodes or page elements.
   int count();
+
+  // key returns the key of the element at index.
+  Slice key(int index);
+
+  // child returns the pgid of the child at index of a branch page/node.
+  pgid_t child(int index);
 };
 
 #endif
\ No newline at end of file
@@ -1,17 +1,24 @@
 #include "db.h"
+#include "bolt_unix.h"
 #include "exception.h"
 #include "freelist.h"
 #include "meta.h"
+#include "node_cache.h"
+#include "page_log.h"
 #include "tx.h"
+#include "wal.h"
 #include "unistd.h"
 #include <algorithm>
 #include <cerrno>
 #include <chrono>
 #include <cstring>
 #include <fcntl.h>
+#include <new>
 #include <stdexcept>
+#include <system_error>
 #include <sys/file.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <thread>
 
 namespace os = molly::os;
@@ -21,20 +28,39 @@ const int DefaultMaxBatchDelay = 10;
 const int DefaultAllocSize = 16 * 1024 * 1024;
 
 Option DefaultOption = {/* .Timeout */ 0, /* .NoGrowSync */ false, /* .ReadOnly */ false, /* .MmapFlags */ 0,
-                        /* .InitialMmapSize */ 0};
-
-DB::DB(std::string path, FileMode mode, Option *option) : opened_(false), path_(path) {
+                        /* .InitialMmapSize */ 0, /* .PageSize */ 0,
+                        /* .NodeCacheSize */ DefaultNodeCacheSize,
+                        /* .PageLog */ false, /* .HugePages */ false, /* .HugeTLB */ false,
+                        /* .InMemory */ false, /* .Wal */ false,
+                        /* .WalCheckpointInterval */ DefaultWalCheckpointInterval,
+                        /* .WalCheckpointSize */ DefaultWalCheckpointSize,
+                        /* .ReclaimBudget */ DefaultReclaimBudget};
+
+DB::DB(std::string path, FileMode mode, Option *option)
+    : opened_(true), strict_mode_(false), no_sync_(false), path_(path), file_(nullptr), in_memory_(false),
+      memfd_(-1), data_(nullptr), data_sz_(0), rwtx_(nullptr), freelist_(nullptr), page_pool_(nullptr),
+      page_arena_(nullptr), node_cache_(nullptr), page_log_(nullptr), wal_(nullptr),
+      closing_(false), wal_checkpoint_size_(0), sync_closing_(false), read_only_(false) {
   // Set default option if no option is provided.
   if (!option) {
     option = &DefaultOption;
   }
   this->no_grow_sync_ = option->NoGrowSync;
   this->mmap_flags_ = option->MmapFlags;
+  this->huge_pages_ = option->HugePages;
 
   // Set default values for later DB operations.
   this->max_batch_size_ = DefaultMaxBatchSize;
   this->max_batch_delay_ = DefaultMaxBatchDelay;
   this->alloc_size_ = DefaultAllocSize;
+  this->reclaim_budget_ = option->ReclaimBudget > 0 ? option->ReclaimBudget : DefaultReclaimBudget;
+
+  // Validate the page size for new files.
+  this->page_size_ = option->PageSize > 0 ? option->PageSize : ::getpagesize();
+  if ((this->page_size_ & (this->page_size_ - 1)) != 0 || this->page_size_ < ::getpagesize() ||
+      this->page_size_ > MaxPageSize) {
+    throw InvalidPageSizeException();
+  }
 
   int flag = O_RDWR;
   if (option != nullptr && option->ReadOnly) {
@@ -42,76 +68,146 @@ DB::DB(std::string path, FileMode mode, Option *option) : opened_(false), path_(
     this->read_only_ = true;
   }
 
-  // open data file and separate sync handler for metadata writes.
-  try {
-    this->file_ = new File(path_, flag | O_CREAT, mode | S_IRWXU);
-  } catch (std::exception &e) {
-    this->close();
-    throw e;
-  }
+  if (option->InMemory) {
+    // Anonymous memory has the same page format as a file but nothing to
+    // lock or share with other processes.
+    this->in_memory_ = true;
+    this->memfd_ = ::memfd_create(path_.c_str(), MFD_CLOEXEC);
+    if (this->memfd_ < 0) {
+      throw std::system_error(errno, std::system_category(), "memfd_create failed");
+    }
+  } else {
+    // open data file and separate sync handler for metadata writes.
+    try {
+      this->file_ = new File(path_, flag | O_CREAT, mode | S_IRWXU);
+    } catch (std::exception &e) {
+      this->close();
+      this->release();
+      throw;
+    }
 
-  // Lock file so that other processes using Bolt in read-write mode cannot
-  // use the database at the same time. This would cause corruption since
-  // the two processes would write meta pages and free pages separately.
-  // The database file is locked exclusively (only one process can grab the lock)
-  // if !option.ReadOnly
-  // The database file is locked using the shared lock (more than one process may
-  // hold a lock at the same time) otherwise (option.ReadOnly is set).
-  try {
-    this->flock(option->Timeout);
-  } catch (std::exception &e) {
-    this->close();
-    throw e;
+    // Lock file so that other processes using Bolt in read-write mode cannot
+    // use the database at the same time. This would cause corruption since
+    // the two processes would write meta pages and free pages separately.
+    // The database file is locked exclusively (only one process can grab the lock)
+    // if !option.ReadOnly
+    // The database file is locked using the shared lock (more than one process may
+    // hold a lock at the same time) otherwise (option.ReadOnly is set).
+    try {
+      this->flock(option->Timeout);
+    } catch (std::exception &e) {
+      this->close();
+      this->release();
+      throw;
+    }
   }
 
   // Default values for test hooks
   // directly use file->writeat
 
   // Initialize the database if it doesn't exist.
-  os::file_info fi = this->file_->stat();
-  if (fi.size == 0) {
+  if (this->in_memory_ || this->file_->stat().size == 0) {
     // Initialize new files with meta pages.
     this->init();
   } else {
     // Read the first meta page to determine the page size.
-    std::string buf;
-    buf.reserve(1000);
+    std::string buf(pageHeaderSize + sizeof(Meta), '\0');
     this->file_->read_at(buf, 0);
-    Meta *m = this->page_in_buffer(buf, 0)->meta();
+    Meta *m = reinterpret_cast<Meta *>(&buf[pageHeaderSize]);
+    bool valid = true;
     try {
       m->validate();
+    } catch (std::exception &e) {
+      // Keep the configured page size and let the meta checks on mmap
+      // report the invalid file.
+      valid = false;
+    }
+    if (valid) {
+      if (option->PageSize > 0 && static_cast<std::uint32_t>(option->PageSize) != m->page_size) {
+        this->close();
+        this->release();
+        throw PageSizeMismatchException();
+      }
       this->page_size_ = m->page_size;
+    }
+  }
+
+  // Initialize page pool, carving pages out of huge page arenas if asked to.
+  if (option->HugePages || option->HugeTLB) {
+    this->page_arena_ = new PageArena(this->page_size_, option->HugeTLB);
+    this->page_pool_ = new PagePool([a = this->page_arena_]() { return a->alloc(); });
+  } else {
+    this->page_pool_ = new PagePool(
+        [s = this->page_size_]() {
+          char *bytes = new char[s];
+          return Slice(bytes, s);
+        },
+        [](const Slice &s) { delete[] s.data(); });
+  }
+
+  // Open the write-ahead log, which recovers the commits it holds.
+  bool wal = option->Wal && !this->read_only_ && !this->in_memory_;
+  if (wal) {
+    try {
+      this->wal_ = new Wal(path_ + ".wal", this->page_size_);
     } catch (std::exception &e) {
-      this->page_size_ = ::getpagesize();
+      this->close();
+      this->release();
+      throw;
     }
+    this->wal_checkpoint_size_ =
+        option->WalCheckpointSize > 0 ? option->WalCheckpointSize : DefaultWalCheckpointSize;
   }
 
-  // Initialize page pool.
-  this->page_pool_ = new PagePool([s = pageSize_]() {
-    char *bytes = new char[s];
-    return Slice(bytes, s);
-  });
+  // Initialize the decoded node cache.
+  if (option->NodeCacheSize > 0) {
+    this->node_cache_ = new NodeCache(option->NodeCacheSize);
+  }
 
   // memory map the data file.
   try {
     this->mmap(option->InitialMmapSize);
   } catch (std::exception &e) {
     this->close();
-    throw e;
+    this->release();
+    throw;
+  }
+
+  // Fold the commits recovered from the write-ahead log into the data file.
+  // The freelist of the last one may only be in the log.
+  if (this->wal_) {
+    this->checkpoint();
   }
 
   // read in the freelist
   this->freelist_ = new struct FreeList();
+  this->freelist_->node_cache = this->node_cache_;
   this->freelist_->read(this->page(this->meta()->freelist));
+
+  // Open the log of pages written by each commit. An in-memory database
+  // can't be backed up incrementally since it doesn't outlive the process.
+  // The log learns the current txid to tell whether commits were made
+  // without it.
+  if (option->PageLog && !this->read_only_ && !this->in_memory_) {
+    try {
+      this->page_log_ = new PageLog(path_ + ".pagelog", this->meta()->txid);
+    } catch (std::exception &e) {
+      this->close();
+      this->release();
+      throw;
+    }
+  }
+
+  // Checkpoint in the background from now on.
+  if (this->wal_) {
+    int interval = option->WalCheckpointInterval > 0 ? option->WalCheckpointInterval : DefaultWalCheckpointInterval;
+    this->checkpointer_ = std::thread(&DB::run_checkpointer, this, std::chrono::milliseconds(interval));
+  }
 }
 
 void DB::init() {
-  // Set the page size to the OS page size.
-  this->page_size_ = ::getpagesize();
-
   // Create two meta pages on a buffer.
-  std::string buf;
-  buf.reserve(4 * this->page_size_);
+  std::string buf(4 * this->page_size_, '\0');
   for (int i = 0; i < 2; i++) {
     Page *p = this->page_in_buffer(buf, i);
     p->setID(static_cast<pgid_t>(i));
@@ -123,7 +219,7 @@ void DB::init() {
     m->version = Version;
     m->page_size = static_cast<std::uint32_t>(this->page_size_);
     m->freelist = 2;
-    // m->root = new struct bucket();
+    m->root = {3, 0, 0, 0};
     m->pgid = 4;
     m->txid = static_cast<txid_t>(i);
     m->checksum = m->sum64();
@@ -142,19 +238,27 @@ void DB::init() {
   p->setCount(0);
 
   // Write the buffer to our data file.
-  this->file_->write_at(buf, 0);
+  pwrite_full(this->fd(), buf.data(), buf.size(), 0);
   this->fdatasync();
 }
 
 void DB::fdatasync() {
+  // Memory is as durable as it gets.
+  if (this->in_memory_) {
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
   int r = ::fdatasync(fd());
+  this->latency_.sync.record(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
   if (r != 0) {
     throw std::system_error(errno, std::system_category(), "fdatasync failed");
   }
 }
 
 Page *DB::page(pgid_t id) {
-  int pos = id * this->pageSize_;
+  std::int64_t pos = static_cast<std::int64_t>(id) * this->page_size_;
   return reinterpret_cast<Page *>(this->data_ + pos);
 }
 
@@ -177,7 +281,7 @@ Tx *DB::begin_tx() {
   this->mmaplock_.lock_shared();
 
   //  Exit if the database is not open yet.
-  if (this->opened_) {
+  if (!this->opened_) {
     this->mmaplock_.unlock_shared();
     this->metalock_.unlock();
     throw DatabaseNotOpenException();
@@ -193,10 +297,7 @@ Tx *DB::begin_tx() {
   this->metalock_.unlock();
 
   // Update the transaction stats.
-  this->statlock_.lock();
-  this->stats_.tx_n++;
-  this->stats_.open_tx_n = this->txs_.size();
-  this->statlock_.unlock();
+  this->stats_.begin_tx();
   return t;
 }
 
@@ -208,33 +309,50 @@ Tx *DB::begin_rwtx() {
 
   // obtain writer lock. This is released by the transaction when it closes.
   // This enforces only one writer transaction at a time.
+  auto start = std::chrono::steady_clock::now();
   this->rwlock_.lock();
+  return this->begin_rwtx_locked(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+}
 
+Tx *DB::begin_rwtx_locked(std::chrono::microseconds lock_time) {
   // Once we have the writer lock then we can lock the meta pages so that we can
   // set up the transaction.
   std::lock_guard<std::mutex> metalock(this->metalock_);
 
   // Exit if the database is not open yet.
-  if (this->opened_) {
+  if (!this->opened_) {
     this->rwlock_.unlock();
     throw DatabaseNotOpenException();
   }
 
   // Create a transaction associated with the database.
   Tx *t = new Tx(this, true);
+  t->stats_.lock_time = lock_time;
   this->rwtx_ = t;
 
   // Free any pages associated with closed read-only transactions.
-  txid_t minid = 0xFFFFFFFFFFFFFFFF;
+  std::vector<txid_t> readers;
   for (auto &tx : this->txs_) {
-    if (tx->meta()->txid < minid) {
-      minid = tx->meta()->txid;
-    }
+    readers.push_back(tx->meta()->txid);
   }
+  std::sort(readers.begin(), readers.end());
+  txid_t minid = readers.empty() ? 0xFFFFFFFFFFFFFFFF : readers.front();
   if (minid > 0) {
     this->freelist_->release(minid - 1);
   }
 
+  // Also free the pages that were both allocated and freed between two open
+  // readers, so that a long running reader only pins the pages of its own
+  // snapshot.
+  for (txid_t txid : readers) {
+    if (txid > 0) {
+      this->freelist_->release_range(minid, txid - 1);
+    }
+    minid = txid + 1;
+  }
+  this->freelist_->release_range(minid, 0xFFFFFFFFFFFFFFFF);
+
   return t;
 }
 // void removeTx(Tx *);
@@ -244,11 +362,238 @@ void DB::update(std::function<void(Tx *)> fn) {
   fn(tx);
 }
 
-DB::~DB() { delete file_; }
+void DB::begin_async(bool writable, Executor exec, std::function<void(Tx *, std::exception_ptr)> done) {
+  // Readers only wait for a remap, which is short, so they start right away.
+  if (!writable || this->read_only_) {
+    Tx *tx = nullptr;
+    std::exception_ptr err;
+    try {
+      tx = this->begin(writable);
+    } catch (...) {
+      err = std::current_exception();
+    }
+    exec([done, tx, err] { done(tx, err); });
+    return;
+  }
+
+  // The lock is handed over when the current writer closes, which may be on
+  // another thread, so the lock time is measured from here.
+  auto start = std::chrono::steady_clock::now();
+  auto acquired = [this, exec, done, start] {
+    exec([this, done, start] {
+      Tx *tx = nullptr;
+      std::exception_ptr err;
+      try {
+        tx = this->begin_rwtx_locked(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+      } catch (...) {
+        err = std::current_exception();
+      }
+      done(tx, err);
+    });
+  };
+  if (this->rwlock_.lock_async(acquired)) {
+    acquired();
+  }
+}
+
+void DB::update_async(std::function<void(Tx *)> fn, Executor exec, std::function<void(std::exception_ptr)> done) {
+  this->begin_async(true, exec, [fn, exec, done](Tx *tx, std::exception_ptr err) {
+    if (err) {
+      done(err);
+      return;
+    }
+    try {
+      fn(tx);
+    } catch (...) {
+      err = std::current_exception();
+      tx->rollback();
+      delete tx;
+      done(err);
+      return;
+    }
+    tx->commit_async(exec, [tx, done](std::exception_ptr err) {
+      // A failed commit leaves the transaction open and the writer lock held.
+      if (err && tx->db()) {
+        tx->rollback();
+      }
+      delete tx;
+      done(err);
+    });
+  });
+}
+
+void DB::run_blocking(std::function<void()> job) {
+  std::lock_guard<std::mutex> lock(this->sync_mutex_);
+  if (!this->syncer_.joinable()) {
+    this->syncer_ = std::thread(&DB::run_syncer, this);
+  }
+  this->sync_jobs_.push_back(std::move(job));
+  this->sync_cond_.notify_one();
+}
+
+void DB::run_syncer() {
+  std::unique_lock<std::mutex> lock(this->sync_mutex_);
+  for (;;) {
+    this->sync_cond_.wait(lock, [this] { return this->sync_closing_ || !this->sync_jobs_.empty(); });
+    if (this->sync_jobs_.empty()) {
+      return;
+    }
+    std::function<void()> job = std::move(this->sync_jobs_.front());
+    this->sync_jobs_.pop_front();
+    lock.unlock();
+    job();
+    lock.lock();
+  }
+}
+
+void DB::stop_syncer() {
+  {
+    std::lock_guard<std::mutex> lock(this->sync_mutex_);
+    if (!this->syncer_.joinable()) {
+      return;
+    }
+    this->sync_closing_ = true;
+  }
+  // Pending jobs still run, closing only stops the thread once it is idle.
+  this->sync_cond_.notify_one();
+  this->syncer_.join();
+}
 
-int DB::fd() { return file_->fd(); }
+Stats DB::stats() {
+  Stats s = this->stats_.sum();
+  s.latency = this->latency_.snapshot();
+  return s;
+}
 
-Meta *DB::meta() { return new Meta(); }
+DB::~DB() {
+  this->stop_syncer();
+
+  // Leave the data file complete so the log is empty on the next open.
+  this->stop_checkpointer();
+  try {
+    this->checkpoint();
+  } catch (std::exception &e) {
+    std::cerr << "bolt: checkpoint failed: " << e.what() << "\n";
+  }
+  try {
+    this->close();
+  } catch (std::exception &e) {
+    std::cerr << "bolt: close failed: " << e.what() << "\n";
+  }
+  this->release();
+}
+
+void DB::release() {
+  delete this->wal_;
+  this->wal_ = nullptr;
+  delete this->page_pool_;
+  this->page_pool_ = nullptr;
+  delete this->page_arena_;
+  this->page_arena_ = nullptr;
+  delete this->node_cache_;
+  this->node_cache_ = nullptr;
+  delete this->page_log_;
+  this->page_log_ = nullptr;
+}
+
+void DB::trim_page_log(txid_t txid) {
+  if (!this->page_log_) {
+    throw PageLogDisabledException();
+  }
+  this->page_log_->trim(txid);
+}
+
+int DB::fd() { return this->in_memory_ ? this->memfd_ : file_->fd(); }
+
+Meta *DB::meta() {
+  // Commits that are only in the write-ahead log are newer than the metas
+  // in the data file.
+  if (this->wal_) {
+    if (Meta *m = this->wal_->meta()) {
+      return m;
+    }
+  }
+
+  // We have to return the meta with the highest txid which doesn't fail
+  // validation. Otherwise, we can cause errors when in fact the database is
+  // in a consistent state. metaA is the one with the higher txid.
+  Meta *metaA = this->meta0;
+  Meta *metaB = this->meta1;
+  if (this->meta1->txid > this->meta0->txid) {
+    std::swap(metaA, metaB);
+  }
+
+  // Use higher meta page if valid. Otherwise fallback to previous, if valid.
+  for (Meta *m : {metaA, metaB}) {
+    try {
+      m->validate();
+      return m;
+    } catch (std::exception &e) {
+    }
+  }
+
+  // This should never be reached, because both meta1 and meta0 were
+  // validated on mmap() and we do fdatasync() on every write.
+  std::cerr << "bolt.DB.meta(): invalid meta pages\n";
+  std::exit(1);
+}
+
+void DB::checkpoint() {
+  if (!this->wal_) {
+    return;
+  }
+
+  // Keep commits out while the log is copied.
+  std::lock_guard<WriterLock> rwlock(this->rwlock_);
+  if (this->wal_->empty()) {
+    return;
+  }
+  this->wal_->write_to(this->fd());
+  this->fdatasync();
+
+  // Readers may hold logged pages, so wait for them to finish before the
+  // log is dropped. Grow the mapping to cover the checkpointed pages.
+  std::unique_lock<std::shared_mutex> mmaplock(this->mmaplock_);
+  std::int64_t sz = static_cast<std::int64_t>(this->wal_->meta()->pgid) * this->page_size_;
+  if (sz > this->data_sz_) {
+    this->munmap();
+    this->mmap(sz);
+  }
+  this->wal_->reset();
+}
+
+void DB::run_checkpointer(std::chrono::milliseconds interval) {
+  std::unique_lock<std::mutex> lock(this->checkpoint_mutex_);
+  while (!this->closing_) {
+    this->checkpoint_cond_.wait_for(
+        lock, interval, [this] { return this->closing_ || this->wal_->size() >= this->wal_checkpoint_size_; });
+    if (this->closing_) {
+      break;
+    }
+
+    lock.unlock();
+    try {
+      this->checkpoint();
+    } catch (std::exception &e) {
+      // The log keeps the commits, so the next checkpoint retries.
+      std::cerr << "bolt: checkpoint failed: " << e.what() << "\n";
+    }
+    lock.lock();
+  }
+}
+
+void DB::stop_checkpointer() {
+  if (!this->checkpointer_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->checkpoint_mutex_);
+    this->closing_ = true;
+  }
+  this->checkpoint_cond_.notify_one();
+  this->checkpointer_.join();
+}
 
 // flock acquires an advisory lock on a file descriptor
 void DB::flock(int timeout) {
@@ -259,14 +604,19 @@ void DB::flock(int timeout) {
     auto now = std::chrono::steady_clock::now();
     auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
     if (timeout > 0 && diff.count() > timeout) {
-      throw std::runtime_error("flock timeout");
+      throw TimeoutException();
     }
     int flag = !this->read_only_ ? LOCK_EX : LOCK_SH;
 
-    if (::flock(this->fd(), flag) != 0 && errno == EWOULDBLOCK) {
-      throw std::runtime_error(std::string("fail to flock:") + std::strerror(errno));
+    // Otherwise attempt to obtain an exclusive lock without blocking, so
+    // that the timeout can be checked between attempts.
+    if (::flock(this->fd(), flag | LOCK_NB) == 0) {
+      return;
+    } else if (errno != EWOULDBLOCK && errno != EINTR) {
+      throw std::system_error(errno, std::system_category(), "fail to flock");
     }
 
+    // Wait for a bit and try again.
     std::this_thread::sleep_for(std::chrono::milliseconds(50));
   }
 }
@@ -277,6 +627,7 @@ void DB::close() {
   }
 
   this->opened_ = false;
+  delete this->freelist_;
   this->freelist_ = nullptr;
 
   // clear ops.
@@ -285,6 +636,7 @@ void DB::close() {
 
   // close the mmap
   this->munmap();
+  this->unmap_retired();
 
   // close file handles.
   if (this->file_) {
@@ -293,12 +645,19 @@ void DB::close() {
         this->funlock();
       } catch (std::exception &e) {
         std::cerr << "bolt.Close(): funlock error: " << e.what() << "\n";
-        throw e;
+        throw;
       }
     }
 
     // Close the file descriptor.
     delete this->file_;
+    this->file_ = nullptr;
+  }
+
+  // Drop the contents of an in-memory database.
+  if (this->memfd_ >= 0) {
+    ::close(this->memfd_);
+    this->memfd_ = -1;
   }
 
   this->path_ = "";
@@ -312,9 +671,26 @@ void DB::funlock() {
   }
 }
 
-void DB::mmap(int sz) {
-  // Map the data file to memory
-  void *b = ::mmap(0, sz, PROT_READ, MAP_SHARED | this->mmap_flags_, this->fd(), 0);
+// mmap opens the underlying memory-mapped file and initializes the meta references.
+// minsz is the minimum size that the new mmap can be.
+void DB::mmap(std::int64_t minsz) {
+  struct stat st;
+  if (::fstat(this->fd(), &st) != 0) {
+    throw std::system_error(errno, std::system_category(), "fstat failed");
+  } else if (st.st_size < 2 * this->page_size_) {
+    throw DatabaseInvalidException();
+  }
+
+  // Ensure the size is at least the minimum size.
+  std::int64_t sz = this->mmap_size(std::max<std::int64_t>(st.st_size, minsz));
+
+  // Map the data file to memory. Huge pages need a huge page aligned mapping.
+  void *b;
+  if (this->huge_pages_) {
+    b = mmap_aligned(sz, PROT_READ, MAP_SHARED | this->mmap_flags_, this->fd(), HugePageSize);
+  } else {
+    b = ::mmap(0, sz, PROT_READ, MAP_SHARED | this->mmap_flags_, this->fd(), 0);
+  }
   if (b == MAP_FAILED) {
     throw std::system_error(errno, std::system_category(), "mmap failed");
   }
@@ -324,9 +700,69 @@ void DB::mmap(int sz) {
     throw std::system_error(errno, std::system_category(), "madvise failed");
   }
 
+  // Ask for huge pages to cut TLB misses. Kernels without THP reject this
+  // with EINVAL, which just leaves the mapping on small pages.
+  if (this->huge_pages_ && ::madvise(b, sz, MADV_HUGEPAGE) != 0 && errno != EINVAL) {
+    throw std::system_error(errno, std::system_category(), "madvise failed");
+  }
+
+  // Decoded pages refer to the old mapping so they must be dropped.
+  if (this->node_cache_) {
+    this->node_cache_->clear();
+  }
+
   // Save the original byte slice and convert to a byte array pointer.
   this->data_ = (char *)b;
   this->data_sz_ = sz;
+
+  // Save references to the meta pages.
+  this->meta0 = reinterpret_cast<Meta *>(this->data_ + pageHeaderSize);
+  this->meta1 = reinterpret_cast<Meta *>(this->data_ + this->page_size_ + pageHeaderSize);
+
+  // Validate the meta pages. We only throw if both meta pages fail
+  // validation, since meta0 failing validation means that it wasn't saved
+  // properly -- but we can recover using meta1. And vice-versa.
+  try {
+    this->meta0->validate();
+  } catch (std::exception &) {
+    this->meta1->validate();
+  }
+}
+
+std::int64_t DB::mmap_size(std::int64_t size) {
+  // Double the size from 32KB until 1GB.
+  for (int i = 15; i <= 30; i++) {
+    if (size <= (std::int64_t(1) << i)) {
+      return std::int64_t(1) << i;
+    }
+  }
+
+  // Verify the requested size is not above the maximum allowed.
+  if (size > MaxMapSize) {
+    throw std::length_error("mmap too large");
+  }
+
+  // If larger than 1GB then grow by 1GB at a time.
+  std::int64_t step = MaxMmapStep;
+  if (size % step != 0) {
+    size += step - size % step;
+  }
+
+  // Ensure that the mmap size is a multiple of the page size.
+  // This should always be true since we're incrementing in MBs.
+  if (size % this->page_size_ != 0) {
+    size = (size / this->page_size_ + 1) * this->page_size_;
+  }
+
+  // If we've exceeded the max size then only grow up to the max size.
+  return std::min(size, MaxMapSize);
+}
+
+void DB::unmap_retired() {
+  for (auto &m : this->retired_maps_) {
+    ::munmap(m.first, m.second);
+  }
+  this->retired_maps_.clear();
 }
 
 void DB::munmap() {
@@ -341,11 +777,80 @@ void DB::munmap() {
   this->data_sz_ = 0;
   if (result != 0) {
     char err_info[255];
-    sprintf(err_info, "fail to munmap: %s", this->file_->name().c_str());
+    sprintf(err_info, "fail to munmap: %s", this->path_.c_str());
     throw std::system_error(errno, std::system_category(), err_info);
   }
 }
 
-void DB::remove_tx(Tx *) {
+Page *DB::allocate(txid_t txid, int count) {
+  // Allocate a temporary buffer for the page. Single pages are recycled
+  // through the page pool, see Tx::free_pages().
+  char *buf;
+  if (count == 1) {
+    buf = const_cast<char *>(this->page_pool_->get().data());
+    std::memset(buf, 0, this->page_size_);
+  } else {
+    buf = new char[static_cast<size_t>(count) * this->page_size_]();
+  }
+  Page *p = new (buf) Page(0, 0);
+  p->setOverflow(count - 1);
+
+  // Use pages from the freelist if they are available.
+  pgid_t id = this->freelist_->allocate(txid, count);
+  if (id != 0) {
+    p->setID(id);
+    return p;
+  }
+
+  // Resize mmap() if we're at the end. The writer's nodes may still refer to
+  // the current mapping, so it is only unmapped once the writer closes.
+  id = this->rwtx_->meta_->pgid;
+  std::int64_t minsz = (static_cast<std::int64_t>(id) + count + 1) * this->page_size_;
+  if (minsz >= this->data_sz_) {
+    std::unique_lock<std::shared_mutex> mmaplock(this->mmaplock_);
+    this->retired_maps_.emplace_back(this->data_, this->data_sz_);
+    this->data_ = nullptr;
+    try {
+      this->mmap(minsz);
+    } catch (...) {
+      this->free_page(p);
+      throw;
+    }
+  }
+
+  // Move the page id high water mark.
+  this->rwtx_->meta_->pgid += count;
+  for (int i = 0; i < count; i++) {
+    this->freelist_->allocs[id + i] = txid;
+  }
+  p->setID(id);
+  return p;
+}
+
+void DB::free_page(Page *p) {
+  if (p->overflow() == 0) {
+    this->page_pool_->put(Slice(reinterpret_cast<char *>(p), this->page_size_));
+  } else {
+    delete[] reinterpret_cast<char *>(p);
+  }
+}
+
+void DB::remove_tx(Tx *tx) {
+  // Release the read lock on the mmap.
+  this->mmaplock_.unlock_shared();
+
+  // Use the meta lock to restrict access to the DB object.
+  this->metalock_.lock();
+
+  // Remove the transaction.
+  auto it = std::find(this->txs_.begin(), this->txs_.end(), tx);
+  if (it != this->txs_.end()) {
+    this->txs_.erase(it);
+  }
+
+  // Unlock the meta pages.
+  this->metalock_.unlock();
 
+  // Merge statistics.
+  this->stats_.close_tx(tx->stats());
 }
@@ -6,11 +6,16 @@
 #include "page.h"
 #include "page_pool.h"
 #include "stats.h"
+#include "writer_lock.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <mutex>
 #include <shared_mutex>
 #include <string>
 #include <gsl/gsl>
+#include <thread>
 #include <vector>
 
 using File = molly::os::File;
@@ -20,8 +25,21 @@ typedef int FileMode;
 
 class Tx;
 class Meta;
+class NodeCache;
+class PageArena;
+class PageLog;
+class Wal;
 struct FreeList;
 
+// MaxPageSize is the largest page size a database can be created with.
+const int MaxPageSize = 64 * 1024;
+
+// MaxMapSize represents the largest mmap size supported by Bolt.
+const std::int64_t MaxMapSize = 0xFFFFFFFFFFFF; // 256TB
+
+// MaxMmapStep is the largest step that can be taken when remapping the mmap.
+const std::int64_t MaxMmapStep = 1 << 30; // 1GB
+
 // Option represents the options that can be set when opening a database.
 struct Option {
   // Timeout is the amount of time to wait to obtain a file lock.
@@ -48,8 +66,72 @@ struct Option {
   // If initialMmapSize is smaller than the previous database size,
   // it takes no effect;
   int InitialMmapSize;
+
+  // PageSize is the page size of a new database file. It must be a power of
+  // two between the OS page size and MaxPageSize. Larger pages make trees
+  // flatter, which pays off for long keys and for devices with a large
+  // native write unit.
+  //
+  // If <= 0, the OS page size is used. When an existing file is opened, a
+  // non-zero PageSize must match the page size the file was created with.
+  int PageSize;
+
+  // NodeCacheSize is the byte budget of the decoded node cache shared
+  // by all transactions.
+  //
+  // If <= 0, decoded pages are not cached.
+  int NodeCacheSize;
+
+  // PageLog records the pages written by every commit in a sidecar file
+  // next to the database so that incremental backups can be taken with
+  // Tx::write_delta().
+  bool PageLog;
+
+  // HugePages asks the kernel to back the data mapping with transparent huge
+  // pages (MADV_HUGEPAGE), which cuts the TLB misses of random lookups over
+  // large databases, and makes the page pool carve its buffers out of huge
+  // page arenas. The data mapping only gets huge pages on file systems with
+  // THP support and for in-memory databases. Ignored by kernels without THP.
+  bool HugePages;
+
+  // HugeTLB makes the page pool arenas use reserved hugetlbfs pages
+  // (MAP_HUGETLB), falling back to transparent huge pages when none are
+  // available. Implies HugePages for the page pool.
+  bool HugeTLB;
+
+  // InMemory backs the database by anonymous memory (a memfd) instead of
+  // the file at path, which is only used to name the memfd. The database
+  // always starts empty and is lost when it is closed. File locking is
+  // skipped and syncs are no-ops, so this is meant for caches that are
+  // rebuilt on restart and for benchmarks.
+  bool InMemory;
+
+  // Wal turns on write-ahead logging. A commit appends its dirty pages and
+  // meta to a sequential log next to the database and syncs only the log;
+  // a background thread checkpoints the logged pages into the data file.
+  // Ignored for in-memory and read-only databases.
+  bool Wal;
+
+  // WalCheckpointInterval is the time in milliseconds between background
+  // checkpoints. If <= 0, DefaultWalCheckpointInterval is used.
+  int WalCheckpointInterval;
+
+  // WalCheckpointSize is the log size in bytes that triggers a checkpoint
+  // before the interval is up. If <= 0, DefaultWalCheckpointSize is used.
+  int WalCheckpointSize;
+
+  // ReclaimBudget is the number of pages of deleted buckets that a commit
+  // returns to the freelist. Deleting a bucket only unlinks its root; the
+  // pages below it are freed by the following commits, so that dropping a
+  // large bucket doesn't hold the writer lock for the whole walk.
+  //
+  // If <= 0, DefaultReclaimBudget is used.
+  int ReclaimBudget;
 };
 
+// DefaultOption represents the options used if nullptr is passed to DB().
+extern Option DefaultOption;
+
 // DB* open(std::string path, FileMode mode, Option* option);
 
 class DB {
@@ -78,30 +160,87 @@ public:
   // start a new transaction.
   Tx *begin(bool writable);
 
+  // begin_async starts a transaction without blocking the calling thread and
+  // calls done through exec with the transaction, or with the error that
+  // begin() would have thrown. A writer waiting for the writer lock holds no
+  // thread: it is queued and run once the current writer closes.
+  void begin_async(bool writable, Executor exec, std::function<void(Tx *, std::exception_ptr)> done);
+
+  // update_async is the non-blocking version of update(). fn runs through
+  // exec once the writer lock is taken, the commit runs on a background
+  // thread and done is called through exec with the error fn or the commit
+  // threw, if any. The transaction is deleted before done is called.
+  void update_async(std::function<void(Tx *)> fn, Executor exec, std::function<void(std::exception_ptr)> done);
+
   int fd();
   Meta *meta();
 
   bool read_only() { return read_only_; }
 
-  int page_size() { return pageSize_; }
+  // stats retrieves ongoing performance stats for the database.
+  // This is only updated when a transaction closes. Counters are sharded
+  // and only summed here, so reading stats is the only part that costs.
+  Stats stats();
+
+  int page_size() { return page_size_; }
+
+  // node_cache returns the decoded node cache or nullptr if it is disabled.
+  NodeCache *node_cache() { return node_cache_; }
+
+  // checkpoint copies the pages logged by Option::Wal to the data file and
+  // empties the log. It waits for the open read transactions to finish, like
+  // a remap does, and blocks commits meanwhile. The background checkpointer
+  // calls it periodically.
+  void checkpoint();
+
+  // trim_page_log drops the page log records of transactions up to txid.
+  // Call it once a full backup at txid has been taken so that the log
+  // doesn't grow forever. Deltas since an earlier txid can't be taken
+  // afterwards.
+  void trim_page_log(txid_t txid);
 
 private:
   void close();
 
+  // release frees the page pool, caches and logs, which close() leaves to
+  // the destructor. The constructor calls it too when opening fails.
+  void release();
+
   Tx *begin_tx();
   Tx *begin_rwtx();
+  Tx *begin_rwtx_locked(std::chrono::microseconds lock_time);
   void remove_tx(Tx *);
   void flock(int timeout);
   void funlock();
-  void mmap(int sz);
+  void mmap(std::int64_t minsz);
+
+  // mmap_size determines the appropriate size for the mmap given the current
+  // size of the database. The minimum size is 32KB and doubles until it
+  // reaches 1GB.
+  std::int64_t mmap_size(std::int64_t size);
   void munmap();
+  void unmap_retired();
+
+  // allocate returns a contiguous block of memory starting at a given page.
+  Page *allocate(txid_t txid, int count);
+
+  // free_page releases the buffer of a page returned by allocate().
+  void free_page(Page *p);
   void init();
   void fdatasync();
+  void run_checkpointer(std::chrono::milliseconds interval);
+  void stop_checkpointer();
+
+  // run_blocking runs a job that blocks, like a commit waiting for
+  // fdatasync, on the background syncer thread, which is started on first
+  // use. Jobs run one at a time in submission order.
+  void run_blocking(std::function<void()> job);
+  void run_syncer();
+  void stop_syncer();
 
   template <class Container> Page *page_in_buffer(Container &buf, pgid_t id);
 
 private:
-  int pageSize_;
   bool opened_;
 
   // When enabled, the database will perform a Check() after every commit.
@@ -134,6 +273,10 @@ private:
   // syscall.MAP_POPULATE on Linux 2.6.23+ for sequential read-ahead.
   int mmap_flags_;
 
+  // When true, the data mapping is aligned to and advised for transparent
+  // huge pages.
+  bool huge_pages_;
+
   // max_batch_size_ is the maximum size of a batch. Default value is
   // copied from DefaultMaxbatchSize in constructor.
   //
@@ -155,33 +298,60 @@ private:
   // of truncate() and fsync() when growing the data file.
   int alloc_size_;
 
+  // reclaim_budget_ is the number of orphaned pages a commit frees, see
+  // Option.ReclaimBudget.
+  int reclaim_budget_;
+
   std::string path_;
   gsl::owner<File *> file_;
+  bool in_memory_; // backed by memfd_ instead of file_
+  int memfd_;
   gsl::owner<File *> lock_file_; // windows only
   char *dataref_;
   char *data_; // pointer to mmapped  file
-  int data_sz_;
+  std::int64_t data_sz_;
+  std::vector<std::pair<char *, std::int64_t>> retired_maps_; // replaced mappings the writer may still refer to
   int file_sz_; // current on disk file size
-  gsl::owner<Meta *> meta0;
-  gsl::owner<Meta *> meta1;
+  Meta *meta0; // points into the mmap
+  Meta *meta1; // points into the mmap
   int page_size_;
   Tx *rwtx_;
   std::vector<Tx *> txs_;
   struct FreeList *freelist_;
-  struct Stats stats_;
+  StatCounters stats_;       // lock-free, summed by stats()
+  CommitHistograms latency_; // lock-free
 
   gsl::owner<PagePool *> page_pool_;
-
-  mutable std::mutex rwlock_;          // Allows only one writer at a time.
+  gsl::owner<PageArena *> page_arena_; // backs page_pool_ if huge pages are used
+  gsl::owner<NodeCache *> node_cache_;
+  gsl::owner<PageLog *> page_log_;
+  gsl::owner<Wal *> wal_;
+
+  // Background checkpointing of wal_.
+  std::thread checkpointer_;
+  std::mutex checkpoint_mutex_;              // protects closing_
+  std::condition_variable checkpoint_cond_; // wakes the checkpointer early
+  bool closing_;
+  std::int64_t wal_checkpoint_size_;
+
+  // Blocking work of the asynchronous API, see run_blocking().
+  std::thread syncer_;
+  std::mutex sync_mutex_;              // protects sync_jobs_ and sync_closing_
+  std::condition_variable sync_cond_;
+  std::deque<std::function<void()>> sync_jobs_;
+  bool sync_closing_;
+
+  mutable WriterLock rwlock_;          // Allows only one writer at a time.
   mutable std::mutex metalock_;        // Protects meta page access.
   mutable std::shared_mutex mmaplock_; // Protects mmap access during remapping.
-  mutable std::shared_mutex statlock_; // Ptotects stat access.
 
   // Read only mode.
   // When true, Update() and Begin(true) return DatabaseReadOnlyException
   bool read_only_;
 
+  friend class Bucket;
   friend class Tx;
+  friend class Node;
 };
 
 DB *open(std::string path, FileMode mode, Option *option);
@@ -43,4 +43,61 @@ struct DatabaseReadOnlyException : public std::runtime_error {
 };
 
 // These errors can occur when putting or deleting a value or a bucket.
+struct KeyRequiredException : public std::runtime_error {
+  KeyRequiredException() : std::runtime_error("key required") {}
+};
+
+struct KeyTooLargeException : public std::runtime_error {
+  KeyTooLargeException() : std::runtime_error("key too large") {}
+};
+
+struct ValueTooLargeException : public std::runtime_error {
+  ValueTooLargeException() : std::runtime_error("value too large") {}
+};
+
+struct BucketNotFoundException : public std::runtime_error {
+  BucketNotFoundException() : std::runtime_error("bucket not found") {}
+};
+
+struct BucketExistsException : public std::runtime_error {
+  BucketExistsException() : std::runtime_error("bucket already exists") {}
+};
+
+struct BucketNameRequiredException : public std::runtime_error {
+  BucketNameRequiredException() : std::runtime_error("bucket name required") {}
+};
+
+struct IncompatibleValueException : public std::runtime_error {
+  IncompatibleValueException() : std::runtime_error("incompatible value") {}
+};
+
+struct ComparatorMismatchException : public std::runtime_error {
+  ComparatorMismatchException() : std::runtime_error("bucket uses a different comparator") {}
+};
+
+// These errors can occur when taking or applying incremental backups.
+struct InvalidPageSizeException : public std::runtime_error {
+  InvalidPageSizeException() : std::runtime_error("invalid page size") {}
+};
+
+struct PageSizeMismatchException : public std::runtime_error {
+  PageSizeMismatchException() : std::runtime_error("page size mismatch") {}
+};
+
+struct PageLogDisabledException : public std::runtime_error {
+  PageLogDisabledException() : std::runtime_error("page log is not enabled") {}
+};
+
+struct DeltaMismatchException : public std::runtime_error {
+  DeltaMismatchException() : std::runtime_error("incremental backup does not apply to this file") {}
+};
+
+// These errors can occur when opening a sharded database.
+struct InvalidShardCountException : public std::runtime_error {
+  InvalidShardCountException() : std::runtime_error("invalid shard count") {}
+};
+
+struct TwoPhaseCommitWalException : public std::runtime_error {
+  TwoPhaseCommitWalException() : std::runtime_error("two-phase commit can't be used with a write-ahead log") {}
+};
 #endif
\ No newline at end of file
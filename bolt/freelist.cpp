@@ -1,9 +1,11 @@
 #include "freelist.h"
+#include "node_cache.h"
 #include "page.h"
 #include <algorithm>
+#include <iostream>
 
 void FreeList::release(txid_t txid) {
-  std::vector<txid_t> m;
+  std::vector<pgid_t> m;
   for (auto it = this->pending.begin(); it != this->pending.end();) {
     if (it->first <= txid) {
       // move transaction's pending pages to the available freelists.
@@ -14,6 +16,43 @@ void FreeList::release(txid_t txid) {
       ++it;
     }
   }
+  this->release_ids(m);
+}
+
+void FreeList::release_range(txid_t begin, txid_t end) {
+  if (begin > end) {
+    return;
+  }
+  std::vector<pgid_t> m;
+  for (auto it = this->pending.lower_bound(begin); it != this->pending.end() && it->first <= end;) {
+    // A page allocated before begin may still be seen by the reader just
+    // below the range. Pages of unknown origin are assumed to be that old.
+    auto &ids = it->second;
+    auto keep = std::partition(ids.begin(), ids.end(), [this, begin](pgid_t id) {
+      auto atx = this->allocs.find(id);
+      return atx == this->allocs.end() || atx->second < begin;
+    });
+    m.insert(m.end(), keep, ids.end());
+    ids.erase(keep, ids.end());
+    if (ids.empty()) {
+      this->pending.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  this->release_ids(m);
+}
+
+void FreeList::release_ids(std::vector<pgid_t> &m) {
+  for (auto id : m) {
+    this->allocs.erase(id);
+  }
+  if (this->node_cache) {
+    for (auto id : m) {
+      this->node_cache->invalidate(id);
+    }
+  }
+  std::sort(m.begin(), m.end());
   auto raw_size = this->ids.size();
   this->ids.insert(this->ids.end(), m.begin(), m.end());
   std::inplace_merge(this->ids.begin(), this->ids.begin() + raw_size, this->ids.end());
@@ -30,14 +69,21 @@ void FreeList::read(Page *p) {
   }
 
   // Copy the list of page ids from the freelist.
+  pgid_t *ids = reinterpret_cast<pgid_t *>(p->ptr());
   if (count > 0) {
-    pgid_t *ids = reinterpret_cast<pgid_t *>(p->ptr());
     this->ids.insert(this->ids.end(), ids + idx, ids + count);
 
     // Make sure they're sorted.
     std::sort(this->ids.begin(), this->ids.end());
   }
 
+  // The orphan queue follows the ids, prefixed by its length.
+  this->orphans.clear();
+  if (p->flags() & FreelistOrphansPageFlag) {
+    pgid_t *orphans = ids + idx + count;
+    this->orphans.assign(orphans + 1, orphans + 1 + orphans[0]);
+  }
+
   // Rebuild the page cache.
   this->reindex();
 }
@@ -55,35 +101,182 @@ void FreeList::reindex() {
 }
 
 void FreeList::rollback(txid_t txid) {
+  // Forget the pages the transaction allocated.
+  for (auto it = this->allocs.begin(); it != this->allocs.end();) {
+    if (it->second == txid) {
+      this->allocs.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+
+  // Remove page ids from cache.
+  auto it = this->pending.find(txid);
+  if (it == this->pending.end()) {
+    return;
+  }
+  for (auto id : it->second) {
+    this->cache.erase(id);
+  }
+
+  // Remove pages from pending list.
+  this->pending.erase(it);
 }
 
 void FreeList::reload(Page *p) {
+  this->ids.clear();
+  this->read(p);
+
+  // Build a cache of only pending pages.
+  std::set<pgid_t> pcache;
+  for (auto &pair : this->pending) {
+    pcache.insert(pair.second.begin(), pair.second.end());
+  }
+
+  // Check each page in the freelist and build a new available freelist
+  // with any pages not in the pending lists.
+  std::vector<pgid_t> a;
+  for (auto id : this->ids) {
+    if (pcache.find(id) == pcache.end()) {
+      a.push_back(id);
+    }
+  }
+  this->ids = std::move(a);
+
+  // Once the available list is rebuilt then rebuild the free cache so that
+  // it includes the available and pending free pages.
+  this->reindex();
 }
 
-int FreeList::size() {
-  return 0;
+void FreeList::write(Page *p) {
+  // Combine the old free pgids and pgids waiting on an open transaction.
+
+  // Update the header flag.
+  p->setFlags(FreelistPageFlag);
+
+  // The page.count can only hold up to 64k elements so if we overflow that
+  // number then we handle it by putting the size in the first element.
+  auto ids = this->all_free_pgids();
+  pgid_t *dst = reinterpret_cast<pgid_t *>(p->ptr());
+  if (ids.size() < 0xFFFF) {
+    p->setCount(ids.size());
+    std::copy(ids.begin(), ids.end(), dst);
+  } else {
+    p->setCount(0xFFFF);
+    dst[0] = ids.size();
+    std::copy(ids.begin(), ids.end(), dst + 1);
+    dst++;
+  }
+
+  // Append the orphan queue. Readers that don't know the flag ignore it and
+  // only leak the pages.
+  if (!this->orphans.empty()) {
+    p->setFlags(FreelistPageFlag | FreelistOrphansPageFlag);
+    dst += ids.size();
+    dst[0] = this->orphans.size();
+    std::copy(this->orphans.begin(), this->orphans.end(), dst + 1);
+  }
 }
 
-int FreeList::count() {
-  return 0;
+std::vector<pgid_t> FreeList::all_free_pgids() {
+  std::vector<pgid_t> m;
+  for (auto &pair : this->pending) {
+    m.insert(m.end(), pair.second.begin(), pair.second.end());
+  }
+  std::sort(m.begin(), m.end());
+
+  std::vector<pgid_t> all(this->ids.size() + m.size());
+  std::merge(this->ids.begin(), this->ids.end(), m.begin(), m.end(), all.begin());
+  return all;
 }
 
-int FreeList::free_count() {
-  return 0;
+int FreeList::size() {
+  int n = this->count();
+  if (n >= 0xFFFF) {
+    // The first element will be used to store the count. See freelist.write.
+    n++;
+  }
+  if (!this->orphans.empty()) {
+    n += 1 + this->orphans.size();
+  }
+  return pageHeaderSize + sizeof(pgid_t) * n;
 }
 
+int FreeList::count() { return this->free_count() + this->pending_count(); }
+
+int FreeList::free_count() { return this->ids.size(); }
+
 int FreeList::pending_count() {
-  return 0;
+  int count = 0;
+  for (auto &pair : this->pending) {
+    count += pair.second.size();
+  }
+  return count;
 }
 
-pgid_t FreeList::allocate(int n) {
+pgid_t FreeList::allocate(txid_t txid, int n) {
+  if (this->ids.empty()) {
+    return 0;
+  }
+
+  pgid_t initial = 0, previd = 0;
+  for (size_t i = 0; i < this->ids.size(); i++) {
+    pgid_t id = this->ids[i];
+    if (id <= 1) {
+      std::cerr << "invalid page allocation: " << id << std::endl;
+      std::exit(1);
+    }
+
+    // Reset initial page if this is not contiguous.
+    if (previd == 0 || id - previd != 1) {
+      initial = id;
+    }
+
+    // If we found a contiguous block then remove it and return it.
+    if ((id - initial) + 1 == static_cast<pgid_t>(n)) {
+      this->ids.erase(this->ids.begin() + (i + 1 - n), this->ids.begin() + (i + 1));
+
+      // Remove from the free cache and remember who allocated the pages.
+      for (pgid_t j = 0; j < static_cast<pgid_t>(n); j++) {
+        this->cache.erase(initial + j);
+        this->allocs[initial + j] = txid;
+      }
+      return initial;
+    }
+
+    previd = id;
+  }
   return 0;
 }
 
 void FreeList::free(txid_t txid, Page *p) {
+  if (p->id() <= 1) {
+    std::cerr << "cannot free page 0 or 1: " << p->id() << std::endl;
+    std::exit(1);
+  }
 
-}
+  // The freelist page of the previous commit is replaced by every commit and
+  // was allocated by it.
+  bool freelist_page = this->allocs.find(p->id()) == this->allocs.end() && (p->flags() & FreelistPageFlag);
+
+  // Free page and all its overflow pages.
+  auto &ids = this->pending[txid];
+  for (pgid_t id = p->id(); id <= p->id() + p->overflow(); id++) {
+    // Verify that page is not already free.
+    if (this->cache.find(id) != this->cache.end()) {
+      std::cerr << "page " << id << " already freed" << std::endl;
+      std::exit(1);
+    }
 
-bool FreeList::freed(pgid_t pgid) {
-  return false;
+    // Add to the freelist and cache.
+    ids.push_back(id);
+    this->cache.insert(id);
+    if (freelist_page) {
+      this->allocs[id] = txid - 1;
+    }
+  }
 }
+
+void FreeList::orphan(pgid_t root) { this->orphans.push_back(root); }
+
+bool FreeList::freed(pgid_t pgid) { return this->cache.find(pgid) != this->cache.end(); }
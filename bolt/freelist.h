@@ -7,6 +7,11 @@
 #include <vector>
 
 class Page;
+class NodeCache;
+
+// DefaultReclaimBudget is the default number of pages of deleted buckets
+// that a commit frees, see FreeList::orphans.
+const int DefaultReclaimBudget = 4096;
 
 // freelist represents a list of all pages that are available for allocation.
 // It also tracks pages that have been freed but are still in use by open
@@ -14,7 +19,10 @@ class Page;
 struct FreeList {
   std::vector<pgid_t> ids;                       // all free and available free page ids
   std::map<txid_t, std::vector<pgid_t>> pending; // mapping of soon-to-be free page ids by tx
+  std::map<pgid_t, txid_t> allocs;               // mapping of txid that allocated a pgid
   std::set<pgid_t> cache;                        // fast lookup of all free and pending page ids
+  std::vector<pgid_t> orphans;                   // roots of unreachable subtrees whose pages are still to be freed
+  NodeCache *node_cache = nullptr;               // decoded pages to invalidate on release
 
   // size returns the size of the page after serialization.
   int size();
@@ -31,24 +39,37 @@ struct FreeList {
   // returns all free pgids (including all free ids and all pending ids) in one sorted list.
   std::vector<pgid_t> all_free_pgids();
 
-  // allocate a contiguous list of pages of a given size. Returns the starting page id. If a contiguous block cannot be
-  // found then 0 is returned.
-  pgid_t allocate(int n);
+  // allocate a contiguous list of pages of a given size for a given transaction id. Returns the starting page id. If a
+  // contiguous block cannot be found then 0 is returned.
+  pgid_t allocate(txid_t txid, int n);
 
   // free releases a page and its overflow for a given transaction id.
   // If the page is already free then a panic will occur.
   void free(txid_t txid, Page *p);
 
   // release moves all page ids for a transaction id (or older) to the freelist.
+  // Released pages are dropped from the node cache since they may be reused.
   void release(txid_t txid);
 
+  // release_range moves the pending page ids of the transactions in
+  // [begin, end] that were also allocated in that range to the freelist.
+  // When no reader's snapshot falls in the range, no one can see those pages
+  // anymore, even though older readers are still open.
+  void release_range(txid_t begin, txid_t end);
+
+  // orphan queues the tree rooted at a page, which must no longer be
+  // reachable from any bucket, to be freed by later commits a few pages at
+  // a time. The queue is saved with the freelist, so a crash doesn't leak
+  // the tree.
+  void orphan(pgid_t root);
+
   // rollback removes the pages from a given pending tx.
   void rollback(txid_t txid);
 
   // freed returns whether a given page is in the free list.
   bool freed(pgid_t pgid);
 
-  // read initializes the freelist from a freelist page.
+  // read initializes the freelist and the orphan queue from a freelist page.
   void read(Page *p);
 
   // write writes the page ids onto a freelist page. All free and pending ids are saved to disk
@@ -58,6 +79,10 @@ struct FreeList {
   // reload reads the freelist from a page and filters oput pending items.
   void reload(Page *p);
 
+  // release_ids moves page ids taken off the pending lists to the available
+  // freelist.
+  void release_ids(std::vector<pgid_t> &m);
+
   // reindex rebuilds the free cache based on available and pending free lists.
   void reindex();
 };
@@ -0,0 +1,71 @@
+#include "histogram.h"
+#include <algorithm>
+
+LatencyHistogram::LatencyHistogram() : max_(0) {
+  for (auto &c : this->counts_) {
+    c.store(0, std::memory_order_relaxed);
+  }
+}
+
+int LatencyHistogram::index(std::uint64_t v) {
+  if (v < SubBuckets) {
+    return static_cast<int>(v);
+  }
+  int shift = (63 - __builtin_clzll(v)) - SubBucketBits;
+  int sub = static_cast<int>(v >> shift) - SubBuckets;
+  return (shift + 1) * SubBuckets + sub;
+}
+
+std::uint64_t LatencyHistogram::highest(int index) {
+  if (index < SubBuckets) {
+    return index;
+  }
+  int shift = index / SubBuckets - 1;
+  std::uint64_t sub = index % SubBuckets;
+  return ((SubBuckets + sub) << shift) + ((std::uint64_t(1) << shift) - 1);
+}
+
+void LatencyHistogram::record(std::chrono::microseconds d) {
+  std::uint64_t v = d.count() > 0 ? d.count() : 0;
+  this->counts_[index(v)].fetch_add(1, std::memory_order_relaxed);
+
+  std::uint64_t max = this->max_.load(std::memory_order_relaxed);
+  while (v > max && !this->max_.compare_exchange_weak(max, v, std::memory_order_relaxed)) {
+  }
+}
+
+LatencySnapshot LatencyHistogram::snapshot() const {
+  // Copy the counts first so that all percentiles agree with each other even
+  // if values are recorded concurrently.
+  std::uint64_t counts[BucketCount];
+  std::uint64_t total = 0;
+  for (int i = 0; i < BucketCount; i++) {
+    counts[i] = this->counts_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+
+  LatencySnapshot s = {total, std::chrono::microseconds(0), std::chrono::microseconds(0),
+                       std::chrono::microseconds(0),
+                       std::chrono::microseconds(this->max_.load(std::memory_order_relaxed))};
+  if (total == 0) {
+    return s;
+  }
+
+  struct {
+    double quantile;
+    std::chrono::microseconds *value;
+  } targets[] = {{0.5, &s.p50}, {0.99, &s.p99}, {0.999, &s.p999}};
+
+  std::uint64_t seen = 0;
+  int t = 0;
+  for (int i = 0; i < BucketCount && t < 3; i++) {
+    seen += counts[i];
+    while (t < 3 && seen >= targets[t].quantile * total) {
+      // Never report more than the largest value actually recorded.
+      std::uint64_t v = highest(i);
+      *targets[t].value = std::min(std::chrono::microseconds(v), s.max);
+      t++;
+    }
+  }
+  return s;
+}
@@ -0,0 +1,50 @@
+#ifndef __BOLT_HISTOGRAM_H
+#define __BOLT_HISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// LatencySnapshot represents the latency distribution recorded by a
+// LatencyHistogram at some point in time.
+struct LatencySnapshot {
+  std::uint64_t count;            // number of recorded values
+  std::chrono::microseconds p50;  // median
+  std::chrono::microseconds p99;  // 99th percentile
+  std::chrono::microseconds p999; // 99.9th percentile
+  std::chrono::microseconds max;  // largest recorded value
+};
+
+// LatencyHistogram records durations with microsecond resolution in a fixed
+// amount of memory. Values below 16us are recorded exactly; above that, every
+// power of two is split into 16 linear buckets, which bounds the error of a
+// reported percentile to 1/16 of its value.
+//
+// Recording is lock-free so it can be done from any thread without
+// serializing on a mutex.
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+
+  // record adds a duration to the histogram.
+  void record(std::chrono::microseconds d);
+
+  // snapshot computes the percentiles of all durations recorded so far.
+  LatencySnapshot snapshot() const;
+
+private:
+  static const int SubBucketBits = 4;
+  static const int SubBuckets = 1 << SubBucketBits;
+  static const int BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+
+  // index returns the bucket a value is recorded in.
+  static int index(std::uint64_t v);
+
+  // highest returns the largest value recorded in a bucket.
+  static std::uint64_t highest(int index);
+
+  std::atomic<std::uint64_t> counts_[BucketCount];
+  std::atomic<std::uint64_t> max_;
+};
+
+#endif
@@ -19,8 +19,8 @@ void Meta::validate() {
 }
 
 void Meta::write(Page *p) {
-  if (this->root->root >= this->pgid) {
-    std::cerr << "root bucket pgid (" << this->root->root << ") above high water mark (" << this->pgid << "\n";
+  if (this->root.root >= this->pgid) {
+    std::cerr << "root bucket pgid (" << this->root.root << ") above high water mark (" << this->pgid << ")\n";
     std::abort();
   } else if (this->freelist >= this->pgid) {
     std::cerr << "freelist pgid (" << this->freelist << ") above high water mark (" << this->pgid << ")\n";
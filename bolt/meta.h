@@ -1,17 +1,24 @@
 #ifndef __BOLT_META_H
 #define __BOLT_META_H
 
+#include "bucket.h"
 #include "types.h"
 #include <cstdint>
 
-struct bucket;
 class Page;
 
 // Represents a marker value to indicate that a file is a Bolt DB.
 const std::uint32_t Magic = 0xED0CDAED;
 
-// The data file format version.
-const int Version = 2;
+// The data file format version. Version 3 grew the bucket header with the
+// bucket flags and comparator, which moves the page of every inline bucket,
+// so files of earlier versions are rejected rather than misread.
+const int Version = 3;
+
+// Set on the metas of a copy written by Compactor. Its pages are laid out
+// differently from the source's, so incremental backups of the source don't
+// apply to it. The first commit to the copy clears the flag.
+const std::uint32_t MetaCompactedFlag = 0x01;
 
 class Meta {
 public:
@@ -32,7 +39,7 @@ public:
   std::uint32_t version;
   std::uint32_t page_size;
   std::uint32_t flags;
-  struct bucket *root;
+  struct bucket root;
   pgid_t freelist;
   pgid_t pgid;
   txid_t txid;
@@ -1,15 +1,17 @@
 #include "node.h"
 #include "bucket.h"
+#include "db.h"
+#include "exception.h"
+#include "freelist.h"
 #include "meta.h"
+#include "node_cache.h"
 #include "page.h"
 #include "tx.h"
+#include "u64_keys.h"
 #include <algorithm>
 #include <cassert>
 #include <iostream>
-
-extern const size_t pageHeaderSize;
-extern const size_t leafPageElementSize;
-extern const size_t branchPageElementSize;
+#include <iterator>
 
 Node *Node::root() {
   if (this->parent_ == nullptr) {
@@ -36,18 +38,24 @@ Node *Node::childAt(int index) const {
     std::cerr << "invalid childAt(" << index << ") on a leaf node";
     std::exit(1);
   }
-  return this->bucket_->node(this->inodes[index].id, this);
+  Node *n = this->bucket_->node(this->inodes[index].id, this);
+
+  // The branch key may be a separator that differs from the child's first
+  // key, and the child must find itself by it when it is spilled.
+  if (n) {
+    n->key_ = this->inodes[index].key;
+  }
+  return n;
 }
 
 int Node::childIndex(const Node *child) const {
-  auto first = std::lower_bound(this->inodes.begin(), this->inodes.end(), child->key());
-  if (first == this->inodes.end()) {
-    return -1;
-  }
-  if ((*first) == child->key_) {
-    return first - this->inodes.begin();
-  }
-  return -1;
+  auto [index, exact] = this->search(child->key_);
+  return exact ? static_cast<int>(index) : -1;
+}
+
+std::pair<size_t, bool> Node::search(const Slice &key) const {
+  std::uint32_t comparator = this->bucket_ ? this->bucket_->comparator() : BytewiseComparator::id;
+  return with_comparator(comparator, [&](auto cmp) { return search_inodes<decltype(cmp)>(this->inodes, key); });
 }
 
 int Node::numChildren() const { return this->inodes.size(); }
@@ -79,15 +87,11 @@ int Node::get(const Slice &key, std::string *value) const {
     std::cerr << " value is null\n";
     std::exit(1);
   }
-  // Find insertion index.
-  auto first = std::lower_bound(this->inodes.begin(), this->inodes.end(), key);
-  // Add capacity and shift nodes if we don't have an exact match and need to
-  // insert.
-  bool exact = numChildren() > 0 && first != this->inodes.end() && (*first) == key;
+  auto [index, exact] = this->search(key);
   if (!exact) {
     return -1;
   }
-  const INode &inode = *first;
+  const INode &inode = this->inodes[index];
   value->assign(inode.value.data(), inode.value.size());
   return 0;
 }
@@ -112,13 +116,11 @@ void Node::put(const Slice &oldKey, const Slice &newKey, const Slice &value, pgi
   }
 
   // Find insertion index.
-  auto first = std::lower_bound(this->inodes.begin(), this->inodes.end(), oldKey);
+  auto [index, exact] = this->search(oldKey);
   // Add capacity and shift nodes if we don't have an exact match and need to
   // insert.
-  bool exact = numChildren() > 0 && first != this->inodes.end() && (*first) == oldKey;
-  auto index = first - inodes.begin();
   if (!exact) {
-    this->inodes.insert(first, INode());
+    this->inodes.insert(this->inodes.begin() + index, INode());
   }
   INode &inode = this->inodes[index];
   inode.flags = flags;
@@ -131,94 +133,498 @@ void Node::put(const Slice &oldKey, const Slice &newKey, const Slice &value, pgi
   }
 }
 
+void Node::merge(const KV *kvs, size_t n) {
+  std::uint32_t comparator = this->bucket_ ? this->bucket_->comparator() : BytewiseComparator::id;
+  with_comparator(comparator, [&](auto cmp) {
+    using Cmp = decltype(cmp);
+    std::vector<INode> merged;
+    merged.reserve(this->inodes.size() + n);
+    auto it = this->inodes.begin();
+    for (size_t i = 0; i < n; i++) {
+      for (; it != this->inodes.end() && Cmp::compare(it->key, kvs[i].key) < 0; ++it) {
+        merged.push_back(std::move(*it));
+      }
+      if (it != this->inodes.end() && Cmp::compare(it->key, kvs[i].key) == 0) {
+        if (it->flags & BucketLeafFlag) {
+          throw IncompatibleValueException();
+        }
+        ++it;
+      }
+      merged.push_back(INode{0, 0, kvs[i].key, kvs[i].value});
+    }
+    std::move(it, this->inodes.end(), std::back_inserter(merged));
+    this->inodes = std::move(merged);
+  });
+}
+
+void Node::delete_range(const Slice &begin, const Slice &end) {
+  std::uint32_t comparator = this->bucket_ ? this->bucket_->comparator() : BytewiseComparator::id;
+  with_comparator(comparator, [&](auto cmp) { this->delete_range_<decltype(cmp)>(begin, end, std::nullopt); });
+}
+
+template <class Cmp>
+void Node::delete_range_(const Slice &begin, const Slice &end, const std::optional<Slice> &upper) {
+  if (this->isLeaf_) {
+    size_t lo = search_inodes<Cmp>(this->inodes, begin).first;
+    size_t hi = search_inodes<Cmp>(this->inodes, end).first;
+    for (size_t i = lo; i < hi; i++) {
+      if (this->inodes[i].flags & BucketLeafFlag) {
+        throw IncompatibleValueException();
+      }
+    }
+    if (lo < hi) {
+      this->inodes.erase(this->inodes.begin() + lo, this->inodes.begin() + hi);
+      this->unbalanced_ = true;
+    }
+    return;
+  }
+
+  // Child i holds the keys in [inodes[i].key, inodes[i + 1].key), so the
+  // children in [first, last) overlap the range.
+  auto [first, exact] = search_inodes<Cmp>(this->inodes, begin);
+  if (!exact && first > 0) {
+    first--;
+  }
+  size_t last = std::max(search_inodes<Cmp>(this->inodes, end).first, first + 1);
+  last = std::min(last, this->inodes.size());
+
+  // Go backwards so that dropping a child doesn't move the ones left to do.
+  for (size_t i = last; i-- > first;) {
+    std::optional<Slice> bound = i + 1 < this->inodes.size() ? this->inodes[i + 1].key : upper;
+    bool covered = Cmp::compare(begin, this->inodes[i].key) <= 0 && bound && Cmp::compare(*bound, end) <= 0;
+
+    // A child read into a node may hold changes of this transaction, so
+    // only untouched subtrees are freed by page.
+    pgid_t id = this->inodes[i].id;
+    if (covered && this->bucket_->nodes.count(id) == 0) {
+      this->free_tree(id);
+      this->inodes.erase(this->inodes.begin() + i);
+      this->unbalanced_ = true;
+    } else {
+      this->childAt(i)->delete_range_<Cmp>(begin, end, bound);
+    }
+  }
+}
+
+void Node::free_tree(pgid_t id) {
+  Tx *tx = this->bucket_->tx();
+  Page *p = tx->page(id);
+  if (p->flags() & BranchPageFlag) {
+    for (std::uint32_t i = 0; i < p->count(); i++) {
+      this->free_tree(p->branchPageElement(i)->id);
+    }
+  } else {
+    for (std::uint32_t i = 0; i < p->count(); i++) {
+      if (p->leafPageElement(i)->flags & BucketLeafFlag) {
+        throw IncompatibleValueException();
+      }
+    }
+  }
+  this->bucket_->freed_.push_back(id);
+}
+
 void Node::del(const Slice &key) {
   if (key.size() <= 0) {
     std::cerr << "del: zero-length key\n";
     std::exit(1);
   }
-  auto first = std::lower_bound(this->inodes.begin(), this->inodes.end(), key);
-  bool exact = numChildren() > 0 && first != this->inodes.end() && (*first) == key;
+  auto [index, exact] = this->search(key);
   if (!exact) {
     return;
   }
   // Delete inode from the node.
-  this->inodes.erase(first);
+  this->inodes.erase(this->inodes.begin() + index);
   // Mark the node as needing rebalacing.
   this->unbalanced_ = true;
 }
 
 void Node::write(Page *p) {
-  // initilize page's header
-  if (this->isLeaf_) {
-    p->setFlags(LeafPageFlag);
-  } else {
-    p->setFlags(BranchPageFlag);
-  }
   if (this->inodes.size() > 0xffff) {
     std::cerr << "page's count is overflow: pgid = " << p->id();
     std::exit(1);
   }
-  p->unsetOverflow();
-  p->setCount(this->inodes.size());
+  if (!this->isLeaf_) {
+    for (auto &inode : this->inodes) {
+      if (inode.id == p->id()) {
+        std::cerr << "write: circular dependency occured\n";
+        std::exit(1);
+      }
+    }
+  }
+  write_inodes(p, this->inodes, this->isLeaf_, this->bucket_ != nullptr && this->bucket_->u64_keys());
+}
+
+void write_inodes(Page *p, const std::vector<INode> &inodes, bool isLeaf, bool u64Keys) {
+  // initilize page's header
+  p->setFlags(isLeaf ? LeafPageFlag : BranchPageFlag);
+  if (u64Keys) {
+    p->setFlags(U64KeyPageFlag);
+  }
+  p->setCount(inodes.size());
 
   if (p->count() == 0) {
     return;
   }
 
-  char *b = reinterpret_cast<char *>(p->ptr() + (this->inodes.size() * this->pageElementSize()));
-  for (size_t i = 0; i < this->inodes.size(); ++i) {
-    const INode &n = this->inodes[i];
-    if (this->isLeaf_) {
-      LeafPageElement *elem = p->leafPageElement(i);
+  // Integer keys are packed in front of the elements and the elements only
+  // point at their values. The data may overlap the page header's ptr field,
+  // so take every address before writing.
+  char *keys = reinterpret_cast<char *>(p->ptr());
+  char *elems = reinterpret_cast<char *>(p->elements());
+  size_t elsz = isLeaf ? leafPageElementSize : branchPageElementSize;
+  char *b = elems + inodes.size() * elsz;
+  for (size_t i = 0; i < inodes.size(); ++i) {
+    const INode &n = inodes[i];
+    std::uint32_t ksize = n.key.size();
+    if (u64Keys) {
+      if (n.key.size() != U64KeySize) {
+        std::cerr << "write: key of " << n.key.size() << " bytes in an integer-key bucket\n";
+        std::exit(1);
+      }
+      std::memcpy(keys + i * U64KeySize, n.key.data(), U64KeySize);
+      ksize = 0;
+    }
+
+    if (isLeaf) {
+      LeafPageElement *elem = reinterpret_cast<LeafPageElement *>(elems) + i;
       elem->flags = n.flags;
-      elem->ksize = n.key.size();
+      elem->ksize = ksize;
       elem->vsize = n.value.size();
       elem->pos = static_cast<std::uint32_t>((char *)(b) - (char *)(elem));
     } else {
-      BranchPageElement *elem = p->branchPageElement(i);
-      elem->ksize = n.key.size();
+      BranchPageElement *elem = reinterpret_cast<BranchPageElement *>(elems) + i;
+      elem->ksize = ksize;
       elem->id = n.id;
       elem->pos = static_cast<std::uint32_t>((char *)(b) - (char *)(elem));
-      if (elem->id != p->id()) {
-        std::cerr << "write: circular dependency occured\n";
-        std::exit(1);
-      }
     }
 
-    std::memcpy(b, n.key.data(), n.key.size());
-    b += n.key.size();
+    std::memcpy(b, n.key.data(), ksize);
+    b += ksize;
     std::memcpy(b, n.value.data(), n.value.size());
     b += n.value.size();
   }
 }
 
-void Node::read(Page *p) {
-  // initilize node's header
-  std::string s;
-  this->id_ = p->id();
-  this->isLeaf_ = (p->flags() & LeafPageFlag) ? true : false;
-  this->inodes.clear();
-  this->inodes.reserve(p->count());
+Slice shortest_separator(const Slice &left, const Slice &right) {
+  size_t n = left.difference_offset(right) + 1;
+  return n < right.size() ? Slice(right.data(), n) : right;
+}
+
+void Node::spill() {
+  Tx *tx = this->bucket_->tx();
+  if (this->spilled_) {
+    return;
+  }
+
+  // Spill child nodes first. Child nodes can materialize sibling nodes in
+  // the case of split-merge so we cannot use a range loop. We have to check
+  // the children size on every loop iteration.
+  std::sort(this->children.begin(), this->children.end(), [](Node *a, Node *b) { return *a < *b; });
+  for (size_t i = 0; i < this->children.size(); i++) {
+    this->children[i]->spill();
+  }
+
+  // We no longer need the child list because it's only used for spill tracking.
+  this->children.clear();
+
+  // Split nodes into appropriate sizes. The first node will always be n.
+  int page_size = tx->db()->page_size();
+  std::vector<Node *> nodes = this->split(page_size);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    Node *node = nodes[i];
+
+    // Add node's page to the freelist if it's not new.
+    if (node->id_ > 0) {
+      tx->db()->freelist_->free(tx->meta()->txid, tx->page(node->id_));
+      node->id_ = 0;
+    }
+
+    // Allocate contiguous space for the node.
+    Page *p = tx->allocate(node->size() / page_size + 1);
+
+    // Write the node.
+    if (p->id() >= tx->meta()->pgid) {
+      std::cerr << "pgid (" << p->id() << ") above high water mark (" << tx->meta()->pgid << ")\n";
+      std::exit(1);
+    }
+    node->id_ = p->id();
+    node->write(p);
+    node->spilled_ = true;
+
+    // Insert into parent inodes. A node split off its left neighbour only
+    // needs a separator from it, which keeps long keys out of branch pages.
+    // The first node keeps the key its parent knows it by, which still
+    // separates it from its left sibling, unless its keys now start before
+    // it.
+    if (node->parent_) {
+      Slice key = node->key_.size() > 0 ? node->key_ : node->inodes[0].key;
+      Slice separator = node->inodes[0].key;
+      if (i > 0) {
+        // Integer keys have a fixed width, so they are never shortened, and
+        // a prefix only separates keys in bytewise order.
+        if (!this->bucket_->u64_keys() && this->bucket_->comparator() == BytewiseComparator::id) {
+          separator = shortest_separator(nodes[i - 1]->inodes.back().key, node->inodes[0].key);
+        }
+      } else if (node->key_.size() > 0 && node->search(node->key_).first == 0) {
+        separator = node->key_;
+      }
+      node->parent_->put(key, separator, Slice(), node->id_, 0);
+      node->key_ = separator;
+      assert(node->key_.size() > 0);
+    }
+
+    // Update the statistics.
+    tx->stats_.spill++;
+  }
+
+  // If the root node split and created a new root then we need to spill that
+  // as well. We'll clear out the children to make sure it doesn't try to respill.
+  if (this->parent_ && this->parent_->id_ == 0) {
+    this->children.clear();
+    this->parent_->spill();
+  }
+}
+
+void Node::free() {
+  if (this->id_ != 0) {
+    Tx *tx = this->bucket_->tx();
+    tx->db()->freelist_->free(tx->meta()->txid, tx->page(this->id_));
+    this->id_ = 0;
+  }
+}
+
+void Node::rebalance() {
+  if (!this->unbalanced_) {
+    return;
+  }
+  this->unbalanced_ = false;
+
+  // Update statistics.
+  Tx *tx = this->bucket_->tx();
+  tx->stats_.rebalance++;
+
+  // Ignore if node is above threshold and has enough keys.
+  const RebalancePolicy &policy = this->bucket_->rebalancePolicy;
+  int page_size = tx->db()->page_size();
+  int threshold = static_cast<int>(page_size * policy.MergePercent);
+  bool enough_keys = static_cast<int>(this->inodes.size()) > this->minKeys();
+  if (this->size() > threshold && enough_keys) {
+    return;
+  }
+
+  // A lazy policy leaves nodes that only dropped below the threshold in this
+  // transaction to a later one.
+  if (policy.Lazy && enough_keys && (this->read_size_ == 0 || this->read_size_ > threshold)) {
+    return;
+  }
+
+  // Root node has special handling.
+  if (!this->parent_) {
+    // If root node is a branch and only has one node then collapse it.
+    if (!this->isLeaf_ && this->inodes.size() == 1) {
+      // Move root's child up.
+      Node *child = this->bucket_->node(this->inodes[0].id, this);
+      this->isLeaf_ = child->isLeaf_;
+      this->inodes = child->inodes;
+      this->children = child->children;
+
+      // Reparent all child nodes being moved.
+      for (auto &inode : this->inodes) {
+        auto it = this->bucket_->nodes.find(inode.id);
+        if (it != this->bucket_->nodes.end()) {
+          it->second->parent_ = this;
+        }
+      }
+
+      // Remove old child.
+      child->parent_ = nullptr;
+      this->bucket_->nodes.erase(child->id_);
+      child->free();
+    }
+    return;
+  }
+
+  // If node has no keys then just remove it.
+  if (this->numChildren() == 0) {
+    this->parent_->del(this->key_);
+    this->parent_->removeChild(this);
+    this->bucket_->nodes.erase(this->id_);
+    this->free();
+    this->parent_->rebalance();
+    return;
+  }
+
+  assert(this->parent_->numChildren() > 1);
+
+  // Destination node is right sibling if idx == 0, otherwise left sibling.
+  bool use_next_sibling = this->parent_->childIndex(this) == 0;
+  Node *target = use_next_sibling ? this->nextSibling() : this->prevSibling();
+
+  // Don't merge into a node so full that it would split again soon.
+  if (enough_keys && policy.MaxMergePercent > 0 &&
+      this->size() + target->size() - static_cast<int>(pageHeaderSize) > page_size * policy.MaxMergePercent) {
+    return;
+  }
+
+  // Merge the right node of the two into the left one.
+  Node *left = use_next_sibling ? this : target;
+  Node *right = use_next_sibling ? target : this;
+
+  // Reparent all child nodes being moved.
+  for (auto &inode : right->inodes) {
+    auto it = this->bucket_->nodes.find(inode.id);
+    if (it != this->bucket_->nodes.end()) {
+      Node *child = it->second;
+      child->parent_->removeChild(child);
+      child->parent_ = left;
+      left->children.push_back(child);
+    }
+  }
+
+  // Copy over inodes from the right node and remove it.
+  left->inodes.insert(left->inodes.end(), right->inodes.begin(), right->inodes.end());
+  this->parent_->del(right->key_);
+  this->parent_->removeChild(right);
+  this->bucket_->nodes.erase(right->id_);
+  right->free();
+
+  // Either this node or the target node was deleted from the parent so
+  // rebalance it.
+  this->parent_->rebalance();
+}
+
+void Node::removeChild(Node *node) {
+  auto it = std::find(this->children.begin(), this->children.end(), node);
+  if (it != this->children.end()) {
+    this->children.erase(it);
+  }
+}
+
+int Node::minKeys() { return this->isLeaf_ ? 1 : 2; }
+
+std::vector<Node *> Node::split(int pageSize) {
+  std::vector<Node *> nodes;
+  Node *node = this;
+  for (;;) {
+    // Split node into two.
+    auto ab = node->splitTwo(pageSize);
+    nodes.push_back(ab.first);
+
+    // If we can't split then exit the loop.
+    if (!ab.second) {
+      break;
+    }
+
+    // Set node to b so it gets split on the next iteration.
+    node = ab.second;
+  }
+  return nodes;
+}
+
+std::pair<Node *, Node *> Node::splitTwo(int pageSize) {
+  // Ignore the split if the page doesn't have at least enough nodes for
+  // two pages or if the nodes can fit in a single page.
+  if (static_cast<int>(this->inodes.size()) <= MinKeysPerPage * 2 || this->sizeLessThan(pageSize)) {
+    return std::make_pair(this, nullptr);
+  }
+
+  // Determine the threshold before starting a new node.
+  double fillPercent = std::max(MinFillPercent, std::min(MaxFillPercent, this->bucket_->fillPercent));
+  int threshold = static_cast<int>(pageSize * fillPercent);
+
+  // Determine split position and sizes of the two pages.
+  int splitIndex = this->splitIndex(threshold).first;
+
+  // Split node into two separate nodes.
+  // If there's no parent then we'll need to create one.
+  if (!this->parent_) {
+    this->parent_ = this->bucket_->new_node(false, nullptr);
+    this->parent_->children.push_back(this);
+  }
+
+  // Create a new node and add it to the parent.
+  Node *next = this->bucket_->new_node(this->isLeaf_, this->parent_);
+  this->parent_->children.push_back(next);
+
+  // Split inodes across two nodes.
+  next->inodes.assign(this->inodes.begin() + splitIndex, this->inodes.end());
+  this->inodes.resize(splitIndex);
+
+  // Update the statistics.
+  this->bucket_->tx()->stats_.split++;
+
+  return std::make_pair(this, next);
+}
+
+std::pair<int, int> Node::splitIndex(int threshold) {
+  int index = 0;
+  int sz = pageHeaderSize;
+
+  // Loop until we only have the minimum number of keys required for the
+  // second page.
+  for (int i = 0; i < static_cast<int>(this->inodes.size()) - MinKeysPerPage; i++) {
+    index = i;
+    const INode &inode = this->inodes[i];
+    int elsize = this->pageElementSize() + inode.key.size() + inode.value.size();
+
+    // If we have at least the minimum number of keys and adding another
+    // node would put us over the threshold then exit and return.
+    if (i >= MinKeysPerPage && sz + elsize > threshold) {
+      break;
+    }
+
+    // Add the element size to the total size.
+    sz += elsize;
+  }
+  return std::make_pair(index, sz);
+}
+
+void read_inodes(Page *p, std::vector<INode> *inodes) {
+  bool isLeaf = (p->flags() & LeafPageFlag) ? true : false;
+  bool u64Keys = (p->flags() & U64KeyPageFlag) ? true : false;
+  inodes->clear();
+  inodes->reserve(p->count());
 
   for (size_t i = 0; i < p->count(); i++) {
     INode inode;
-    if (this->isLeaf_) {
+    if (isLeaf) {
       LeafPageElement *elem = p->leafPageElement(i);
       inode.flags = elem->flags;
-      inode.key = elem->key();
+      inode.key = u64Keys ? p->u64Key(i) : elem->key();
       inode.value = elem->value();
     } else {
       BranchPageElement *elem = p->branchPageElement(i);
-      INode inode;
+      inode.flags = 0;
       inode.id = elem->id;
-      inode.key = elem->key();
+      inode.key = u64Keys ? p->u64Key(i) : elem->key();
     }
     if (inode.key.size() <= 0) {
       std::cerr << "read: zero-length inode key\n";
       std::exit(1);
     }
-    this->inodes.push_back(std::move(inode));
+    inodes->push_back(std::move(inode));
   }
+}
+
+void Node::read(Page *p) {
+  // initilize node's header
+  this->id_ = p->id();
+  this->isLeaf_ = (p->flags() & LeafPageFlag) ? true : false;
+  read_inodes(p, &this->inodes);
+  this->read_size_ = this->size();
+
+  // Save first key so we can find the node in the parent when we spill.
+  if (this->inodes.size() > 0) {
+    this->key_ = this->inodes[0].key;
+    assert(this->key_.size() > 0);
+  }
+}
+
+void Node::read(const DecodedPage &d) {
+  this->id_ = d.id;
+  this->isLeaf_ = d.isLeaf;
+  this->inodes = d.inodes;
+  this->read_size_ = this->size();
 
   // Save first key so we can find the node in the parent when we spill.
   if (this->inodes.size() > 0) {
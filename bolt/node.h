@@ -1,15 +1,23 @@
 #ifndef __BOLT_NODE_H
 #define __BOLT_NODE_H
 
+#include "comparator.h"
 #include "slice.h"
 #include "types.h"
 #include <cstdint>
 #include <cstring>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
+// MinKeysPerPage is the least number of keys a split leaves in a page.
+const int MinKeysPerPage = 2;
+
 class Bucket;
 class Page;
+struct DecodedPage;
+struct KV;
 
 // INode represents an internal node inside of a node.
 // It can be used to point to elements in a page or
@@ -33,11 +41,33 @@ inline bool operator==(const INode &n, const Slice &key) {
 
 inline bool operator==(const INode &n, const char *key) { return n.key == key; }
 
+// search_inodes returns the index of the first inode whose key is not less
+// than key under Cmp, and whether that inode's key is equal to key.
+template <class Cmp> std::pair<size_t, bool> search_inodes(const std::vector<INode> &inodes, const Slice &key) {
+  size_t index = lower_bound_by<Cmp>(inodes.size(), key, [&](size_t i) -> const Slice & { return inodes[i].key; });
+  return std::make_pair(index, index < inodes.size() && Cmp::compare(inodes[index].key, key) == 0);
+}
+
+// shortest_separator returns the shortest prefix of right that still sorts
+// after left, given left < right. A branch key only has to sort after every
+// key of the child on its left and not after the first key of its own child,
+// so it can be cut right after the first byte that differs.
+Slice shortest_separator(const Slice &left, const Slice &right);
+
+// read_inodes decodes the elements of a branch or leaf page into inodes.
+// Keys and values refer to the page memory.
+void read_inodes(Page *p, std::vector<INode> *inodes);
+
+// write_inodes serializes inodes onto a branch or leaf page, packing the keys
+// into an integer array if u64Keys is set.
+void write_inodes(Page *p, const std::vector<INode> &inodes, bool isLeaf, bool u64Keys);
+
 // Node represents an in-memory, deserialized page.
 class Node {
 public:
   Node(Bucket *bucket, bool isLeaf, Node *parent)
-      : bucket_(bucket), isLeaf_(isLeaf), parent_(parent) {}
+      : bucket_(bucket), isLeaf_(isLeaf), unbalanced_(false), spilled_(false), id_(0), read_size_(0),
+        parent_(parent) {}
 
   Slice key() const { return key_; }
 
@@ -74,6 +104,11 @@ public:
   // prevSibling returns the previous node with the same parent.
   Node *prevSibling() const;
 
+  // search returns the index of the first inode whose key is not less than
+  // key in the order of the bucket's comparator, and whether it is equal to
+  // key.
+  std::pair<size_t, bool> search(const Slice &key) const;
+
   // get queries a value
   int get(const Slice &key, std::string *value) const;
 
@@ -81,6 +116,15 @@ public:
   void put(const Slice &oldKey, const Slice &newKey, const Slice &value,
            pgid_t id, std::uint32_t flags);
 
+  // merge inserts or replaces n key/value pairs, sorted by the bucket's
+  // comparator and without duplicates, in one pass over the inodes.
+  // Throws IncompatibleValueException if a key names a nested bucket.
+  void merge(const KV *kvs, size_t n);
+
+  // delete_range removes the keys in [begin, end) from the tree under a root
+  // node, see Bucket::delete_range().
+  void delete_range(const Slice &begin, const Slice &end);
+
   // del removes a key from the node.
   // not thread-safe
   void del(const Slice &key);
@@ -93,12 +137,17 @@ public:
   // read initializes the node from a page.
   void read(Page *p);
 
+  // read initializes the node from an already decoded page.
+  void read(const DecodedPage &d);
+
   // spill writes the nodes to dirty pages and splits nodes as it goes.
   // Throws an runtime_error if dirty pages cannot be allocated.
   void spill();
 
   // rebalance attempts to combine the node with sibling nodes if the node's
-  // filled size is below a threshold or if there are not enough keys.
+  // filled size is below a threshold or if there are not enough keys. The
+  // threshold and when merges happen are set by the bucket's
+  // rebalancePolicy.
   void rebalance();
 
   // removes a node from the list of in-memory children.
@@ -124,6 +173,8 @@ public:
 
 private:
   // split breaks up a node into multiple smaller nodes, if appropriate.
+  // pageSize is the page size of the database, which Option::PageSize
+  // may set larger than the OS page.
   // This should only be called from the spill() function.
   std::vector<Node *> split(int pageSize);
 
@@ -136,17 +187,29 @@ private:
   // This is noly be called from split().
   std::pair<int, int> splitIndex(int threshold);
 
+  // delete_range_ removes the keys in [begin, end) under the node, whose
+  // keys all sort before upper, if set.
+  template <class Cmp> void delete_range_(const Slice &begin, const Slice &end, const std::optional<Slice> &upper);
+
+  // free_tree queues a page and every page below it to be freed when the
+  // bucket is spilled. Throws IncompatibleValueException if it holds a
+  // nested bucket.
+  void free_tree(pgid_t id);
+
   Bucket *bucket_;
   bool isLeaf_;
   bool unbalanced_;
   bool spilled_;
-  Slice key_;
+  Slice key_; // key of the node in its parent, which may be a separator shorter than its first key
   pgid_t id_;
+  int read_size_; // size of the page the node was read from, 0 for a new node
   Node *parent_;
   std::vector<Node *> children; // help to record sub node during spilling
   std::vector<INode> inodes;
 
+  friend class Bucket;
   friend class Cursor;
+  friend struct elemRef;
 };
 
 #endif
@@ -0,0 +1,87 @@
+#include "node_cache.h"
+#include "page.h"
+
+std::shared_ptr<const DecodedPage> DecodedPage::decode(Page *p) {
+  auto d = std::make_shared<DecodedPage>();
+  d->id = p->id();
+  d->isLeaf = (p->flags() & LeafPageFlag) ? true : false;
+  read_inodes(p, &d->inodes);
+  if (p->flags() & U64KeyPageFlag) {
+    d->u64Keys.reserve(d->inodes.size());
+    for (auto &inode : d->inodes) {
+      d->u64Keys.push_back(decode_u64_key(inode.key.data()));
+    }
+  }
+  return d;
+}
+
+NodeCache::NodeCache(std::size_t capacity) : shard_capacity_(capacity / ShardCount) {}
+
+std::shared_ptr<const DecodedPage> NodeCache::get(Page *p) {
+  pgid_t id = p->id();
+  Shard &s = this->shard(id);
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto search = s.index.find(id);
+    if (search != s.index.end()) {
+      s.lru.splice(s.lru.begin(), s.lru, search->second);
+      return search->second->page;
+    }
+  }
+
+  // Decode outside of the lock. Only readers that can still reach the page
+  // race here and they all decode identical contents.
+  std::shared_ptr<const DecodedPage> d = DecodedPage::decode(p);
+
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto search = s.index.find(id);
+  if (search != s.index.end()) {
+    return search->second->page;
+  }
+  s.lru.push_front(Entry{id, d});
+  s.index[id] = s.lru.begin();
+  s.charge += d->charge();
+  this->evict(s);
+  return d;
+}
+
+void NodeCache::evict(Shard &s) {
+  // Always keep the most recent entry so that a single oversized page still
+  // gets cached.
+  while (s.charge > this->shard_capacity_ && s.lru.size() > 1) {
+    Entry &e = s.lru.back();
+    s.charge -= e.page->charge();
+    s.index.erase(e.id);
+    s.lru.pop_back();
+  }
+}
+
+void NodeCache::invalidate(pgid_t id) {
+  Shard &s = this->shard(id);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto search = s.index.find(id);
+  if (search == s.index.end()) {
+    return;
+  }
+  s.charge -= search->second->page->charge();
+  s.lru.erase(search->second);
+  s.index.erase(search);
+}
+
+void NodeCache::clear() {
+  for (auto &s : this->shards_) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.lru.clear();
+    s.index.clear();
+    s.charge = 0;
+  }
+}
+
+std::size_t NodeCache::charge() {
+  std::size_t sz = 0;
+  for (auto &s : this->shards_) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    sz += s.charge;
+  }
+  return sz;
+}
@@ -0,0 +1,100 @@
+#ifndef __BOLT_NODE_CACHE_H
+#define __BOLT_NODE_CACHE_H
+
+#include "node.h"
+#include "types.h"
+#include "u64_keys.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+class Page;
+
+// DefaultNodeCacheSize is the default byte budget of the decoded node cache.
+const int DefaultNodeCacheSize = 32 * 1024 * 1024;
+
+// DecodedPage is an immutable, decoded representation of a branch or leaf page.
+// Keys and values point into the mmap so a DecodedPage is only valid until the
+// data file is remapped.
+struct DecodedPage {
+  pgid_t id;
+  bool isLeaf;
+  std::vector<INode> inodes;
+  std::vector<std::uint64_t> u64Keys; // keys of a page with U64KeyPageFlag, in host byte order
+
+  // charge returns the number of bytes accounted against the cache budget.
+  std::size_t charge() const {
+    return sizeof(DecodedPage) + this->inodes.capacity() * sizeof(INode) +
+           this->u64Keys.capacity() * sizeof(std::uint64_t);
+  }
+
+  // search returns the index of the first inode whose key is not less than
+  // key under Cmp, and whether it is equal to key. Integer keys are searched
+  // as integers; seeking to a prefix of one still compares slices.
+  template <class Cmp> std::pair<size_t, bool> search(const Slice &key) const {
+    if (std::is_same<Cmp, BytewiseComparator>::value && !this->u64Keys.empty() && key.size() == U64KeySize) {
+      size_t index = u64_lower_bound(this->u64Keys.data(), this->u64Keys.size(), decode_u64_key(key.data()));
+      return std::make_pair(index, index < this->inodes.size() && this->inodes[index].key == key);
+    }
+    return search_inodes<Cmp>(this->inodes, key);
+  }
+
+  // decode parses the elements of a branch or leaf page.
+  static std::shared_ptr<const DecodedPage> decode(Page *p);
+};
+
+// NodeCache is a DB-wide cache of decoded pages keyed by pgid which is shared
+// by all transactions. Since pages are copy-on-write, the contents of a pgid
+// never change until the page is released by the freelist, which is when its
+// entry must be invalidated. The cache is cleared whenever the mmap changes.
+class NodeCache {
+public:
+  // capacity is the total byte budget. It is split evenly over the shards.
+  explicit NodeCache(std::size_t capacity);
+
+  // get returns the decoded representation of a mmapped page, decoding and
+  // inserting it into the cache on a miss.
+  std::shared_ptr<const DecodedPage> get(Page *p);
+
+  // invalidate drops the entry for a given page id, if any.
+  void invalidate(pgid_t id);
+
+  // clear drops every entry.
+  void clear();
+
+  // charge returns the number of bytes currently held by the cache.
+  std::size_t charge();
+
+private:
+  struct Entry {
+    pgid_t id;
+    std::shared_ptr<const DecodedPage> page;
+  };
+
+  // Shard is an independent LRU list guarded by its own mutex so that readers
+  // looking up different pages don't contend on a single lock.
+  struct Shard {
+    std::mutex mutex;
+    std::list<Entry> lru; // most recently used entries first
+    std::unordered_map<pgid_t, std::list<Entry>::iterator> index;
+    std::size_t charge = 0;
+  };
+
+  static const int ShardCount = 16;
+
+  Shard &shard(pgid_t id) { return this->shards_[id % ShardCount]; }
+
+  // evict drops least recently used entries until the shard fits its budget.
+  // The shard mutex must be held.
+  void evict(Shard &s);
+
+  std::size_t shard_capacity_;
+  Shard shards_[ShardCount];
+};
+
+#endif
@@ -38,10 +38,10 @@ std::string Page::type() const {
   return stringStream.str();
 }
 
-Meta *Page::meta() const { return reinterpret_cast<Meta *>(this->ptr_); }
+Meta *Page::meta() const { return reinterpret_cast<Meta *>(this->ptr()); }
 
 LeafPageElement *Page::leafPageElement(std::uint16_t index) const {
-  LeafPageElement *ptr = reinterpret_cast<LeafPageElement *>(this->ptr_);
+  LeafPageElement *ptr = reinterpret_cast<LeafPageElement *>(this->elements());
   return ptr + index;
 }
 
@@ -50,7 +50,7 @@ std::vector<LeafPageElement> Page::leafPageElements() const {
   if (this->count_ == 0) {
     return result;
   }
-  LeafPageElement *ptr = reinterpret_cast<LeafPageElement *>(this->ptr_);
+  LeafPageElement *ptr = reinterpret_cast<LeafPageElement *>(this->elements());
   for (unsigned int i = 0; i < this->count_; i++) {
     result.push_back(*(ptr + i));
   }
@@ -58,7 +58,7 @@ std::vector<LeafPageElement> Page::leafPageElements() const {
 }
 
 BranchPageElement *Page::branchPageElement(std::uint16_t index) const {
-  BranchPageElement *ptr = reinterpret_cast<BranchPageElement *>(this->ptr_);
+  BranchPageElement *ptr = reinterpret_cast<BranchPageElement *>(this->elements());
   return ptr + index;
 }
 
@@ -67,7 +67,7 @@ std::vector<BranchPageElement> Page::branchPageElements() const {
   if (this->count_ == 0) {
     return result;
   }
-  BranchPageElement *ptr = reinterpret_cast<BranchPageElement *>(this->ptr_);
+  BranchPageElement *ptr = reinterpret_cast<BranchPageElement *>(this->elements());
   for (unsigned int i = 0; i < this->count_; i++) {
     result.push_back(*(ptr + i));
   }
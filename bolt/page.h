@@ -17,6 +17,13 @@ enum PageFlag {
   LeafPageFlag = 0x02,
   MetaPageFlag = 0x04,
   FreelistPageFlag = 0x10,
+  // U64KeyPageFlag marks a branch or leaf page of a bucket created with
+  // BucketU64KeysFlag. Its keys are packed into an array of count big-endian
+  // integers in front of the elements, which have ksize 0.
+  U64KeyPageFlag = 0x20,
+  // FreelistOrphansPageFlag marks a freelist page whose ids are followed by
+  // the orphan queue of the freelist, see FreeList::orphans.
+  FreelistOrphansPageFlag = 0x40,
 };
 
 const int BucketLeafFlag = 0x01;
@@ -32,7 +39,12 @@ template <typename T, typename U> size_t offsetOf(U T::*member) {
 class Page {
 public:
   static size_t pagehsz() { return offsetOf(&Page::ptr_); }
-  Page(pgid_t id, std::uint16_t flag, std::uintptr_t ptr) : id_(id), flags_(flag), count_(0), overflow_(0), ptr_(ptr) {}
+
+  // Page is a header placed at the start of a page buffer or of a page in
+  // the mmap. The data follows it, so pages must not be copied.
+  Page(pgid_t id, std::uint16_t flag) : id_(id), flags_(flag), count_(0), overflow_(0) {}
+  Page(const Page &) = delete;
+  Page &operator=(const Page &) = delete;
   // type returns a human readable page type string used for debugging.
   std::string type() const;
   // meta returns a pointer to the metadata section of the page.
@@ -48,6 +60,11 @@ public:
   // branchPageElements retrieves a list of branch nodes.
   std::vector<BranchPageElement> branchPageElements() const;
 
+  // u64Key returns the key at index of a page with U64KeyPageFlag.
+  Slice u64Key(std::uint16_t index) const {
+    return Slice(reinterpret_cast<const char *>(this->ptr()) + index * sizeof(std::uint64_t), sizeof(std::uint64_t));
+  }
+
   // dump writes n bytes of the page to STDERR as hex output.
   void hexdump(int n) const;
 
@@ -58,18 +75,27 @@ public:
   std::uint32_t count() { return count_; }
 
   void setOverflow() { this->overflow_ |= 0xffff; }
+  void setOverflow(std::uint32_t overflow) { this->overflow_ = overflow; }
   void unsetOverflow() { this->overflow_ &= 0x0000; }
+  std::uint32_t overflow() { return overflow_; }
 
   pgid_t id() { return id_; }
   void setID(pgid_t id) { this->id_ = id; }
-  std::uintptr_t ptr() { return ptr_; }
+  // ptr returns the address of the page data, right after the header.
+  std::uintptr_t ptr() const { return reinterpret_cast<std::uintptr_t>(&this->ptr_); }
+
+  // elements returns the address of the element array, which follows the key
+  // array on pages with U64KeyPageFlag.
+  std::uintptr_t elements() const {
+    return (this->flags_ & U64KeyPageFlag) ? this->ptr() + this->count_ * sizeof(std::uint64_t) : this->ptr();
+  }
 
 private:
   pgid_t id_;
   std::uint16_t flags_;
   std::uint32_t count_;
   std::uint32_t overflow_;
-  std::uintptr_t ptr_;
+  std::uintptr_t ptr_; // first bytes of the data, only its address is used
 };
 
 // LeafPageElement represents a node on a leaf page.
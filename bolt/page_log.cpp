@@ -0,0 +1,191 @@
+#include "page_log.h"
+#include "bolt_unix.h"
+#include "exception.h"
+#include "molly/hash/hash.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace hash = molly::hash;
+
+// Marks the header of a page log.
+const std::uint64_t PageLogMagic = 0x50474C4F47000001;
+
+PageLog::PageLog(std::string path, txid_t txid) : path_(path), start_(0) {
+  this->fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (this->fd_ < 0) {
+    throw std::system_error(errno, std::system_category(), "fail to open page log: " + path_);
+  }
+
+  try {
+    // A new log, or one which misses the commits made while the database was
+    // opened without it, only covers the commits from now on.
+    std::uint64_t head[2];
+    std::vector<Record> records;
+    if (::pread(this->fd_, head, sizeof(head), 0) != sizeof(head) || head[0] != PageLogMagic) {
+      this->rewrite(txid, {});
+      return;
+    }
+    this->start_ = head[1];
+    std::int64_t sz = this->scan(&records);
+    txid_t last = records.empty() ? this->start_ : records.back().txid;
+    if (last < txid) {
+      this->rewrite(txid, {});
+      return;
+    }
+
+    // Drop a record that was torn by a crash in the middle of an append.
+    if (::ftruncate(this->fd_, sz) != 0) {
+      throw std::system_error(errno, std::system_category(), "fail to truncate page log: " + path_);
+    }
+  } catch (...) {
+    ::close(this->fd_);
+    throw;
+  }
+}
+
+PageLog::~PageLog() { ::close(this->fd_); }
+
+std::string PageLog::encode(const Record &r) {
+  std::uint64_t count = r.runs.size();
+  std::string buf;
+  buf.reserve(3 * sizeof(std::uint64_t) + count * 2 * sizeof(std::uint64_t));
+  buf.append(reinterpret_cast<const char *>(&r.txid), sizeof(r.txid));
+  buf.append(reinterpret_cast<const char *>(&count), sizeof(count));
+  for (auto &run : r.runs) {
+    buf.append(reinterpret_cast<const char *>(&run.first), sizeof(run.first));
+    buf.append(reinterpret_cast<const char *>(&run.second), sizeof(run.second));
+  }
+  std::uint64_t checksum = hash::fnva64_buf(buf.data(), buf.size());
+  buf.append(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+  return buf;
+}
+
+void PageLog::append(txid_t txid, const std::map<pgid_t, std::uint64_t> &runs) {
+  Record r;
+  r.txid = txid;
+  r.runs.assign(runs.begin(), runs.end());
+  std::string buf = encode(r);
+
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  write_full(this->fd_, buf.data(), buf.size());
+}
+
+void PageLog::sync() {
+  if (::fdatasync(this->fd_) != 0) {
+    throw std::system_error(errno, std::system_category(), "fdatasync failed");
+  }
+}
+
+std::int64_t PageLog::scan(std::vector<Record> *records) {
+  struct stat st;
+  if (::fstat(this->fd_, &st) != 0) {
+    throw std::system_error(errno, std::system_category(), "fail to stat page log: " + path_);
+  }
+
+  std::int64_t off = 2 * sizeof(std::uint64_t);
+  for (;;) {
+    std::uint64_t head[2];
+    if (::pread(this->fd_, head, sizeof(head), off) != sizeof(head)) {
+      return off;
+    }
+
+    // Don't trust the count of a torn record before checking it fits.
+    std::uint64_t remain = st.st_size - off - sizeof(head);
+    if (head[1] > remain / (2 * sizeof(std::uint64_t))) {
+      return off;
+    }
+
+    Record r;
+    r.txid = head[0];
+    std::string body(head[1] * 2 * sizeof(std::uint64_t) + sizeof(std::uint64_t), '\0');
+    if (::pread(this->fd_, &body[0], body.size(), off + sizeof(head)) != static_cast<ssize_t>(body.size())) {
+      return off;
+    }
+    const std::uint64_t *words = reinterpret_cast<const std::uint64_t *>(body.data());
+    for (std::uint64_t i = 0; i < head[1]; i++) {
+      r.runs.emplace_back(words[2 * i], words[2 * i + 1]);
+    }
+
+    // A checksum mismatch means the tail of the log was never completed.
+    std::string buf = encode(r);
+    if (std::memcmp(buf.data() + buf.size() - sizeof(std::uint64_t), &words[2 * head[1]], sizeof(std::uint64_t)) != 0) {
+      return off;
+    }
+    off += buf.size();
+    if (records) {
+      records->push_back(std::move(r));
+    }
+  }
+}
+
+std::map<pgid_t, std::uint64_t> PageLog::pages_since(txid_t since, txid_t until) {
+  std::vector<Record> records;
+  txid_t start;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->scan(&records);
+    start = this->start_;
+  }
+
+  // The pages of the commits up to start are unknown, see trim().
+  if (since < start) {
+    throw DeltaMismatchException();
+  }
+
+  std::map<pgid_t, std::uint64_t> runs;
+  for (auto &r : records) {
+    if (r.txid <= since || r.txid > until) {
+      continue;
+    }
+    for (auto &run : r.runs) {
+      std::uint64_t &n = runs[run.first];
+      n = std::max(n, run.second);
+    }
+  }
+  return runs;
+}
+
+void PageLog::trim(txid_t txid) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  std::vector<Record> records;
+  this->scan(&records);
+  records.erase(std::remove_if(records.begin(), records.end(), [txid](const Record &r) { return r.txid <= txid; }),
+                records.end());
+  this->rewrite(std::max(this->start_, txid), records);
+}
+
+void PageLog::rewrite(txid_t start, const std::vector<Record> &records) {
+  std::uint64_t head[2] = {PageLogMagic, start};
+  std::string buf(reinterpret_cast<const char *>(head), sizeof(head));
+  for (auto &r : records) {
+    buf.append(encode(r));
+  }
+
+  // Write the records to a new file and atomically replace the log.
+  std::string tmp = this->path_ + ".tmp";
+  int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::system_category(), "fail to open page log: " + tmp);
+  }
+  try {
+    write_full(fd, buf.data(), buf.size());
+    if (::fdatasync(fd) != 0) {
+      throw std::system_error(errno, std::system_category(), "fdatasync failed");
+    }
+    if (std::rename(tmp.c_str(), this->path_.c_str()) != 0) {
+      throw std::system_error(errno, std::system_category(), "fail to rename page log: " + tmp);
+    }
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(this->fd_);
+  this->fd_ = fd;
+  this->start_ = start;
+}
@@ -0,0 +1,67 @@
+#ifndef __BOLT_PAGE_LOG_H
+#define __BOLT_PAGE_LOG_H
+
+#include "types.h"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// PageLog is an append-only sidecar file which records the pages written by
+// every commit. It is what makes incremental backups cheap: the pages changed
+// since a txid are found by scanning the log instead of the data file.
+//
+// The log starts with a header holding the txid it covers the commits after:
+//   magic | start
+// followed by a record per commit, laid out as:
+//   txid | count | count * (pgid, number of pages) | checksum
+// A torn record at the end of the log is discarded when the log is opened.
+class PageLog {
+public:
+  // open opens (creating it if needed) the page log at the given path for a
+  // database at txid. A log which doesn't record every commit up to txid,
+  // because the database was written without it, restarts at txid.
+  PageLog(std::string path, txid_t txid);
+  ~PageLog();
+
+  // append records the page runs written by a transaction. runs maps the
+  // first pgid of every written page to its number of pages.
+  void append(txid_t txid, const std::map<pgid_t, std::uint64_t> &runs);
+
+  // sync flushes appended records to disk.
+  void sync();
+
+  // pages_since returns the page runs written by transactions in (since, until].
+  // Throws DeltaMismatchException if the log doesn't reach back to since.
+  std::map<pgid_t, std::uint64_t> pages_since(txid_t since, txid_t until);
+
+  // trim drops every record of a transaction up to and including txid. Call
+  // this once a full backup at txid has been taken; the log no longer covers
+  // earlier txids.
+  void trim(txid_t txid);
+
+private:
+  struct Record {
+    txid_t txid;
+    std::vector<std::pair<pgid_t, std::uint64_t>> runs;
+  };
+
+  // scan reads every valid record and returns the length of the valid prefix,
+  // including the header.
+  std::int64_t scan(std::vector<Record> *records);
+
+  // rewrite atomically replaces the log with one starting at start and
+  // holding the given records.
+  void rewrite(txid_t start, const std::vector<Record> &records);
+
+  // encode serializes a record including its checksum.
+  static std::string encode(const Record &r);
+
+  std::string path_;
+  int fd_;
+  txid_t start_;     // every commit after start_ is recorded
+  std::mutex mutex_; // serializes appends with scans
+};
+
+#endif
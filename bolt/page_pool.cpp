@@ -1,11 +1,23 @@
 #include "page_pool.h"
+#include "bolt_unix.h"
+#include <algorithm>
+#include <new>
+#include <sys/mman.h>
+
+PagePool::~PagePool() {
+  if (this->free_page_) {
+    for (auto &s : this->pages_) {
+      this->free_page_(s);
+    }
+  }
+}
 
 Slice PagePool::get() {
   std::lock_guard<std::mutex> lock(_pool_mutex);
   if (this->pages_.empty()) {
     return new_page_();
   }
-  Slice &s = this->pages_.back();
+  Slice s = this->pages_.back();
   this->pages_.pop_back();
   return s;
 }
@@ -13,4 +25,47 @@ Slice PagePool::get() {
 void PagePool::put(const Slice &s) {
   std::lock_guard<std::mutex> lock(_pool_mutex);
   this->pages_.push_back(s);
-}
\ No newline at end of file
+}
+
+PageArena::PageArena(int page_size, bool hugetlb)
+    : page_size_(page_size), hugetlb_(hugetlb), next_(nullptr), end_(nullptr) {
+  // A chunk is a whole number of huge pages holding at least one page.
+  this->chunk_size_ = std::max<std::size_t>(HugePageSize, (page_size + HugePageSize - 1) / HugePageSize * HugePageSize);
+}
+
+PageArena::~PageArena() {
+  for (auto chunk : this->chunks_) {
+    ::munmap(chunk, this->chunk_size_);
+  }
+}
+
+Slice PageArena::alloc() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (this->end_ - this->next_ < this->page_size_) {
+    this->grow();
+  }
+  char *p = this->next_;
+  this->next_ += this->page_size_;
+  return Slice(p, this->page_size_);
+}
+
+void PageArena::grow() {
+  void *b = MAP_FAILED;
+  if (this->hugetlb_) {
+    b = ::mmap(nullptr, this->chunk_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+
+  // Without reserved huge pages, fall back to transparent huge pages. The
+  // chunk must be aligned or the kernel can only use them for part of it.
+  if (b == MAP_FAILED) {
+    b = mmap_aligned(this->chunk_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, HugePageSize);
+    if (b == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    ::madvise(b, this->chunk_size_, MADV_HUGEPAGE);
+  }
+
+  this->chunks_.push_back(static_cast<char *>(b));
+  this->next_ = static_cast<char *>(b);
+  this->end_ = this->next_ + this->chunk_size_;
+}
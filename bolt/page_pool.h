@@ -2,13 +2,19 @@
 #define __BOLT_PAGE_POOL_H
 
 #include "slice.h"
+#include <cstddef>
 #include <functional>
 #include <mutex>
 #include <vector>
 
+// PagePool recycles the single-page buffers of writable transactions.
 class PagePool {
 public:
-  PagePool(std::function<Slice()> new_page) : new_page_(new_page) {}
+  // new_page makes a buffer when the pool is empty. free_page, if set, is
+  // called on every pooled buffer when the pool is destroyed.
+  PagePool(std::function<Slice()> new_page, std::function<void(const Slice &)> free_page = nullptr)
+      : new_page_(new_page), free_page_(free_page) {}
+  ~PagePool();
 
   // once you get Slice from page pool, you should charge the slice's life.
   Slice get();
@@ -18,6 +24,38 @@ private:
   std::mutex _pool_mutex; // protects page pool
   std::vector<Slice> pages_;
   std::function<Slice()> new_page_;
+  std::function<void(const Slice &)> free_page_;
+};
+
+// HugePageSize is the size of the huge pages PageArena maps.
+const std::size_t HugePageSize = 2 * 1024 * 1024;
+
+// PageArena hands out page buffers carved out of huge-page-backed chunks, so
+// that a pool of pages costs a few TLB entries instead of one per page.
+// Buffers can't be returned to the arena: they are recycled through a
+// PagePool and released together when the arena is destroyed.
+class PageArena {
+public:
+  // hugetlb requests reserved hugetlbfs pages, otherwise chunks are advised
+  // for transparent huge pages.
+  PageArena(int page_size, bool hugetlb);
+  ~PageArena();
+
+  // alloc returns a new page buffer. Throws std::bad_alloc if no memory can
+  // be mapped.
+  Slice alloc();
+
+private:
+  // grow maps a new chunk.
+  void grow();
+
+  std::mutex mutex_; // protects the fields below
+  int page_size_;
+  bool hugetlb_;
+  std::size_t chunk_size_;
+  std::vector<char *> chunks_;
+  char *next_;
+  char *end_;
 };
 
 #endif
\ No newline at end of file
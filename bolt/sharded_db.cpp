@@ -0,0 +1,324 @@
+#include "sharded_db.h"
+#include "bolt_unix.h"
+#include "bucket.h"
+#include "cursor.h"
+#include "exception.h"
+#include "meta.h"
+#include "molly/hash/hash.h"
+#include "page.h"
+#include "tx.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <system_error>
+#include <unistd.h>
+
+namespace hash = molly::hash;
+
+ShardedCursor::~ShardedCursor() {
+  for (Cursor *c : this->cursors_) {
+    delete c;
+  }
+}
+
+std::pair<std::optional<Slice>, std::optional<Slice>> ShardedCursor::pick() {
+  // Shards are few, a linear scan is cheaper than keeping a heap.
+  this->current_ = -1;
+  for (size_t i = 0; i < this->heads_.size(); i++) {
+    if (this->heads_[i].first &&
+        (this->current_ < 0 || this->heads_[i].first->compare(*this->heads_[this->current_].first) < 0)) {
+      this->current_ = static_cast<int>(i);
+    }
+  }
+  if (this->current_ < 0) {
+    return {};
+  }
+  return this->heads_[this->current_];
+}
+
+std::pair<std::optional<Slice>, std::optional<Slice>> ShardedCursor::first() {
+  for (size_t i = 0; i < this->cursors_.size(); i++) {
+    this->heads_[i] = this->cursors_[i]->first();
+  }
+  return this->pick();
+}
+
+std::pair<std::optional<Slice>, std::optional<Slice>> ShardedCursor::next() {
+  if (this->current_ < 0) {
+    return {};
+  }
+  this->heads_[this->current_] = this->cursors_[this->current_]->next();
+  return this->pick();
+}
+
+std::pair<std::optional<Slice>, std::optional<Slice>> ShardedCursor::seek(const Slice &seek) {
+  for (size_t i = 0; i < this->cursors_.size(); i++) {
+    this->heads_[i] = this->cursors_[i]->seek(seek);
+  }
+  return this->pick();
+}
+
+Tx *ShardedTx::tx_for(const Slice &key) { return this->txs_[this->db_->shard_of(key)]; }
+
+ShardedCursor *ShardedTx::cursor(const Slice &name) {
+  std::vector<Cursor *> cursors;
+  for (Tx *tx : this->txs_) {
+    if (Bucket *b = tx->bucket(name)) {
+      cursors.push_back(b->cursor());
+    }
+  }
+  return new ShardedCursor(cursors);
+}
+
+ShardedDB::ShardedDB(std::string path, FileMode mode, ShardedOption *option)
+    : path_(path), bounds_(option->Bounds), two_phase_(option->TwoPhaseCommit), decision_fd_(-1) {
+  if (option->Shards <= 0 ||
+      (!this->bounds_.empty() && this->bounds_.size() != static_cast<size_t>(option->Shards - 1)) ||
+      !std::is_sorted(this->bounds_.begin(), this->bounds_.end())) {
+    throw InvalidShardCountException();
+  }
+  Option *db_option = option->DBOption ? option->DBOption : &DefaultOption;
+  if (this->two_phase_ && db_option->Wal) {
+    throw TwoPhaseCommitWalException();
+  }
+
+  try {
+    // Finish an interrupted two-phase commit before any shard reads its meta.
+    if (this->two_phase_ && !db_option->ReadOnly && !db_option->InMemory) {
+      std::string decision_path = path_ + ".2pc";
+      this->decision_fd_ = ::open(decision_path.c_str(), O_RDWR | O_CREAT, mode);
+      if (this->decision_fd_ < 0) {
+        throw std::system_error(errno, std::system_category(), "fail to open decision file: " + decision_path);
+      }
+      this->recover();
+    }
+
+    for (int i = 0; i < option->Shards; i++) {
+      this->shards_.push_back(new DB(this->shard_path(i), mode, db_option));
+    }
+  } catch (...) {
+    for (DB *db : this->shards_) {
+      delete db;
+    }
+    if (this->decision_fd_ >= 0) {
+      ::close(this->decision_fd_);
+    }
+    throw;
+  }
+}
+
+ShardedDB::~ShardedDB() {
+  for (DB *db : this->shards_) {
+    delete db;
+  }
+  if (this->decision_fd_ >= 0) {
+    ::close(this->decision_fd_);
+  }
+}
+
+int ShardedDB::shard_of(const Slice &key) const {
+  if (this->bounds_.empty()) {
+    return static_cast<int>(hash::fnva64_buf(key.data(), key.size()) % this->shards_.size());
+  }
+  // Shard i holds the keys below bounds_[i].
+  auto it = std::upper_bound(
+      this->bounds_.begin(), this->bounds_.end(), key,
+      [](const Slice &key, const std::string &bound) { return key < Slice(bound.data(), bound.size()); });
+  return static_cast<int>(it - this->bounds_.begin());
+}
+
+void ShardedDB::update(const Slice &key, std::function<void(Tx *)> fn) {
+  Tx *tx = this->shards_[this->shard_of(key)]->begin(true);
+  try {
+    fn(tx);
+  } catch (...) {
+    tx->rollback();
+    delete tx;
+    throw;
+  }
+  try {
+    tx->commit();
+  } catch (...) {
+    // A failed commit leaves the transaction open and the writer lock held.
+    if (tx->db()) {
+      tx->rollback();
+    }
+    delete tx;
+    throw;
+  }
+  delete tx;
+}
+
+void ShardedDB::view(const Slice &key, std::function<void(Tx *)> fn) {
+  Tx *tx = this->shards_[this->shard_of(key)]->begin(false);
+  try {
+    fn(tx);
+  } catch (...) {
+    tx->rollback();
+    delete tx;
+    throw;
+  }
+  tx->rollback();
+  delete tx;
+}
+
+void ShardedDB::update_all(std::function<void(ShardedTx *)> fn) {
+  // Taking the writer locks in shard order keeps concurrent calls from
+  // deadlocking.
+  std::vector<Tx *> txs;
+  auto rollback = [&txs] {
+    for (Tx *tx : txs) {
+      if (tx->db()) {
+        tx->rollback();
+      }
+      delete tx;
+    }
+  };
+  try {
+    for (DB *db : this->shards_) {
+      txs.push_back(db->begin(true));
+    }
+    ShardedTx stx(this, txs);
+    fn(&stx);
+
+    if (this->decision_fd_ >= 0) {
+      this->commit_two_phase(txs);
+    } else {
+      for (Tx *tx : txs) {
+        tx->commit();
+      }
+    }
+  } catch (...) {
+    rollback();
+    throw;
+  }
+  for (Tx *tx : txs) {
+    delete tx;
+  }
+}
+
+void ShardedDB::view_all(std::function<void(ShardedTx *)> fn) {
+  std::vector<Tx *> txs;
+  auto rollback = [&txs] {
+    for (Tx *tx : txs) {
+      tx->rollback();
+      delete tx;
+    }
+  };
+  try {
+    for (DB *db : this->shards_) {
+      txs.push_back(db->begin(false));
+    }
+    ShardedTx stx(this, txs);
+    fn(&stx);
+  } catch (...) {
+    rollback();
+    throw;
+  }
+  rollback();
+}
+
+void ShardedDB::commit_two_phase(std::vector<Tx *> &txs) {
+  // Phase one: every shard writes its pages, which are invisible until its
+  // meta points to them, so a failure here leaves all shards unchanged.
+  for (Tx *tx : txs) {
+    tx->prepare();
+  }
+
+  // The decision is made once every shard's meta is durable in the
+  // coordinator file:
+  //   count | count * (shard, meta) | checksum
+  std::uint64_t count = txs.size();
+  std::string buf(reinterpret_cast<const char *>(&count), sizeof(count));
+  for (size_t i = 0; i < txs.size(); i++) {
+    std::uint64_t shard = i;
+    buf.append(reinterpret_cast<const char *>(&shard), sizeof(shard));
+    buf.append(reinterpret_cast<const char *>(txs[i]->meta_), sizeof(Meta));
+  }
+  std::uint64_t checksum = hash::fnva64_buf(buf.data(), buf.size());
+  buf.append(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+  pwrite_full(this->decision_fd_, buf.data(), buf.size(), 0);
+  if (::fdatasync(this->decision_fd_) != 0) {
+    throw std::system_error(errno, std::system_category(), "fdatasync failed");
+  }
+
+  // Phase two: publish the metas. A crash from here on is finished by
+  // recover() when the database is opened again.
+  for (Tx *tx : txs) {
+    tx->write_meta();
+    tx->close();
+  }
+}
+
+void ShardedDB::recover() {
+  std::uint64_t count;
+  if (::pread(this->decision_fd_, &count, sizeof(count), 0) != sizeof(count)) {
+    return;
+  }
+
+  // A torn record means the decision was never made, so the shards keep
+  // their metas.
+  if (count > 1024 * 1024) {
+    return;
+  }
+  std::string buf(reinterpret_cast<const char *>(&count), sizeof(count));
+  size_t n = count * (sizeof(std::uint64_t) + sizeof(Meta));
+  buf.resize(sizeof(count) + n);
+  std::uint64_t checksum;
+  if (::pread(this->decision_fd_, &buf[sizeof(count)], n, sizeof(count)) != static_cast<ssize_t>(n) ||
+      ::pread(this->decision_fd_, &checksum, sizeof(checksum), sizeof(count) + n) != sizeof(checksum) ||
+      checksum != hash::fnva64_buf(buf.data(), buf.size())) {
+    return;
+  }
+
+  for (std::uint64_t i = 0; i < count; i++) {
+    std::uint64_t shard;
+    Meta m;
+    const char *entry = &buf[sizeof(count) + i * (sizeof(shard) + sizeof(Meta))];
+    std::memcpy(&shard, entry, sizeof(shard));
+    std::memcpy(&m, entry + sizeof(shard), sizeof(Meta));
+
+    std::string path = this->shard_path(static_cast<int>(shard));
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+      throw std::system_error(errno, std::system_category(), "fail to open shard: " + path);
+    }
+
+    // Find the newest meta the shard has.
+    txid_t txid = 0;
+    for (int id = 0; id < 2; id++) {
+      Meta cur;
+      if (::pread(fd, &cur, sizeof(cur), static_cast<std::int64_t>(id) * m.page_size + pageHeaderSize) !=
+          sizeof(cur)) {
+        continue;
+      }
+      try {
+        cur.validate();
+        txid = std::max(txid, cur.txid);
+      } catch (std::exception &e) {
+      }
+    }
+
+    // Its pages were synced in phase one, only the meta may be missing.
+    if (txid < m.txid) {
+      std::string page(m.page_size, '\0');
+      pgid_t id = m.txid % 2;
+      Page *p = new (&page[0]) Page(id, MetaPageFlag);
+      Meta *pm = p->meta();
+      *pm = m;
+      pm->checksum = pm->sum64();
+      try {
+        pwrite_full(fd, page.data(), page.size(), static_cast<std::int64_t>(id) * m.page_size);
+        if (::fdatasync(fd) != 0) {
+          throw std::system_error(errno, std::system_category(), "fdatasync failed");
+        }
+      } catch (...) {
+        ::close(fd);
+        throw;
+      }
+    }
+    ::close(fd);
+  }
+}
@@ -0,0 +1,151 @@
+#ifndef __BOLT_SHARDED_DB_H
+#define __BOLT_SHARDED_DB_H
+
+#include "db.h"
+#include "slice.h"
+#include <functional>
+#include <gsl/gsl>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Cursor;
+class ShardedDB;
+
+// ShardedOption represents the options that can be set when opening a sharded
+// database.
+struct ShardedOption {
+  // Shards is the number of shard files. It can't change once the database
+  // has been created, since keys would move between shards.
+  int Shards;
+
+  // Bounds partitions the keys by range: shard i holds the keys in
+  // [Bounds[i-1], Bounds[i]). It must hold Shards - 1 sorted keys.
+  //
+  // If empty, keys are partitioned by hash, which spreads sequential keys
+  // across all writers.
+  std::vector<std::string> Bounds;
+
+  // TwoPhaseCommit makes the writes of update_all() atomic across shards. The
+  // shards first write their pages, then a decision record listing every
+  // shard's new meta is synced to a coordinator file, and only then are the
+  // metas written. Opening the database finishes the writes of a decision
+  // that was interrupted by a crash. Can't be combined with Option::Wal.
+  bool TwoPhaseCommit;
+
+  // DBOption is used to open every shard. If nullptr, DefaultOption is used.
+  Option *DBOption;
+};
+
+// ShardedCursor iterates over a bucket of every shard in key order, merging
+// the cursors of the shards.
+class ShardedCursor {
+public:
+  ~ShardedCursor();
+
+  // first moves the cursor to the first key of all shards.
+  std::pair<std::optional<Slice>, std::optional<Slice>> first();
+
+  // next moves the cursor to the next key across all shards.
+  std::pair<std::optional<Slice>, std::optional<Slice>> next();
+
+  // seek moves the cursor to the first key of all shards that is not before
+  // the given key.
+  std::pair<std::optional<Slice>, std::optional<Slice>> seek(const Slice &seek);
+
+private:
+  ShardedCursor(std::vector<Cursor *> cursors) : cursors_(cursors), heads_(cursors.size()), current_(-1) {}
+
+  // pick makes the shard with the smallest head the current one.
+  std::pair<std::optional<Slice>, std::optional<Slice>> pick();
+
+  std::vector<gsl::owner<Cursor *>> cursors_;
+  std::vector<std::pair<std::optional<Slice>, std::optional<Slice>>> heads_; // current item of each cursor
+  int current_;
+
+  friend class ShardedTx;
+};
+
+// ShardedTx is a transaction over all shards of a sharded database.
+class ShardedTx {
+public:
+  // size returns the number of shards.
+  int size() const { return static_cast<int>(txs_.size()); }
+
+  // tx returns the transaction of shard i.
+  Tx *tx(int i) { return txs_[i]; }
+
+  // tx_for returns the transaction of the shard that holds key.
+  Tx *tx_for(const Slice &key);
+
+  // cursor creates a cursor over the bucket of the given name in every shard.
+  // Shards without the bucket are skipped. The cursor is only valid as long
+  // as the transaction is open.
+  ShardedCursor *cursor(const Slice &name);
+
+private:
+  ShardedTx(ShardedDB *db, std::vector<Tx *> txs) : db_(db), txs_(txs) {}
+
+  ShardedDB *db_;
+  std::vector<Tx *> txs_;
+
+  friend class ShardedDB;
+};
+
+// ShardedDB partitions keys across independent database files so that writers
+// of different shards commit in parallel, each shard having its own writer
+// lock. Shard i is stored at "<path>.<i>".
+class ShardedDB {
+public:
+  // open a sharded database at the given path, creating the shards that
+  // don't exist.
+  ShardedDB(std::string path, FileMode mode, ShardedOption *option);
+  ~ShardedDB();
+
+  // size returns the number of shards.
+  int size() const { return static_cast<int>(shards_.size()); }
+
+  // shard returns the database of shard i.
+  DB *shard(int i) { return shards_[i]; }
+
+  // shard_of returns the shard that holds key.
+  int shard_of(const Slice &key) const;
+
+  // update executes a function within a read-write transaction on the shard
+  // that holds key, and commits it unless the function throws.
+  void update(const Slice &key, std::function<void(Tx *)> fn);
+
+  // view executes a function within a read-only transaction on the shard
+  // that holds key.
+  void view(const Slice &key, std::function<void(Tx *)> fn);
+
+  // update_all executes a function within a read-write transaction on every
+  // shard and commits them, atomically if ShardedOption::TwoPhaseCommit is
+  // set. The writer locks are taken in shard order, so it waits for the
+  // writers of every shard and blocks them meanwhile.
+  void update_all(std::function<void(ShardedTx *)> fn);
+
+  // view_all executes a function within a read-only transaction on every
+  // shard. The shards' snapshots are taken one after the other, so they are
+  // not consistent with each other unless writers use update_all().
+  void view_all(std::function<void(ShardedTx *)> fn);
+
+private:
+  std::string shard_path(int i) const { return path_ + "." + std::to_string(i); }
+
+  // commit_two_phase commits the transactions of update_all() atomically.
+  void commit_two_phase(std::vector<Tx *> &txs);
+
+  // recover finishes the writes of the last decision record. It runs before
+  // the shards are opened.
+  void recover();
+
+  std::string path_;
+  std::vector<std::string> bounds_;
+  std::vector<gsl::owner<DB *>> shards_;
+  bool two_phase_;
+  int decision_fd_; // coordinator file of the two-phase commit, or -1
+};
+
+#endif
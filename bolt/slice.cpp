@@ -1,4 +1,73 @@
 #include "slice.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// DifferenceKernel is an implementation of difference_bytes().
+typedef size_t (*DifferenceKernel)(const char *, const char *, size_t);
+
+// difference_words finds the first differing byte 8 bytes at a time: the
+// highest set bit of the xor of two big-endian words is in that byte.
+static size_t difference_words(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  for (; i + sizeof(std::uint64_t) <= n; i += sizeof(std::uint64_t)) {
+    std::uint64_t x = load_be64(a + i) ^ load_be64(b + i);
+    if (x != 0) {
+      return i + __builtin_clzll(x) / 8;
+    }
+  }
+  while (i < n && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2"))) static size_t difference_sse2(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) ^ 0xFFFF;
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + difference_words(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t difference_avx2(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + difference_words(a + i, b + i, n - i);
+}
+#endif
+
+// select_difference picks the difference_bytes kernel for the running CPU.
+static DifferenceKernel select_difference() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return difference_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return difference_sse2;
+  }
+#endif
+  return difference_words;
+}
+
+size_t difference_bytes(const char *a, const char *b, size_t n) {
+  static const DifferenceKernel kernel = select_difference();
+  return kernel(a, b, n);
+}
 
 Slice::Slice(const struct SliceParts &parts, std::string *buf) {
   size_t length = 0;
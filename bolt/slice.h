@@ -3,10 +3,53 @@
 
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <string>
 #include <tuple>
 
+// ShortCompareSize is the length up to which keys are compared a word at a
+// time inline. Longer keys are left to memcmp, which is vectorized.
+const size_t ShortCompareSize = 64;
+
+// load_be64 reads 8 bytes as a big-endian integer, so that comparing two
+// loads agrees with memcmp on the same bytes.
+inline std::uint64_t load_be64(const char *p) {
+  std::uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+// compare_bytes compares the first n bytes of a and b like memcmp, but
+// without a call for short keys.
+inline int compare_bytes(const char *a, const char *b, size_t n) {
+  if (n > ShortCompareSize) {
+    return std::memcmp(a, b, n);
+  }
+  size_t i = 0;
+  for (; i + sizeof(std::uint64_t) <= n; i += sizeof(std::uint64_t)) {
+    std::uint64_t x = load_be64(a + i), y = load_be64(b + i);
+    if (x != y) {
+      return x < y ? -1 : 1;
+    }
+  }
+  for (; i < n; i++) {
+    unsigned char x = a[i], y = b[i];
+    if (x != y) {
+      return x < y ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+// difference_bytes returns the index of the first of n bytes at which a and b
+// differ, or n if they are equal. It uses the widest vector compare the CPU
+// supports.
+size_t difference_bytes(const char *a, const char *b, size_t n);
+
 class Slice {
 public:
   // Create an empty slice.
@@ -91,7 +134,7 @@ private:
 
 inline int Slice::compare(const Slice &that) const {
   const size_t min_len = (size_ < that.size_) ? size_ : that.size_;
-  int r = ::memcmp(data_, that.data_, min_len);
+  int r = compare_bytes(data_, that.data_, min_len);
   if (r == 0) {
     if (size_ < that.size_) {
       r = -1;
@@ -103,13 +146,8 @@ inline int Slice::compare(const Slice &that) const {
 }
 
 inline size_t Slice::difference_offset(const Slice &that) const {
-  size_t off = 0;
   const size_t len = (size_ < that.size_) ? size_ : that.size_;
-  for (; off < len; off++) {
-    if (data_[off] != that.data_[off])
-      break;
-  }
-  return off;
+  return difference_bytes(data_, that.data_, len);
 }
 
 // A set of Slices that are virtually concatenated together. 'parts'
@@ -131,7 +169,7 @@ inline bool operator<(const Slice &x, const Slice &y) {
   size_t s1 = x.size();
   size_t s2 = y.size();
   size_t s = (s1 < s2) ? s1 : s2;
-  int result = std::memcmp(x.data(), y.data(), s);
+  int result = compare_bytes(x.data(), y.data(), s);
   return (result < 0) || (result == 0 && s1 < s2);
 }
 
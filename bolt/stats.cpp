@@ -1 +1,106 @@
-#include "stats.h"
\ No newline at end of file
+#include "stats.h"
+#include <initializer_list>
+
+void CommitHistograms::record(const TxStats &s) {
+  this->rebalance.record(s.rebalance_time);
+  this->spill.record(s.spill_time);
+  this->write.record(s.write_time);
+  this->lock.record(s.lock_time);
+}
+
+CommitLatency CommitHistograms::snapshot() const {
+  return {this->rebalance.snapshot(), this->spill.snapshot(), this->write.snapshot(), this->sync.snapshot(),
+          this->lock.snapshot()};
+}
+
+StatCounters::StatCounters() : free_page_n_(0), pending_page_n_(0), free_alloc_(0), freelist_inuse_(0) {
+  for (auto &sh : this->shards_) {
+    for (auto *c : {&sh.tx_n, &sh.open_tx_n, &sh.page_count, &sh.page_alloc, &sh.cursor_count, &sh.node_count,
+                    &sh.node_deref, &sh.rebalance, &sh.rebalance_time, &sh.split, &sh.spill, &sh.spill_time,
+                    &sh.write, &sh.write_time, &sh.sync, &sh.sync_time, &sh.lock_time}) {
+      c->store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+StatCounters::Shard &StatCounters::shard() {
+  // Threads are spread over the shards in the order they first touch them.
+  static std::atomic<unsigned> next(0);
+  thread_local unsigned index = next.fetch_add(1, std::memory_order_relaxed) % ShardCount;
+  return this->shards_[index];
+}
+
+void StatCounters::add(Shard &sh, const TxStats &s) {
+  const auto relaxed = std::memory_order_relaxed;
+  sh.page_count.fetch_add(s.page_count, relaxed);
+  sh.page_alloc.fetch_add(s.page_alloc, relaxed);
+  sh.cursor_count.fetch_add(s.cursor_count, relaxed);
+  sh.node_count.fetch_add(s.node_count, relaxed);
+  sh.node_deref.fetch_add(s.node_deref, relaxed);
+  sh.rebalance.fetch_add(s.rebalance, relaxed);
+  sh.rebalance_time.fetch_add(s.rebalance_time.count(), relaxed);
+  sh.split.fetch_add(s.split, relaxed);
+  sh.spill.fetch_add(s.spill, relaxed);
+  sh.spill_time.fetch_add(s.spill_time.count(), relaxed);
+  sh.write.fetch_add(s.write, relaxed);
+  sh.write_time.fetch_add(s.write_time.count(), relaxed);
+  sh.sync.fetch_add(s.sync, relaxed);
+  sh.sync_time.fetch_add(s.sync_time.count(), relaxed);
+  sh.lock_time.fetch_add(s.lock_time.count(), relaxed);
+}
+
+void StatCounters::begin_tx() {
+  Shard &sh = this->shard();
+  sh.tx_n.fetch_add(1, std::memory_order_relaxed);
+  sh.open_tx_n.fetch_add(1, std::memory_order_relaxed);
+}
+
+void StatCounters::close_tx(const TxStats &s) {
+  Shard &sh = this->shard();
+  sh.open_tx_n.fetch_sub(1, std::memory_order_relaxed);
+  add(sh, s);
+}
+
+void StatCounters::commit(const TxStats &s, int free_page_n, int pending_page_n, int free_alloc,
+                          int freelist_inuse) {
+  this->free_page_n_.store(free_page_n, std::memory_order_relaxed);
+  this->pending_page_n_.store(pending_page_n, std::memory_order_relaxed);
+  this->free_alloc_.store(free_alloc, std::memory_order_relaxed);
+  this->freelist_inuse_.store(freelist_inuse, std::memory_order_relaxed);
+  add(this->shard(), s);
+}
+
+Stats StatCounters::sum() const {
+  const auto relaxed = std::memory_order_relaxed;
+  Stats s = {};
+  s.free_page_n = this->free_page_n_.load(relaxed);
+  s.pending_page_n = this->pending_page_n_.load(relaxed);
+  s.free_alloc = this->free_alloc_.load(relaxed);
+  s.freelist_inuse = this->freelist_inuse_.load(relaxed);
+
+  // A transaction may be opened on one shard and closed on another, so only
+  // the sum of open_tx_n is meaningful.
+  std::int64_t open_tx_n = 0;
+  for (auto &sh : this->shards_) {
+    TxStats &t = s.tx_stats;
+    s.tx_n += sh.tx_n.load(relaxed);
+    open_tx_n += sh.open_tx_n.load(relaxed);
+    t.page_count += sh.page_count.load(relaxed);
+    t.page_alloc += sh.page_alloc.load(relaxed);
+    t.cursor_count += sh.cursor_count.load(relaxed);
+    t.node_count += sh.node_count.load(relaxed);
+    t.node_deref += sh.node_deref.load(relaxed);
+    t.rebalance += sh.rebalance.load(relaxed);
+    t.rebalance_time += std::chrono::microseconds(sh.rebalance_time.load(relaxed));
+    t.split += sh.split.load(relaxed);
+    t.spill += sh.spill.load(relaxed);
+    t.spill_time += std::chrono::microseconds(sh.spill_time.load(relaxed));
+    t.write += sh.write.load(relaxed);
+    t.write_time += std::chrono::microseconds(sh.write_time.load(relaxed));
+    t.sync += sh.sync.load(relaxed);
+    t.sync_time += std::chrono::microseconds(sh.sync_time.load(relaxed));
+    t.lock_time += std::chrono::microseconds(sh.lock_time.load(relaxed));
+  }
+  s.open_tx_n = open_tx_n;
+  return s;
+}
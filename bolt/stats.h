@@ -1,7 +1,10 @@
 #ifndef __BOLT_STATS_H
 #define __BOLT_STATS_H
 
+#include "histogram.h"
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 
 // TxStats reprents statistics about the actions performed by the transaction.
 struct TxStats {
@@ -18,16 +21,23 @@ struct TxStats {
 
   // Rebalance statistics.
   int rebalance;                            // number of node rebalances
-  std::chrono::milliseconds rebalance_time; // total time spent rebalancing
+  std::chrono::microseconds rebalance_time; // total time spent rebalancing
 
   // Split/Spill statistics.
   int split;                            // number of nodes split
   int spill;                            // number of nodes spilled
-  std::chrono::milliseconds spill_time; // total time spent spilling
+  std::chrono::microseconds spill_time; // total time spent spilling
 
   // Write statistics.
   int write;                            // number of writes performed
-  std::chrono::milliseconds write_time; // total time spent writing to disk
+  std::chrono::microseconds write_time; // total time spent writing to disk
+
+  // Sync statistics.
+  int sync;                            // number of fdatasync calls
+  std::chrono::microseconds sync_time; // total time spent in fdatasync
+
+  // Lock statistics.
+  std::chrono::microseconds lock_time; // time spent waiting for the writer lock
 
   TxStats &operator+=(const TxStats &rhs) {
     this->page_count += rhs.page_count;
@@ -42,6 +52,9 @@ struct TxStats {
     this->spill_time += rhs.spill_time;
     this->write += rhs.write;
     this->write_time += rhs.write_time;
+    this->sync += rhs.sync;
+    this->sync_time += rhs.sync_time;
+    this->lock_time += rhs.lock_time;
     return *this;
   }
 
@@ -63,6 +76,9 @@ struct TxStats {
     this->spill_time -= rhs.spill_time;
     this->write -= rhs.write;
     this->write_time -= rhs.write_time;
+    this->sync -= rhs.sync;
+    this->sync_time -= rhs.sync_time;
+    this->lock_time -= rhs.lock_time;
     return *this;
   }
 
@@ -72,6 +88,85 @@ struct TxStats {
   }
 };
 
+// BucketStats records statistics about resources used by a bucket.
+struct BucketStats {
+  // Page count statistics.
+  int branch_page_n;     // number of logical branch pages
+  int branch_overflow_n; // number of physical branch overflow pages
+  int leaf_page_n;       // number of logical leaf pages
+  int leaf_overflow_n;   // number of physical leaf overflow pages
+
+  // Tree statistics.
+  int key_n; // number of keys/value pairs
+  int depth; // number of levels in B+tree
+
+  // Page size utilization.
+  std::int64_t branch_alloc; // bytes allocated for physical branch pages
+  std::int64_t branch_inuse; // bytes actually used for branch data
+  std::int64_t leaf_alloc;   // bytes allocated for physical leaf pages
+  std::int64_t leaf_inuse;   // bytes actually used for leaf data
+
+  // Bucket statistics.
+  int bucket_n;                     // total number of buckets including the top bucket
+  int inline_bucket_n;              // total number of inlined buckets
+  std::int64_t inline_bucket_inuse; // bytes used for inlined buckets (also accounted for in leaf_inuse)
+
+  // fill_ratio returns the fraction of allocated page bytes that hold data.
+  double fill_ratio() const {
+    std::int64_t alloc = branch_alloc + leaf_alloc;
+    return alloc > 0 ? static_cast<double>(branch_inuse + leaf_inuse) / alloc : 0;
+  }
+
+  BucketStats &operator+=(const BucketStats &rhs) {
+    this->branch_page_n += rhs.branch_page_n;
+    this->branch_overflow_n += rhs.branch_overflow_n;
+    this->leaf_page_n += rhs.leaf_page_n;
+    this->leaf_overflow_n += rhs.leaf_overflow_n;
+    this->key_n += rhs.key_n;
+    if (this->depth < rhs.depth) {
+      this->depth = rhs.depth;
+    }
+    this->branch_alloc += rhs.branch_alloc;
+    this->branch_inuse += rhs.branch_inuse;
+    this->leaf_alloc += rhs.leaf_alloc;
+    this->leaf_inuse += rhs.leaf_inuse;
+    this->bucket_n += rhs.bucket_n;
+    this->inline_bucket_n += rhs.inline_bucket_n;
+    this->inline_bucket_inuse += rhs.inline_bucket_inuse;
+    return *this;
+  }
+
+  friend BucketStats operator+(BucketStats lhs, const BucketStats &rhs) {
+    lhs += rhs;
+    return lhs;
+  }
+};
+
+// CommitLatency represents the latency distribution of every commit phase.
+struct CommitLatency {
+  LatencySnapshot rebalance; // rebalancing nodes which had deletions
+  LatencySnapshot spill;     // spilling nodes onto dirty pages
+  LatencySnapshot write;     // writing dirty pages to disk
+  LatencySnapshot sync;      // a single fdatasync call
+  LatencySnapshot lock;      // waiting for the writer lock
+};
+
+// CommitHistograms records the commit phases of all write transactions.
+// Recording is lock-free.
+struct CommitHistograms {
+  LatencyHistogram rebalance;
+  LatencyHistogram spill;
+  LatencyHistogram write;
+  LatencyHistogram sync;
+  LatencyHistogram lock;
+
+  // record adds the phase timings of a committed write transaction.
+  void record(const TxStats &s);
+
+  // snapshot computes the percentiles of every phase.
+  CommitLatency snapshot() const;
+};
+
 // Stats represents statistics about the database.
 struct Stats {
   // Freelist stats
@@ -86,6 +181,8 @@ struct Stats {
 
   struct TxStats tx_stats; // global, ongoing stats.
 
+  CommitLatency latency; // commit phase latencies, filled in by DB::stats()
+
   Stats &operator-=(const Stats &rhs) {
     this->tx_n -= rhs.tx_n;
     this->tx_stats -= rhs.tx_stats;
@@ -108,4 +205,63 @@ struct Stats {
   }
 };
 
-#endif
\ No newline at end of file
+// StatCounters accumulates the database statistics without a lock. Every
+// thread updates its own cache line aligned shard with relaxed atomics and
+// the shards are only summed when the stats are read, so opening and closing
+// transactions doesn't serialize on the stats.
+class StatCounters {
+public:
+  StatCounters();
+
+  // begin_tx counts a started read transaction.
+  void begin_tx();
+
+  // close_tx counts a closed read transaction and merges its stats.
+  void close_tx(const TxStats &s);
+
+  // commit merges the stats of a closed write transaction along with the
+  // freelist stats it observed.
+  void commit(const TxStats &s, int free_page_n, int pending_page_n, int free_alloc, int freelist_inuse);
+
+  // sum adds up all shards.
+  Stats sum() const;
+
+private:
+  struct alignas(64) Shard {
+    std::atomic<std::int64_t> tx_n;
+    std::atomic<std::int64_t> open_tx_n;
+    std::atomic<std::int64_t> page_count;
+    std::atomic<std::int64_t> page_alloc;
+    std::atomic<std::int64_t> cursor_count;
+    std::atomic<std::int64_t> node_count;
+    std::atomic<std::int64_t> node_deref;
+    std::atomic<std::int64_t> rebalance;
+    std::atomic<std::int64_t> rebalance_time;
+    std::atomic<std::int64_t> split;
+    std::atomic<std::int64_t> spill;
+    std::atomic<std::int64_t> spill_time;
+    std::atomic<std::int64_t> write;
+    std::atomic<std::int64_t> write_time;
+    std::atomic<std::int64_t> sync;
+    std::atomic<std::int64_t> sync_time;
+    std::atomic<std::int64_t> lock_time;
+  };
+
+  static const int ShardCount = 32;
+
+  // shard returns the shard of the calling thread.
+  Shard &shard();
+
+  // add merges transaction stats into a shard.
+  static void add(Shard &sh, const TxStats &s);
+
+  Shard shards_[ShardCount];
+
+  // Freelist stats are only written by the single writer.
+  std::atomic<int> free_page_n_;
+  std::atomic<int> pending_page_n_;
+  std::atomic<int> free_alloc_;
+  std::atomic<int> freelist_inuse_;
+};
+
+#endif
@@ -1,23 +1,46 @@
 #include "tx.h"
+#include "backup.h"
+#include "bolt_unix.h"
 #include "bucket.h"
+#include "compact.h"
 #include "db.h"
 #include "meta.h"
+#include "node_cache.h"
 #include "page.h"
+#include "page_log.h"
+#include "wal.h"
 #include "exception.h"
 #include "freelist.h"
-
-Tx::Tx(DB *db, bool writable) : writable_(writable), db_(db) {
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+// Size of each chunk copied by WriteTo(). Large enough to amortize syscalls
+// and to satisfy the alignment O_DIRECT needs.
+const std::size_t CopyChunkSize = 1 << 20;
+const std::size_t CopyAlignment = 4096;
+
+Tx::Tx(DB *db, bool writable)
+    : writeFlag(0), writeRate(0), writable_(writable), managed_(false), db_(db), stats_() {
   // Copy the meta page since it can be changed by the writer.
   this->meta_ = new Meta(*db->meta());
 
   // Copy over the root bucket.
   this->root_ = new Bucket(this);
-  this->root_->set_bucket(*this->meta_->root);
+  this->root_->set_bucket(this->meta_->root);
 
   // Increment the transaction id and add a page cache for writable
   // transactions.
   if (this->writable_) {
     this->meta_->incrementTxID();
+    this->meta_->flags &= ~MetaCompactedFlag;
   }
 }
 
@@ -28,17 +51,34 @@ Page *Tx::page(pgid_t id) {
     return search->second;
   }
 
+  // Then the pages logged but not checkpointed yet.
+  if (this->db_->wal_) {
+    if (Page *p = this->db_->wal_->page(id)) {
+      return p;
+    }
+  }
+
   // Otherwise return directly from the mmap.
   return this->db_->page(id);
 }
 
+std::shared_ptr<const DecodedPage> Tx::decoded_page(Page *p) {
+  NodeCache *cache = this->db_->node_cache();
+  if (cache == nullptr || this->pages_.count(p->id()) > 0 || p != this->db_->page(p->id())) {
+    return DecodedPage::decode(p);
+  }
+  return cache->get(p);
+}
+
 std::int64_t Tx::size() { return static_cast<std::int64_t>(this->meta_->pgid) * this->db_->page_size(); }
 
 Cursor *Tx::cursor() { return root_->cursor(); }
 
 Bucket *Tx::bucket(Slice name) { return root_->bucket(name); }
 
-Bucket *Tx::create_bucket(Slice name) { return root_->create_bucket(name); }
+Bucket *Tx::create_bucket(Slice name, std::uint32_t flags, std::uint32_t comparator) {
+  return root_->create_bucket(name, flags, comparator);
+}
 
 Bucket *Tx::create_bucket_if_not_exists(Slice name) { return root_->create_bucket_if_not_exists(name); }
 
@@ -52,7 +92,23 @@ void Tx::for_each(std::function<void(Slice name, Bucket *b)> fn) {
 
 void Tx::on_commit(std::function<void()> fn) { commit_handlers_.push_back(fn); }
 
-void Tx::commit() {
+void Tx::commit_async(Executor exec, std::function<void(std::exception_ptr)> done) {
+  if (!db_) {
+    exec([done] { done(std::make_exception_ptr(TxClosedException())); });
+    return;
+  }
+  this->db_->run_blocking([this, exec, done] {
+    std::exception_ptr err;
+    try {
+      this->commit();
+    } catch (...) {
+      err = std::current_exception();
+    }
+    exec([done, err] { done(err); });
+  });
+}
+
+void Tx::prepare() {
   assert(!managed_);
   if (!db_) {
     throw TxClosedException();
@@ -63,25 +119,53 @@ void Tx::commit() {
 
   // TODO: Use vectorized I/O to write out dirty pages.
 
-  // Rebalance nodes which have had deletions
+  // Rebalance nodes which have had deletions.
+  auto start = std::chrono::steady_clock::now();
+  this->root_->rebalance();
+  if (this->stats_.rebalance > 0) {
+    this->stats_.rebalance_time +=
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  }
+
+  // spill data onto dirty pages.
+  start = std::chrono::steady_clock::now();
+  this->root_->spill();
+  this->stats_.spill_time +=
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
 
-  // spill data onto dirty pages
+  // Free the old root bucket.
+  this->meta_->root.root = this->root_->root();
 
-  // free the old root bucket
+  // Free a slice of the buckets deleted by this and earlier transactions.
+  this->reclaim();
 
-  // free the freelist and allocate new pages for it. This will overestimate
+  // Free the freelist and allocate new pages for it. This will overestimate
   // the size of the freelist but not underestimate the size (which would be bad).
+  // The freelist also carries the orphan queue, so that pages of deleted
+  // buckets that weren't reclaimed yet survive a restart.
+  FreeList *freelist = this->db_->freelist_;
+  freelist->free(this->meta_->txid, this->page(this->meta_->freelist));
+  Page *p = this->allocate(freelist->size() / this->db_->page_size() + 1);
+  freelist->write(p);
+  this->meta_->freelist = p->id();
 
   // If the high water mark has moved up then attempt to grow the database.
 
   // Write dirty pages to disk.
+  this->write();
 
   // If strict mode is enabled then perform a consistency check.
   // Only the first consistency error is reported in the panic.
+}
+
+void Tx::commit() {
+  this->prepare();
 
   // Write meta to disk.
+  this->write_meta();
 
   // Finalize the transaction.
+  this->close();
 
   // Execute commit handlers now that the locks have been removed.
 }
@@ -100,7 +184,7 @@ void Tx::_rollback() {
   }
   if (writable_) {
     db_->freelist_->rollback(meta_->txid);
-    db_->freelist_->reload(db_->page(db_->meta()->freelist));
+    db_->freelist_->reload(this->page(db_->meta()->freelist));
   }
   close();
 }
@@ -115,37 +199,164 @@ void Tx::close() {
     auto freelist_pending_n = db_->freelist_->pending_count();
     auto freelist_alloc = db_->freelist_->size();
 
+    // Drop the mappings replaced while the writer was open, its nodes are no
+    // longer used.
+    db_->unmap_retired();
+
     // Remove transaction ref & writer lock.
     db_->rwtx_ = nullptr;
     db_->rwlock_.unlock();
 
     // Merge statistics.
-    db_->statlock_.lock();
-    db_->stats_.free_page_n = freelist_free_n;
-    db_->stats_.pending_page_n = freelist_pending_n;
-    db_->stats_.free_alloc =  (freelist_free_n + freelist_pending_n) * db_->page_size();
-    db_->stats_.freelist_inuse = freelist_alloc;
-    db_->stats_.tx_stats += stats_;
-    db_->statlock_.unlock();
+    db_->stats_.commit(stats_, freelist_free_n, freelist_pending_n,
+                       (freelist_free_n + freelist_pending_n) * db_->page_size(), freelist_alloc);
   } else {
     db_->remove_tx(this);
   }
 
-  // clear all references.
+  // Return the dirty pages left by a rollback before clearing all references.
+  this->free_pages();
   db_ = nullptr;
   delete meta_;
   delete root_;
-  pages_.clear();
+  this->buffers_.clear();
+}
+
+// throttle sleeps until copying the given number of bytes since start no
+// longer exceeds rate bytes per second.
+static void throttle(std::chrono::steady_clock::time_point start, std::int64_t copied, std::int64_t rate) {
+  if (rate <= 0) {
+    return;
+  }
+  auto due = start + std::chrono::microseconds(copied * 1000000 / rate);
+  std::this_thread::sleep_until(due);
 }
 
-std::int64_t Tx::write_to(os::File w) {
-  // Attempt to open reader with WriteFlag
-  os::File* f = os::open_file(db_->path_, os::OPEN_RDONLY|writeFlag, os::ModeDefault);
+std::int64_t Tx::write_to(os::File *w) {
+  // Attempt to open reader with WriteFlag. An in-memory database has no file
+  // to reopen, so its memfd is read directly; all reads below are positional.
+  os::File *f = nullptr;
+  int src = db_->fd();
+  if (!db_->in_memory_) {
+    f = os::open_file(db_->path_, os::OPEN_RDONLY | writeFlag, os::ModeDefault);
+    src = f->fd();
+  }
+  auto close_file = gsl::finally([f] {
+    if (f) {
+      f->close();
+      delete f;
+    }
+  });
+
+  // Write meta 0 and meta 1 with a lower transaction id.
+  int page_size = db_->page_size();
+  std::string buf = meta_pages(*meta_, page_size);
+  write_full(w->fd(), buf.data(), buf.size());
+
+  // Copy data pages, past the meta pages in the file.
+  std::int64_t off = 2 * page_size;
+  std::int64_t sz = this->size();
+  auto start = std::chrono::steady_clock::now();
+
+  // Let the kernel move the data unless the caller asked for O_DIRECT, in
+  // which case the page cache must be bypassed.
+  if ((writeFlag & O_DIRECT) == 0) {
+    while (off < sz) {
+      std::size_t n = std::min<std::int64_t>(CopyChunkSize, sz - off);
+      std::int64_t r = copy_range(src, &off, w->fd(), n);
+      if (r <= 0) {
+        break;
+      }
+      throttle(start, off - 2 * page_size, writeRate);
+    }
+  }
 
-  return 0;
+  // Otherwise copy through a large aligned buffer. The source is read with
+  // O_DIRECT where the file system allows it, so that the copy doesn't evict
+  // the pages of the live database from the page cache.
+  if (off < sz) {
+    int direct = -1;
+    if (!db_->in_memory_ && (writeFlag & O_DIRECT) == 0) {
+      direct = ::open(db_->path_.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+    }
+    auto close_direct = gsl::finally([direct] {
+      if (direct >= 0) {
+        ::close(direct);
+      }
+    });
+    int reader = direct >= 0 ? direct : src;
+    bool cached = !db_->in_memory_ && direct < 0 && (writeFlag & O_DIRECT) == 0;
+
+    void *ptr = nullptr;
+    if (::posix_memalign(&ptr, CopyAlignment, CopyChunkSize) != 0) {
+      throw std::bad_alloc();
+    }
+    std::unique_ptr<char, decltype(&std::free)> chunk(static_cast<char *>(ptr), &std::free);
+    while (off < sz) {
+      // O_DIRECT reads must start at an aligned offset.
+      std::int64_t base = off - off % static_cast<std::int64_t>(CopyAlignment);
+      ssize_t r = ::pread(reader, chunk.get(), CopyChunkSize, base);
+      if (r < 0 && errno == EINTR) {
+        continue;
+      }
+      if (r <= off - base) {
+        throw std::system_error(r < 0 ? errno : EIO, std::system_category(), "short read while copying database");
+      }
+      std::size_t n = std::min<std::int64_t>(base + r, sz) - off;
+      write_full(w->fd(), chunk.get() + (off - base), n);
+      if (cached) {
+        // The file system can't bypass the page cache, drop what was read.
+        ::posix_fadvise(reader, base, r, POSIX_FADV_DONTNEED);
+      }
+      off += n;
+      throttle(start, off - 2 * page_size, writeRate);
+    }
+  }
+  return sz;
 }
 
-void Tx::copy_file(std::string path, os::file_mode mode) {}
+std::int64_t Tx::write_delta(os::File *w, txid_t since) {
+  PageLog *log = db_->page_log_;
+  if (!log) {
+    throw PageLogDisabledException();
+  }
+
+  // Only commits visible to this transaction are exported. Their pages can't
+  // be reused while the transaction is open.
+  auto runs = log->pages_since(since, meta_->txid);
+  Page *freelist = this->page(meta_->freelist);
+  runs[meta_->freelist] = static_cast<std::uint64_t>(freelist->overflow()) + 1;
+
+  int page_size = db_->page_size();
+  DeltaHeader h = {DeltaMagic, static_cast<std::uint32_t>(page_size), since, meta_->txid, runs.size()};
+  write_full(w->fd(), reinterpret_cast<const char *>(&h), sizeof(h));
+  write_full(w->fd(), reinterpret_cast<const char *>(meta_), sizeof(*meta_));
+  std::int64_t n = sizeof(h) + sizeof(*meta_);
+
+  for (auto &run : runs) {
+    std::uint64_t head[2] = {run.first, run.second};
+    std::size_t sz = run.second * page_size;
+    write_full(w->fd(), reinterpret_cast<const char *>(head), sizeof(head));
+    write_full(w->fd(), reinterpret_cast<const char *>(this->page(run.first)), sz);
+    n += sizeof(head) + sz;
+  }
+  return n;
+}
+
+void Tx::copy_file(std::string path, os::file_mode mode, bool compact) {
+  os::File f(path, O_RDWR | O_CREAT | O_TRUNC, mode);
+  if (compact) {
+    Compactor(this, &f).run();
+  } else {
+    this->write_to(&f);
+  }
+
+  // Make sure the copy is durable before it is swapped in.
+  if (::fdatasync(f.fd()) != 0) {
+    throw std::system_error(errno, std::system_category(), "fdatasync failed");
+  }
+  f.close();
+}
 
 void Tx::check() {}
 
@@ -153,11 +364,151 @@ PageInfo *Tx::page(int id) { return nullptr; }
 
 void Tx::check_bucket(Bucket *b, std::map<pgid_t, Page *> reachable, std::set<pgid_t> freed) {}
 
-Page *Tx::allocate(int count) { return nullptr; }
+Page *Tx::allocate(int count) {
+  Page *p = this->db_->allocate(this->meta_->txid, count);
+
+  // Save to our page cache.
+  this->pages_[p->id()] = p;
 
-void Tx::write() {}
+  // Update statistics.
+  this->stats_.page_count += count;
+  this->stats_.page_alloc += count * this->db_->page_size();
+  return p;
+}
+
+void Tx::reclaim() {
+  FreeList *f = this->db_->freelist_;
+  auto &orphans = f->orphans;
+
+  // The queue is used as a stack so that it holds at most the pages along
+  // one path of each tree and their siblings.
+  for (int n = 0; n < this->db_->reclaim_budget_ && !orphans.empty();) {
+    Page *p = this->page(orphans.back());
+    orphans.pop_back();
+    if (p->flags() & BranchPageFlag) {
+      for (std::uint32_t i = 0; i < p->count(); i++) {
+        orphans.push_back(p->branchPageElement(i)->id);
+      }
+    } else {
+      // Nested buckets go with their parent. Inline ones live in the leaf.
+      for (std::uint32_t i = 0; i < p->count(); i++) {
+        LeafPageElement *elem = p->leafPageElement(i);
+        if (elem->flags & BucketLeafFlag) {
+          struct bucket b;
+          std::memcpy(&b, elem->value().data(), sizeof(b));
+          if (b.root != 0) {
+            orphans.push_back(b.root);
+          }
+        }
+      }
+    }
+    n += p->overflow() + 1;
+    f->free(this->meta_->txid, p);
+  }
+}
 
-void Tx::write_meta() {}
+char *Tx::alloc(size_t n) {
+  this->buffers_.emplace_back(new char[n]());
+  return this->buffers_.back().get();
+}
+
+void Tx::free_pages() {
+  for (auto &it : this->pages_) {
+    this->db_->free_page(it.second);
+  }
+  this->pages_.clear();
+}
+
+void Tx::write() {
+  // Write pages to disk in order, pages_ is sorted by id. With a write-ahead
+  // log the pages are logged together with the meta by write_meta() instead.
+  auto start = std::chrono::steady_clock::now();
+  std::map<pgid_t, std::uint64_t> runs;
+  int page_size = db_->page_size();
+  for (auto &it : this->pages_) {
+    Page *p = it.second;
+    std::uint64_t n = static_cast<std::uint64_t>(p->overflow()) + 1;
+    if (!db_->wal_) {
+      pwrite_full(db_->fd(), reinterpret_cast<const char *>(p), n * page_size,
+                  static_cast<std::int64_t>(it.first) * page_size);
+      this->stats_.write++;
+    }
+    runs[it.first] = n;
+  }
+  if (!db_->wal_) {
+    this->free_pages();
+  }
+
+  // Record the written pages so that they are durable before the meta
+  // points to them.
+  if (db_->page_log_) {
+    db_->page_log_->append(meta_->txid, runs);
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  this->stats_.write_time += std::chrono::duration_cast<std::chrono::microseconds>(now - start);
+
+  // Ignore file sync if flag is set on DB or there is no file. The log is
+  // synced by write_meta().
+  if (!db_->no_sync_ && !db_->in_memory_ && !db_->wal_) {
+    db_->fdatasync();
+    if (db_->page_log_) {
+      db_->page_log_->sync();
+    }
+    this->stats_.sync++;
+    this->stats_.sync_time +=
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - now);
+  }
+}
+
+void Tx::write_meta() {
+  auto start = std::chrono::steady_clock::now();
+  bool sync = !db_->no_sync_ && !db_->in_memory_;
+
+  if (db_->wal_) {
+    // Log the dirty pages and the meta as a single record, which is the only
+    // write a commit has to sync. The checkpointer moves them to the data
+    // file later.
+    db_->wal_->append(*meta_, this->pages_, sync);
+    if (sync && db_->page_log_) {
+      db_->page_log_->sync();
+    }
+    this->stats_.write += this->pages_.size() + 1;
+    this->free_pages();
+
+    // Readers copy the meta under the meta lock.
+    {
+      std::lock_guard<std::mutex> lock(db_->metalock_);
+      db_->wal_->publish(*meta_);
+    }
+    if (db_->wal_->size() >= db_->wal_checkpoint_size_) {
+      db_->checkpoint_cond_.notify_one();
+    }
+  } else {
+    // Create a temporary buffer for the meta page.
+    std::string buf(db_->page_size(), '\0');
+    Page *p = new (&buf[0]) Page(0, 0);
+    meta_->write(p);
+
+    // Write the meta page to file.
+    pwrite_full(db_->fd(), buf.data(), buf.size(), static_cast<std::int64_t>(p->id()) * db_->page_size());
+    if (sync) {
+      db_->fdatasync();
+    }
+    this->stats_.write++;
+  }
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  this->stats_.write_time += elapsed;
+  if (sync) {
+    this->stats_.sync++;
+    this->stats_.sync_time += elapsed;
+  }
+
+  // Only committed transactions are sampled, rollbacks would skew the
+  // histograms towards zero.
+  db_->latency_.record(stats_);
+}
 
 Page *Tx::_page(pgid_t id) { return nullptr; }
 
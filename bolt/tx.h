@@ -1,14 +1,18 @@
 #ifndef __BOLT_TX_H
 #define __BOLT_TX_H
 
+#include "comparator.h"
 #include "meta.h"
 #include "molly/os/file.h"
 #include "slice.h"
 #include "stats.h"
+#include "types.h"
 #include <gsl/gsl>
 #include <cstdint>
+#include <exception>
 #include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -17,6 +21,7 @@ class DB;
 class Page;
 class Cursor;
 class Bucket;
+struct DecodedPage;
 struct PageInfo;
 
 namespace os = molly::os;
@@ -38,8 +43,16 @@ public:
   // By default, the flag is unset, which works well for mostly in-memory
   // workloads. For databases that are much larger than availabe RAM, set
   // the flag to syscall.O_DIRECT to avoid trashing the page cache.
+  // Without O_DIRECT the data is copied inside the kernel with
+  // copy_file_range() or sendfile() when possible.
   int writeFlag;
 
+  // writeRate limits WriteTo() to the given number of bytes per second so
+  // that backups don't starve foreground I/O.
+  //
+  // If <= 0, the copy is not throttled.
+  std::int64_t writeRate;
+
   bool writable() const { return writable_; }
   bool managed() const { return managed_; }
 
@@ -56,6 +69,11 @@ public:
   // If page has been written to then a temporary buffered page is returned.
   Page *page(pgid_t id);
 
+  // decoded_page returns the decoded elements of a branch or leaf page.
+  // Pages read from the mmap are shared with other transactions through the
+  // database's node cache; dirty and inline pages are decoded privately.
+  std::shared_ptr<const DecodedPage> decoded_page(Page *p);
+
   // cursor creates a cursor associated with the root bucket.
   // All items in the cursor will return a nil value becaurse all root bucket keys point to buckets.
   // The cursor is noly valid as long as the transaction is open.
@@ -73,13 +91,24 @@ public:
   // create_bucket creates a new bucket.
   // Returns an error if the bucket already exists, if the bucket name is blank, or if the bucket name is too long.
   // The bucket instance is only valid for the lifetime of the transction.
-  Bucket *create_bucket(Slice name);
+  // flags and comparator are stored in the bucket header, see
+  // Bucket::create_bucket().
+  Bucket *create_bucket(Slice name, std::uint32_t flags = 0, std::uint32_t comparator = BytewiseComparator::id);
+
+  // create_bucket<Cmp> creates a bucket whose keys are ordered by Cmp.
+  template <class Cmp> Bucket *create_bucket(Slice name, std::uint32_t flags = 0) {
+    return this->create_bucket(name, flags, Cmp::id);
+  }
 
   // create_bucket_if_not_exists creates a new bucket if it doesn't already exist.
   // Returns an error if the bucket name is blank, or if the bucket name is too long.
   // The bucket instance is only valid for the lifetime of the transaction.
   Bucket *create_bucket_if_not_exists(Slice name);
 
+  // delete_bucket deletes a bucket. Only the bucket's key is removed right
+  // away; its pages, including those of its nested buckets, are returned to
+  // the freelist by this and later commits, see Option.ReclaimBudget.
+  // Throws BucketNotFoundException if the bucket doesn't exist.
   void delete_bucket(Slice name);
 
   // for_each executes a function for each bucket in the root.
@@ -95,18 +124,37 @@ public:
   // called on a read-only transaction.
   void commit();
 
+  // commit_async runs commit() on the database's background syncer thread,
+  // so that waiting for the disk doesn't block the calling thread, and then
+  // calls done through exec with the error commit() threw, if any.
+  void commit_async(Executor exec, std::function<void(std::exception_ptr)> done);
+
   // Rollback closes the transction and igores all previous updates. Read-only
   // transcations must be rolled back and not commited.
   void rollback();
 
   // Write_to writes the entire database to a writer.
   // If err == nil then exactly tx.Size() bytes will be written into the writer.
-  std::int64_t write_to(os::File w);
+  // The copy is streamed in large chunks and honors writeFlag and writeRate.
+  std::int64_t write_to(os::File *w);
+
+  // write_delta writes an incremental backup to a writer: only the pages
+  // written by transactions after since, plus the current meta and freelist.
+  // Apply it to a backup taken at since with apply_deltas().
+  // Requires the database to be opened with Option.PageLog. Throws
+  // DeltaMismatchException if the page log doesn't cover the commits after
+  // since, because it was trimmed past since or enabled after it.
+  std::int64_t write_delta(os::File *w, txid_t since);
 
   // copy_file copies the entire database to file at the given path.
   // A reader transaction is maintained during the copy so it is safe to continue
   // using the database while a copy is in progress.
-  void copy_file(std::string path, os::file_mode mode);
+  //
+  // When compact is set, buckets are rewritten instead of copied page by page:
+  // leaves are laid out in key order on full pages and the copy has no free
+  // pages, so it is usually much smaller than the source and scans over it are
+  // sequential. A compacted copy can't be the base of apply_deltas().
+  void copy_file(std::string path, os::file_mode mode, bool compact = false);
 
   // Check performs several consistency checks on the database for this transaction.
   // An error is returned if any inconsistency is found.
@@ -141,18 +189,40 @@ private:
   // allocate returns a contiguous block of memory starting at a given page.
   Page *allocate(int count);
 
+  // reclaim frees up to the database's reclaim budget of pages of the
+  // orphaned trees queued on the freelist.
+  void reclaim();
+
+  // free_pages releases the buffers of the dirty pages.
+  void free_pages();
+
   // write writes any dirty pages to disk.
   void write();
 
   // writeMeta writes the meta to the disk
   void write_meta();
 
+  // prepare runs the first phase of commit(): it writes the dirty pages to
+  // disk but leaves the meta alone, so the changes are not visible yet.
+  void prepare();
+
   // page returns a reference to the page with a given id.
   // If page has been written to then a temporary buffered page is returned.
   Page *_page(pgid_t id);
 
   // for_each_page iterates over every page within a given page and executes a function.
   void for_each_page(pgid_t pgid, int depth, std::function<void(Page *, int)> fn);
+
+  // alloc returns n bytes that live as long as the transaction, for values
+  // written into nodes by the transaction itself, like bucket headers.
+  char *alloc(size_t n);
+
+  std::vector<std::unique_ptr<char[]>> buffers_;
+
+  friend class Bucket;
+  friend class DB;
+  friend class Node;
+  friend class ShardedDB;
 };
 
 #endif
\ No newline at end of file
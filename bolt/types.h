@@ -2,8 +2,14 @@
 #define __BOLT_TYPES_H
 
 #include <cstdint>
+#include <functional>
 
 typedef std::uint64_t pgid_t;
 typedef std::uint64_t txid_t;
 
+// Executor runs a function on a thread of the caller's runtime, typically by
+// queueing it to a worker pool. The asynchronous transaction API resumes the
+// caller's work through it.
+typedef std::function<void(std::function<void()>)> Executor;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "u64_keys.h"
+
+// Ranges at most this long are counted instead of bisected.
+static const size_t LinearSearchThreshold = 16;
+
+Slice encode_u64_key(std::uint64_t v, char buf[U64KeySize]) {
+  for (size_t i = 0; i < U64KeySize; i++) {
+    buf[i] = static_cast<char>(v >> (56 - 8 * i));
+  }
+  return Slice(buf, U64KeySize);
+}
+
+std::uint64_t decode_u64_key(const char *key) {
+  std::uint64_t v = 0;
+  for (size_t i = 0; i < U64KeySize; i++) {
+    v = (v << 8) | static_cast<unsigned char>(key[i]);
+  }
+  return v;
+}
+
+size_t u64_lower_bound(const std::uint64_t *keys, size_t n, std::uint64_t key) {
+  // The answer always lies in [base, base + n].
+  const std::uint64_t *base = keys;
+  while (n > LinearSearchThreshold) {
+    size_t half = n / 2;
+    base = base[half] < key ? base + half : base;
+    n -= half;
+  }
+
+  size_t i = 0;
+  for (size_t j = 0; j < n; j++) {
+    i += base[j] < key;
+  }
+  return (base - keys) + i;
+}
@@ -0,0 +1,26 @@
+#ifndef __BOLT_U64_KEYS_H
+#define __BOLT_U64_KEYS_H
+
+#include "slice.h"
+#include <cstddef>
+#include <cstdint>
+
+// U64KeySize is the size of a key in a bucket created with BucketU64KeysFlag.
+const size_t U64KeySize = sizeof(std::uint64_t);
+
+// encode_u64_key writes v big-endian into buf and returns it as a key. Keys
+// are big-endian so that byte order and integer order agree, which lets the
+// rest of the tree compare them as ordinary slices.
+Slice encode_u64_key(std::uint64_t v, char buf[U64KeySize]);
+
+// decode_u64_key returns the integer of an encoded key.
+// REQUIRES: key.size() == U64KeySize
+std::uint64_t decode_u64_key(const char *key);
+
+// u64_lower_bound returns the index of the first of n sorted keys that is not
+// less than key, like std::lower_bound but without a branch per step: the
+// range is halved with a conditional move until it fits in a few cache lines,
+// then the smaller keys are counted in a loop the compiler can vectorize.
+size_t u64_lower_bound(const std::uint64_t *keys, size_t n, std::uint64_t key);
+
+#endif
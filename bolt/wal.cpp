@@ -0,0 +1,178 @@
+#include "wal.h"
+#include "bolt_unix.h"
+#include "molly/hash/hash.h"
+#include "page.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <new>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace hash = molly::hash;
+
+Wal::Wal(std::string path, int page_size) : path_(path), page_size_(page_size), size_(0), has_meta_(false) {
+  this->fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (this->fd_ < 0) {
+    throw std::system_error(errno, std::system_category(), "fail to open write-ahead log: " + path_);
+  }
+
+  // Drop a record that was torn by a crash in the middle of an append.
+  try {
+    this->size_ = this->scan();
+    if (::ftruncate(this->fd_, this->size_) != 0) {
+      throw std::system_error(errno, std::system_category(), "fail to truncate write-ahead log: " + path_);
+    }
+  } catch (...) {
+    ::close(this->fd_);
+    throw;
+  }
+}
+
+Wal::~Wal() { ::close(this->fd_); }
+
+void Wal::load(const char *image, std::uint64_t n) {
+  // Keep the image byte for byte, readers see it just like a mapped page.
+  std::unique_ptr<char[]> buf(new char[n * this->page_size_]);
+  std::memcpy(buf.get(), image, n * this->page_size_);
+  pgid_t id = reinterpret_cast<Page *>(buf.get())->id();
+  this->pages_[id] = std::move(buf);
+}
+
+void Wal::append(const Meta &m, const std::map<pgid_t, Page *> &pages, bool sync) {
+  std::uint64_t head[2] = {m.txid, pages.size()};
+  std::string buf;
+  buf.append(reinterpret_cast<const char *>(head), sizeof(head));
+  buf.append(reinterpret_cast<const char *>(&m), sizeof(m));
+  for (auto &it : pages) {
+    std::uint64_t run[2] = {it.first, static_cast<std::uint64_t>(it.second->overflow()) + 1};
+    buf.append(reinterpret_cast<const char *>(run), sizeof(run));
+    buf.append(reinterpret_cast<const char *>(it.second), run[1] * this->page_size_);
+  }
+  std::uint64_t checksum = hash::fnva64_buf(buf.data(), buf.size());
+  buf.append(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+
+  write_full(this->fd_, buf.data(), buf.size());
+  if (sync && ::fdatasync(this->fd_) != 0) {
+    throw std::system_error(errno, std::system_category(), "fdatasync failed");
+  }
+
+  // The pages are only reachable through the meta, so readers can see them
+  // before it is published.
+  std::unique_lock<std::shared_mutex> lock(this->mutex_);
+  this->size_ += buf.size();
+  for (auto &it : pages) {
+    this->load(reinterpret_cast<const char *>(it.second), static_cast<std::uint64_t>(it.second->overflow()) + 1);
+  }
+}
+
+void Wal::publish(const Meta &m) {
+  std::unique_lock<std::shared_mutex> lock(this->mutex_);
+  this->meta_ = m;
+  this->has_meta_ = true;
+}
+
+Page *Wal::page(pgid_t id) {
+  std::shared_lock<std::shared_mutex> lock(this->mutex_);
+  auto it = this->pages_.find(id);
+  if (it == this->pages_.end()) {
+    return nullptr;
+  }
+  return reinterpret_cast<Page *>(it->second.get());
+}
+
+bool Wal::empty() {
+  std::shared_lock<std::shared_mutex> lock(this->mutex_);
+  return !this->has_meta_;
+}
+
+std::int64_t Wal::size() {
+  std::shared_lock<std::shared_mutex> lock(this->mutex_);
+  return this->size_;
+}
+
+std::int64_t Wal::scan() {
+  struct stat st;
+  if (::fstat(this->fd_, &st) != 0) {
+    throw std::system_error(errno, std::system_category(), "fail to stat write-ahead log: " + path_);
+  }
+
+  std::int64_t off = 0;
+  std::string buf;
+  for (;;) {
+    std::uint64_t head[2];
+    Meta m;
+    if (::pread(this->fd_, head, sizeof(head), off) != sizeof(head) ||
+        ::pread(this->fd_, &m, sizeof(m), off + sizeof(head)) != sizeof(m)) {
+      return off;
+    }
+
+    // Read the page runs one by one, never trusting a length of a torn
+    // record before checking it fits in the file.
+    buf.assign(reinterpret_cast<const char *>(head), sizeof(head));
+    buf.append(reinterpret_cast<const char *>(&m), sizeof(m));
+    std::vector<std::pair<size_t, std::uint64_t>> images;
+    for (std::uint64_t i = 0; i < head[1]; i++) {
+      std::uint64_t run[2];
+      std::int64_t pos = off + buf.size();
+      if (::pread(this->fd_, run, sizeof(run), pos) != sizeof(run) ||
+          run[1] > static_cast<std::uint64_t>(st.st_size - pos) / this->page_size_) {
+        return off;
+      }
+      buf.append(reinterpret_cast<const char *>(run), sizeof(run));
+      images.emplace_back(buf.size(), run[1]);
+      buf.resize(buf.size() + run[1] * this->page_size_);
+      if (::pread(this->fd_, &buf[images.back().first], run[1] * this->page_size_, pos + sizeof(run)) !=
+          static_cast<ssize_t>(run[1] * this->page_size_)) {
+        return off;
+      }
+    }
+
+    // A checksum mismatch means the tail of the log was never completed.
+    std::uint64_t checksum;
+    if (::pread(this->fd_, &checksum, sizeof(checksum), off + buf.size()) != sizeof(checksum) ||
+        checksum != hash::fnva64_buf(buf.data(), buf.size())) {
+      return off;
+    }
+
+    for (auto &image : images) {
+      this->load(&buf[image.first], image.second);
+    }
+    this->meta_ = m;
+    this->has_meta_ = true;
+    off += buf.size() + sizeof(checksum);
+  }
+}
+
+void Wal::write_to(int fd) {
+  std::shared_lock<std::shared_mutex> lock(this->mutex_);
+  for (auto &it : this->pages_) {
+    Page *p = reinterpret_cast<Page *>(it.second.get());
+    std::uint64_t n = static_cast<std::uint64_t>(p->overflow()) + 1;
+    pwrite_full(fd, it.second.get(), n * this->page_size_, static_cast<std::int64_t>(it.first) * this->page_size_);
+  }
+
+  // Write the meta last, it points the data file at the new pages.
+  if (this->has_meta_) {
+    std::string buf(this->page_size_, '\0');
+    pgid_t id = this->meta_.txid % 2;
+    Page *p = new (&buf[0]) Page(id, MetaPageFlag);
+    Meta *m = p->meta();
+    *m = this->meta_;
+    m->checksum = m->sum64();
+    pwrite_full(fd, buf.data(), buf.size(), static_cast<std::int64_t>(id) * this->page_size_);
+  }
+}
+
+void Wal::reset() {
+  std::unique_lock<std::shared_mutex> lock(this->mutex_);
+  if (::ftruncate(this->fd_, 0) != 0) {
+    throw std::system_error(errno, std::system_category(), "fail to truncate write-ahead log: " + path_);
+  }
+  this->size_ = 0;
+  this->pages_.clear();
+  this->has_meta_ = false;
+}
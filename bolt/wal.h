@@ -0,0 +1,92 @@
+#ifndef __BOLT_WAL_H
+#define __BOLT_WAL_H
+
+#include "meta.h"
+#include "types.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+
+class Page;
+
+// DefaultWalCheckpointInterval is the default time in milliseconds between
+// two background checkpoints.
+const int DefaultWalCheckpointInterval = 1000;
+
+// DefaultWalCheckpointSize is the default log size in bytes above which a
+// checkpoint starts right away.
+const int DefaultWalCheckpointSize = 64 * 1024 * 1024;
+
+// Wal is the write-ahead log of a database opened with Option::Wal. A commit
+// appends the images of its dirty pages and its meta to the log as a single
+// record and syncs only the log, which is one sequential write instead of
+// scattered page writes plus a meta write, each followed by a sync.
+//
+// Logged pages are served from memory until a checkpoint has copied them and
+// the newest meta to the data file, after which the log starts over.
+//
+// Each record is laid out as:
+//   txid | count | meta | count * (pgid, number of pages, page data) | checksum
+// A torn record at the end of the log is discarded when the log is opened,
+// every complete record is replayed.
+class Wal {
+public:
+  // open opens (creating it if needed) the log at the given path and loads
+  // the records it holds.
+  Wal(std::string path, int page_size);
+  ~Wal();
+
+  // append logs the dirty pages and the meta of a commit, syncs the log if
+  // sync is set and makes the pages visible through page(). The meta only
+  // becomes visible through meta() once it is published.
+  void append(const Meta &m, const std::map<pgid_t, Page *> &pages, bool sync);
+
+  // publish makes m the meta returned by meta(). The caller serializes it
+  // with the readers copying the meta.
+  void publish(const Meta &m);
+
+  // meta returns the meta of the newest published commit, or nullptr if the
+  // log is empty.
+  Meta *meta() { return this->has_meta_ ? &this->meta_ : nullptr; }
+
+  // page returns the newest logged image of a page, or nullptr if the data
+  // file holds the newest one.
+  Page *page(pgid_t id);
+
+  // empty returns whether there is nothing to checkpoint.
+  bool empty();
+
+  // size returns the size of the log in bytes.
+  std::int64_t size();
+
+  // write_to copies the logged pages and the newest meta to the data file.
+  // The caller syncs the data file. No commit may run concurrently.
+  void write_to(int fd);
+
+  // reset empties the log once its pages are durable in the data file.
+  // Pages returned by page() become invalid, so no reader may be open.
+  void reset();
+
+private:
+  // scan replays every valid record and returns the length of the valid
+  // prefix of the log.
+  std::int64_t scan();
+
+  // load copies a page image of n pages into the logged pages, replacing any
+  // older image of the same page.
+  void load(const char *image, std::uint64_t n);
+
+  std::string path_;
+  int fd_;
+  int page_size_;
+  std::int64_t size_;
+
+  std::shared_mutex mutex_; // protects pages_ against concurrent readers
+  std::map<pgid_t, std::unique_ptr<char[]>> pages_;
+  Meta meta_;
+  bool has_meta_;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include "writer_lock.h"
+
+void WriterLock::lock() {
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  this->cond_.wait(lock, [this] { return !this->held_; });
+  this->held_ = true;
+}
+
+bool WriterLock::try_lock() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (this->held_) {
+    return false;
+  }
+  this->held_ = true;
+  return true;
+}
+
+void WriterLock::unlock() {
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  if (this->waiters_.empty()) {
+    this->held_ = false;
+    lock.unlock();
+    this->cond_.notify_one();
+    return;
+  }
+
+  // Hand the lock over without releasing it so that a blocked thread can't
+  // take it in between.
+  std::function<void()> acquired = std::move(this->waiters_.front());
+  this->waiters_.pop_front();
+  lock.unlock();
+  acquired();
+}
+
+bool WriterLock::lock_async(std::function<void()> acquired) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (!this->held_) {
+    this->held_ = true;
+    return true;
+  }
+  this->waiters_.push_back(std::move(acquired));
+  return false;
+}
@@ -0,0 +1,35 @@
+#ifndef __BOLT_WRITER_LOCK_H
+#define __BOLT_WRITER_LOCK_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+// WriterLock is the lock that allows only one writer transaction at a time.
+// Unlike a std::mutex it may be unlocked by another thread than the one that
+// locked it, because a transaction begun by a coroutine can commit on another
+// worker thread, and it can be acquired without blocking: lock_async queues a
+// callback that is handed the lock when it is released.
+class WriterLock {
+public:
+  WriterLock() : held_(false) {}
+
+  void lock();
+  bool try_lock();
+  void unlock();
+
+  // lock_async takes the lock and returns true if it is free. Otherwise it
+  // returns false and calls acquired, which must not block, once the lock has
+  // been handed over to it. Queued callbacks are served first come first
+  // served, before any thread blocked in lock().
+  bool lock_async(std::function<void()> acquired);
+
+private:
+  std::mutex mutex_; // protects the fields below
+  std::condition_variable cond_;
+  bool held_;
+  std::deque<std::function<void()>> waiters_;
+};
+
+#endif
@@ -0,0 +1,173 @@
+// The awaitables of bolt/async.h need C++20, so the tests in this file are
+// only built into the test_bolt_async target, see CMakeLists.txt.
+#if __cplusplus > 201703L
+
+#include "bolt/async.h"
+#include "bolt/bucket.h"
+#include "bolt/exception.h"
+#include "util.h"
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <string>
+#include <system_error>
+
+#ifndef __cpp_impl_coroutine
+#error "test_bolt_async must be built with coroutine support"
+#endif
+
+// Task is a coroutine which starts right away and keeps its frame until the
+// test destroys it, so that done() can be checked after it finishes.
+struct Task {
+  struct promise_type {
+    Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+    std::suspend_never initial_suspend() { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  ~Task() { h.destroy(); }
+  bool done() const { return h.done(); }
+
+  std::coroutine_handle<promise_type> h;
+};
+
+// Loop is an executor which queues functions to be run by the test thread.
+// Commits report back from the syncer thread, so the queue is locked.
+class Loop {
+public:
+  Executor executor() {
+    return [this](std::function<void()> fn) {
+      std::lock_guard<std::mutex> lock(mu_);
+      queue_.push_back(std::move(fn));
+      cond_.notify_one();
+    };
+  }
+
+  // run_until runs the queued functions until the task is done.
+  void run_until(const Task &task) {
+    while (!task.done()) {
+      std::unique_lock<std::mutex> lock(mu_);
+      cond_.wait(lock, [this] { return !queue_.empty(); });
+      std::function<void()> fn = std::move(queue_.front());
+      queue_.pop_front();
+      lock.unlock();
+      fn();
+    }
+  }
+
+  bool empty() {
+    std::lock_guard<std::mutex> lock(mu_);
+    return queue_.empty();
+  }
+
+private:
+  std::mutex mu_;
+  std::condition_variable cond_;
+  std::deque<std::function<void()>> queue_;
+};
+
+// Ensure that a coroutine can update the database and read it back.
+TEST(AsyncTest, UpdateBegin) {
+  DB *db = must_open_db();
+  Loop loop;
+  std::string value;
+  auto run = [](DB *db, Executor exec, std::string *value) -> Task {
+    co_await co_update(
+        db, [](Tx *tx) { tx->create_bucket("widgets")->put("foo", "bar"); }, exec);
+
+    Tx *tx = co_await co_begin(db, false, exec);
+    *value = tx->bucket("widgets")->get("foo").ToString();
+    tx->rollback();
+    delete tx;
+  };
+
+  Task task = run(db, loop.executor(), &value);
+  loop.run_until(task);
+  ASSERT_EQ(value, "bar");
+  delete db;
+}
+
+// Ensure that a coroutine waiting for the writer lock is suspended until the
+// current writer closes, and that co_commit() resumes it once committed.
+TEST(AsyncTest, BeginWaitsForWriter) {
+  DB *db = must_open_db();
+  Loop loop;
+  auto run = [](DB *db, Executor exec) -> Task {
+    Tx *tx = co_await co_begin(db, true, exec);
+    tx->create_bucket("widgets");
+    co_await co_commit(tx, exec);
+    delete tx;
+  };
+
+  Tx *tx = db->begin(true);
+  Task task = run(db, loop.executor());
+  ASSERT_FALSE(task.done());
+  ASSERT_TRUE(loop.empty());
+
+  tx->commit();
+  delete tx;
+  loop.run_until(task);
+
+  tx = db->begin(false);
+  ASSERT_NE(tx->bucket("widgets"), nullptr);
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that errors are rethrown from co_await.
+TEST(AsyncTest, CommitError) {
+  DB *db = must_open_db();
+  Loop loop;
+  bool thrown = false;
+  auto run = [](DB *db, Executor exec, bool *thrown) -> Task {
+    Tx *tx = co_await co_begin(db, false, exec);
+    try {
+      co_await co_commit(tx, exec);
+    } catch (TxNotWritableException &e) {
+      *thrown = true;
+    }
+    tx->rollback();
+    delete tx;
+  };
+
+  Task task = run(db, loop.executor(), &thrown);
+  loop.run_until(task);
+  ASSERT_TRUE(thrown);
+  delete db;
+}
+
+// Ensure that a failed commit of co_update() releases the writer lock.
+TEST(AsyncTest, UpdateCommitError) {
+  DB *db = must_open_db();
+  Loop loop;
+  bool thrown = false;
+  std::string value(4 << 20, 'x');
+  auto run = [](DB *db, Executor exec, const std::string *value, bool *thrown) -> Task {
+    try {
+      FileSizeLimit limit(1 << 20);
+      co_await co_update(
+          db, [value](Tx *tx) { tx->create_bucket("widgets")->put("foo", Slice(value->data(), value->size())); },
+          exec);
+    } catch (std::system_error &e) {
+      *thrown = true;
+    }
+  };
+
+  Task task = run(db, loop.executor(), &value, &thrown);
+  loop.run_until(task);
+  ASSERT_TRUE(thrown);
+
+  Tx *tx = db->begin(true);
+  tx->create_bucket("widgets");
+  tx->commit();
+  delete tx;
+  delete db;
+}
+
+#endif
@@ -0,0 +1,171 @@
+#include "bolt/backup.h"
+#include "bolt/bucket.h"
+#include "bolt/exception.h"
+#include "bolt/tx.h"
+#include "util.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace os = molly::os;
+
+// contents returns every key/value pair of every bucket, keyed by bucket name
+// and key.
+static std::map<std::string, std::string> contents(DB *db) {
+  std::map<std::string, std::string> m;
+  Tx *tx = db->begin(false);
+  tx->for_each([&](Slice name, Bucket *b) {
+    b->for_each([&](Slice k, Slice v) { m[name.ToString() + "/" + k.ToString()] = v.ToString(); });
+  });
+  tx->rollback();
+  delete tx;
+  return m;
+}
+
+// put_range writes the keys in [from, to) to a bucket, creating it if needed,
+// and commits.
+static void put_range(DB *db, const std::string &bucket, int from, int to, const std::string &value) {
+  std::vector<std::string> keys;
+  keys.reserve(to - from);
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket_if_not_exists(Slice(bucket.data(), bucket.size()));
+  for (int i = from; i < to; i++) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%08d", i);
+    keys.emplace_back(buf);
+    b->put(Slice(keys.back().data(), keys.back().size()), Slice(value.data(), value.size()));
+  }
+  tx->commit();
+  delete tx;
+}
+
+// write_delta exports the commits after since to a file and returns the txid
+// the delta brings a backup to.
+static txid_t write_delta(DB *db, const std::string &path, txid_t since) {
+  os::File f(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  Tx *tx = db->begin(false);
+  try {
+    tx->write_delta(&f, since);
+  } catch (...) {
+    tx->rollback();
+    delete tx;
+    f.close();
+    throw;
+  }
+  txid_t txid = tx->meta()->txid;
+  tx->rollback();
+  delete tx;
+  f.close();
+  return txid;
+}
+
+// newest_txid returns the txid of the last commit.
+static txid_t newest_txid(DB *db) {
+  Tx *tx = db->begin(false);
+  txid_t txid = tx->meta()->txid;
+  tx->rollback();
+  delete tx;
+  return txid;
+}
+
+// Ensure that a full backup brought up to date by a chain of incremental
+// backups matches the source database.
+TEST(BackupTest, ApplyDeltas) {
+  Option option = DefaultOption;
+  option.PageLog = true;
+  DB *db = new DB(temp_file(), 0666, &option);
+  put_range(db, "widgets", 0, 1000, "v1");
+
+  std::string base = temp_file();
+  Tx *tx = db->begin(false);
+  txid_t since = tx->meta()->txid;
+  tx->copy_file(base, 0666);
+  tx->rollback();
+  delete tx;
+
+  // The first delta rewrites existing pages and grows the tree, the second
+  // adds a bucket.
+  put_range(db, "widgets", 500, 2000, std::string(100, 'x'));
+  std::string delta1 = temp_file();
+  txid_t txid = write_delta(db, delta1, since);
+  put_range(db, "gadgets", 0, 100, "v2");
+  std::string delta2 = temp_file();
+  write_delta(db, delta2, txid);
+
+  apply_deltas(base, {delta1, delta2});
+  DB *copy = new DB(base, 0666, nullptr);
+  ASSERT_EQ(contents(copy).size(), 2100);
+  ASSERT_EQ(contents(copy), contents(db));
+  delete copy;
+
+  // The deltas must be applied in order.
+  ASSERT_THROW(apply_deltas(base, {delta1}), DeltaMismatchException);
+  delete db;
+}
+
+// Ensure that a compacted copy is not accepted as the base of incremental
+// backups, whose pages only line up with a page by page copy.
+TEST(BackupTest, ApplyDeltasCompactedBase) {
+  Option option = DefaultOption;
+  option.PageLog = true;
+  DB *db = new DB(temp_file(), 0666, &option);
+  put_range(db, "widgets", 0, 1000, "v1");
+
+  std::string base = temp_file();
+  Tx *tx = db->begin(false);
+  txid_t since = tx->meta()->txid;
+  tx->copy_file(base, 0666, true);
+  tx->rollback();
+  delete tx;
+
+  put_range(db, "widgets", 500, 2000, "v2");
+  std::string delta = temp_file();
+  write_delta(db, delta, since);
+  ASSERT_THROW(apply_deltas(base, {delta}), DeltaMismatchException);
+
+  // The copy itself is left untouched.
+  DB *copy = new DB(base, 0666, nullptr);
+  ASSERT_EQ(contents(copy).size(), 1000);
+  delete copy;
+  delete db;
+}
+
+// Ensure that a delta is refused when the page log doesn't hold every commit
+// since the base, instead of silently missing pages.
+TEST(BackupTest, WriteDeltaUncovered) {
+  std::string path = temp_file();
+  DB *db = new DB(path, 0666, nullptr);
+  put_range(db, "widgets", 0, 100, "v1");
+  txid_t since = newest_txid(db);
+  put_range(db, "widgets", 100, 200, "v2");
+  delete db;
+
+  // The log is enabled after since.
+  Option option = DefaultOption;
+  option.PageLog = true;
+  db = new DB(path, 0666, &option);
+  txid_t start = newest_txid(db);
+  put_range(db, "widgets", 200, 300, "v3");
+  std::string delta = temp_file();
+  ASSERT_THROW(write_delta(db, delta, since), DeltaMismatchException);
+  write_delta(db, delta, start);
+
+  // The log is trimmed past since.
+  txid_t trimmed = newest_txid(db);
+  put_range(db, "widgets", 300, 400, "v4");
+  db->trim_page_log(trimmed);
+  ASSERT_THROW(write_delta(db, delta, start), DeltaMismatchException);
+  write_delta(db, delta, trimmed);
+  delete db;
+
+  // Commits are made while the log is disabled.
+  db = new DB(path, 0666, nullptr);
+  put_range(db, "widgets", 400, 500, "v5");
+  delete db;
+  db = new DB(path, 0666, &option);
+  ASSERT_THROW(write_delta(db, delta, trimmed), DeltaMismatchException);
+  delete db;
+}
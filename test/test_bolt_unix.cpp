@@ -1,6 +1,11 @@
 #include "bolt/bolt_unix.h"
 #include "bolt/db.h"
+#include "util.h"
+#include <fcntl.h>
 #include <gtest/gtest.h>
+#include <string>
+#include <system_error>
+#include <unistd.h>
 
 /*
 TEST(MmapDBTest, MmapFunc) {
@@ -8,3 +13,30 @@ TEST(MmapDBTest, MmapFunc) {
     mmap(&db, 10000);
 }
 */
+
+// Ensure that copy_range copies from the given offset and that a bad file
+// descriptor is reported instead of being taken for a missing syscall.
+TEST(BoltUnixTest, CopyRange) {
+  std::string src_path = temp_file(), dst_path = temp_file();
+  int src = ::open(src_path.c_str(), O_RDWR | O_CREAT, 0666);
+  int dst = ::open(dst_path.c_str(), O_RDWR | O_CREAT, 0666);
+  ASSERT_EQ(::write(src, "0123456789", 10), 10);
+
+  std::int64_t off = 2;
+  ASSERT_EQ(copy_range(src, &off, dst, 5), 5);
+  ASSERT_EQ(off, 7);
+  char buf[8] = {};
+  ASSERT_EQ(::pread(dst, buf, sizeof(buf), 0), 5);
+  ASSERT_EQ(std::string(buf), "23456");
+
+  ::close(dst);
+  try {
+    copy_range(src, &off, dst, 3);
+    FAIL() << "expected std::system_error";
+  } catch (std::system_error &e) {
+    ASSERT_EQ(e.code().value(), EBADF);
+  }
+  ::close(src);
+  ::unlink(src_path.c_str());
+  ::unlink(dst_path.c_str());
+}
@@ -0,0 +1,691 @@
+#include "bolt/bucket.h"
+#include "bolt/exception.h"
+#include "bolt/page.h"
+#include "bolt/tx.h"
+#include "util.h"
+#include <algorithm>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+// Ensure that a bucket can write and read back values and that a missing
+// key reads as empty.
+TEST(BucketTest, PutGet) {
+  DB *db = must_open_db();
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  ASSERT_NE(b, nullptr);
+
+  b->put("foo", "bar");
+  b->put("baz", "bat");
+  ASSERT_EQ(b->get("foo").ToString(), "bar");
+  ASSERT_EQ(b->get("baz").ToString(), "bat");
+  ASSERT_TRUE(b->get("no such key").empty());
+
+  // Overwrite a value.
+  b->put("foo", "qux");
+  ASSERT_EQ(b->get("foo").ToString(), "qux");
+
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that invalid keys and values are rejected.
+TEST(BucketTest, PutErrors) {
+  DB *db = must_open_db();
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+
+  ASSERT_THROW(b->put("", "bar"), KeyRequiredException);
+  std::string key(MaxKeySize + 1, 'k');
+  ASSERT_THROW(b->put(Slice(key.data(), key.size()), "bar"), KeyTooLargeException);
+
+  // A key holding a nested bucket can't be overwritten by a value.
+  b->create_bucket("nested");
+  ASSERT_THROW(b->put("nested", "bar"), IncompatibleValueException);
+  ASSERT_THROW(b->delete_by_key("nested"), IncompatibleValueException);
+
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that a deleted key can't be read back and that deleting a missing
+// key does nothing.
+TEST(BucketTest, Delete) {
+  DB *db = must_open_db();
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  b->put("foo", "bar");
+  b->delete_by_key("foo");
+  ASSERT_TRUE(b->get("foo").empty());
+  ASSERT_NO_THROW(b->delete_by_key("foo"));
+
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that buckets are found by name, can't be created twice and are
+// only created once by create_bucket_if_not_exists.
+TEST(BucketTest, CreateBucket) {
+  DB *db = must_open_db();
+  Tx *tx = db->begin(true);
+  ASSERT_EQ(tx->bucket("widgets"), nullptr);
+  Bucket *b = tx->create_bucket("widgets");
+  ASSERT_EQ(tx->bucket("widgets"), b);
+  ASSERT_THROW(tx->create_bucket("widgets"), BucketExistsException);
+  ASSERT_THROW(tx->create_bucket(""), BucketNameRequiredException);
+  ASSERT_EQ(tx->create_bucket_if_not_exists("widgets"), b);
+
+  // Values and buckets share the key space.
+  b->put("foo", "bar");
+  ASSERT_THROW(b->create_bucket("foo"), IncompatibleValueException);
+  ASSERT_EQ(b->bucket("foo"), nullptr);
+
+  // A nested bucket isn't returned as a value.
+  Bucket *child = b->create_bucket_if_not_exists("child");
+  ASSERT_NE(child, nullptr);
+  ASSERT_TRUE(b->get("child").empty());
+  child->put("baz", "bat");
+  ASSERT_EQ(b->bucket("child")->get("baz").ToString(), "bat");
+
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that writes require a writable transaction.
+TEST(BucketTest, ReadOnly) {
+  DB *db = must_open_db();
+  Tx *tx = db->begin(false);
+  ASSERT_THROW(tx->create_bucket("widgets"), TxNotWritableException);
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that the sequence of a bucket counts up from zero.
+TEST(BucketTest, NextSequence) {
+  DB *db = must_open_db();
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  ASSERT_EQ(b->sequence(), 0u);
+  ASSERT_EQ(b->next_sequence(), 1u);
+  ASSERT_EQ(b->next_sequence(), 2u);
+  b->set_sequence(1000);
+  ASSERT_EQ(b->next_sequence(), 1001u);
+
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that for_each visits the keys in order and passes nested buckets
+// with an empty value.
+TEST(BucketTest, ForEach) {
+  DB *db = must_open_db();
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  b->put("foo", "0000");
+  b->put("baz", "0001");
+  b->create_bucket("bar");
+
+  std::vector<std::string> keys, values;
+  b->for_each([&](Slice k, Slice v) {
+    keys.push_back(k.ToString());
+    values.push_back(v.ToString());
+  });
+  ASSERT_EQ(keys, (std::vector<std::string>{"bar", "baz", "foo"}));
+  ASSERT_EQ(values, (std::vector<std::string>{"", "0001", "0000"}));
+
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// slice refers to the bytes of s.
+static Slice slice(const std::string &s) { return Slice(s.data(), s.size()); }
+
+// key returns a key of the given length for id n, padded after the id so
+// that neighbouring keys differ early.
+static std::string key(int n, size_t size = 8) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "%08d", n);
+  std::string k(buf);
+  k.resize(std::max(size, k.size()), 'x');
+  return k;
+}
+
+// Ensure that committed values, including nested buckets both inline and
+// on their own pages, can be read back after the database is reopened.
+TEST(BucketTest, CommitReopen) {
+  std::string path = temp_file();
+  DB *db = new DB(path, 0666, nullptr);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 2000; i++) {
+    keys.push_back(key(i));
+  }
+
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  for (int i = 0; i < 1000; i++) {
+    b->put(slice(keys[i]), slice(keys[i]));
+  }
+  b->create_bucket("small")->put("foo", "bar");
+  Bucket *large = b->create_bucket("large");
+  for (int i = 0; i < 1000; i++) {
+    large->put(slice(keys[i]), slice(keys[i]));
+  }
+  tx->commit();
+  delete tx;
+
+  // Update a committed tree in a second transaction.
+  tx = db->begin(true);
+  b = tx->bucket("widgets");
+  ASSERT_NE(b, nullptr);
+  for (int i = 1000; i < 2000; i++) {
+    b->put(slice(keys[i]), slice(keys[i]));
+  }
+  tx->commit();
+  delete tx;
+  delete db;
+
+  db = new DB(path, 0666, nullptr);
+  tx = db->begin(false);
+  b = tx->bucket("widgets");
+  ASSERT_NE(b, nullptr);
+  for (int i = 0; i < 2000; i++) {
+    ASSERT_EQ(b->get(slice(keys[i])).ToString(), keys[i]);
+  }
+  ASSERT_EQ(b->bucket("small")->get("foo").ToString(), "bar");
+  ASSERT_TRUE(b->bucket("small")->inline_());
+  Bucket *large2 = b->bucket("large");
+  ASSERT_FALSE(large2->inline_());
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(large2->get(slice(keys[i])).ToString(), keys[i]);
+  }
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that a split stores the shortest separator of two leaves in their
+// parent rather than the whole first key of the right leaf.
+TEST(BucketTest, CommitShortestSeparators) {
+  DB *db = must_open_db();
+  std::vector<std::string> keys;
+  for (int i = 0; i < 200; i++) {
+    keys.push_back(key(i, 200));
+  }
+
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  for (auto &k : keys) {
+    b->put(slice(k), "v");
+  }
+  tx->commit();
+  delete tx;
+
+  tx = db->begin(false);
+  b = tx->bucket("widgets");
+  Page *root = tx->page(b->root());
+  ASSERT_TRUE(root->flags() & BranchPageFlag);
+  ASSERT_GT(root->count(), 2u);
+  for (std::uint32_t i = 1; i < root->count(); i++) {
+    // Keys share no more than 8 bytes, so a separator needs at most 8.
+    ASSERT_LE(root->branchPageElement(i)->ksize, 8u);
+  }
+  for (auto &k : keys) {
+    ASSERT_EQ(b->get(slice(k)).ToString(), "v");
+  }
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that deleting most keys merges the leaves they emptied.
+TEST(BucketTest, CommitRebalance) {
+  DB *db = must_open_db();
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(key(i, 64));
+  }
+
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  for (auto &k : keys) {
+    b->put(slice(k), "v");
+  }
+  tx->commit();
+  delete tx;
+
+  tx = db->begin(true);
+  b = tx->bucket("widgets");
+  int leaves = b->stats().leaf_page_n;
+  for (int i = 0; i < 1000; i++) {
+    if (i % 50 != 0) {
+      b->delete_by_key(slice(keys[i]));
+    }
+  }
+  tx->commit();
+  ASSERT_GT(tx->stats().rebalance, 0);
+  delete tx;
+
+  tx = db->begin(false);
+  b = tx->bucket("widgets");
+  ASSERT_LT(b->stats().leaf_page_n, leaves);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(b->get(slice(keys[i])).empty(), i % 50 != 0);
+  }
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// RebalanceTest fills a bucket with half full leaves and deletes keys from
+// every leaf under a given rebalance policy.
+class RebalanceTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    db = must_open_db();
+    for (int i = 0; i < 1000; i++) {
+      keys.push_back(key(i, 64));
+    }
+    Tx *tx = db->begin(true);
+    Bucket *b = tx->create_bucket("widgets");
+    for (auto &k : keys) {
+      b->put(slice(k), "v");
+    }
+    tx->commit();
+    delete tx;
+    leaves = leaf_count();
+  }
+
+  void TearDown() override { delete db; }
+
+  // remove deletes the keys whose index modulo 4 is r and commits.
+  void remove(int r, const RebalancePolicy &policy) {
+    Tx *tx = db->begin(true);
+    Bucket *b = tx->bucket("widgets");
+    b->rebalancePolicy = policy;
+    for (int i = r; i < static_cast<int>(keys.size()); i += 4) {
+      b->delete_by_key(slice(keys[i]));
+    }
+    tx->commit();
+    delete tx;
+  }
+
+  int leaf_count() {
+    Tx *tx = db->begin(false);
+    int n = tx->bucket("widgets")->stats().leaf_page_n;
+    tx->rollback();
+    delete tx;
+    return n;
+  }
+
+  DB *db;
+  std::vector<std::string> keys;
+  int leaves;
+};
+
+// Ensure that leaves that stay above MergePercent are left alone and that
+// those below it are merged.
+TEST_F(RebalanceTest, MergePercent) {
+  ASSERT_GT(leaves, 10);
+  remove(0, DefaultRebalancePolicy);
+  ASSERT_EQ(leaf_count(), leaves);
+
+  remove(1, {/* .MergePercent */ 0.45, /* .MaxMergePercent */ 0, /* .Lazy */ false});
+  ASSERT_LT(leaf_count(), leaves);
+}
+
+// Ensure that merges which would produce a node above MaxMergePercent are
+// skipped.
+TEST_F(RebalanceTest, MaxMergePercent) {
+  remove(0, {/* .MergePercent */ 0.45, /* .MaxMergePercent */ 0.5, /* .Lazy */ false});
+  ASSERT_EQ(leaf_count(), leaves);
+
+  remove(1, {/* .MergePercent */ 0.45, /* .MaxMergePercent */ 0.9, /* .Lazy */ false});
+  ASSERT_LT(leaf_count(), leaves);
+}
+
+// Ensure that a lazy policy only merges nodes that were already below
+// MergePercent when the transaction read them.
+TEST_F(RebalanceTest, Lazy) {
+  RebalancePolicy lazy = {/* .MergePercent */ 0.45, /* .MaxMergePercent */ 0, /* .Lazy */ true};
+  remove(0, lazy);
+  ASSERT_EQ(leaf_count(), leaves);
+
+  remove(1, lazy);
+  ASSERT_LT(leaf_count(), leaves);
+}
+
+// Ensure that the stats of a bucket small enough to be inline only count
+// its inline page.
+TEST(BucketTest, StatsSmall) {
+  DB *db = must_open_db();
+  Tx *tx = db->begin(true);
+  tx->create_bucket("widgets")->put("foo", "bar");
+  tx->commit();
+  delete tx;
+
+  tx = db->begin(false);
+  BucketStats s = tx->bucket("widgets")->stats();
+  ASSERT_EQ(s.branch_page_n, 0);
+  ASSERT_EQ(s.leaf_page_n, 0);
+  ASSERT_EQ(s.key_n, 1);
+  ASSERT_EQ(s.depth, 1);
+  ASSERT_EQ(s.bucket_n, 1);
+  ASSERT_EQ(s.inline_bucket_n, 1);
+  ASSERT_EQ(s.inline_bucket_inuse, static_cast<std::int64_t>(pageHeaderSize + leafPageElementSize + 6));
+  ASSERT_EQ(s.leaf_inuse, 0);
+  ASSERT_EQ(s.leaf_alloc, 0);
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that the stats of a bucket account for its pages and those of its
+// nested buckets, both inline and on their own pages.
+TEST(BucketTest, Stats) {
+  DB *db = must_open_db();
+  std::vector<std::string> keys;
+  for (int i = 0; i < 500; i++) {
+    keys.push_back(key(i));
+  }
+  std::string value(100, 'v');
+
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  Bucket *large = b->create_bucket("large");
+  for (auto &k : keys) {
+    b->put(slice(k), slice(value));
+    large->put(slice(k), slice(value));
+  }
+  b->create_bucket("small")->put("foo", "bar");
+  tx->commit();
+  delete tx;
+
+  tx = db->begin(false);
+  BucketStats s = tx->bucket("widgets")->stats();
+  int page_size = db->page_size();
+  ASSERT_EQ(s.bucket_n, 3);
+  ASSERT_EQ(s.inline_bucket_n, 1);
+  ASSERT_EQ(s.key_n, 500 + 2 + 500 + 1);
+  ASSERT_EQ(s.depth, 2);
+  ASSERT_EQ(s.branch_page_n, 2);
+  ASSERT_GT(s.leaf_page_n, 2);
+  ASSERT_EQ(s.branch_alloc, static_cast<std::int64_t>(s.branch_page_n + s.branch_overflow_n) * page_size);
+  ASSERT_EQ(s.leaf_alloc, static_cast<std::int64_t>(s.leaf_page_n + s.leaf_overflow_n) * page_size);
+  ASSERT_GE(s.leaf_inuse, 2 * 500 * static_cast<std::int64_t>(leafPageElementSize + 8 + value.size()));
+  ASSERT_LE(s.leaf_inuse, s.leaf_alloc);
+  ASSERT_GT(s.fill_ratio(), 0);
+  ASSERT_LE(s.fill_ratio(), 1);
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that walking the subtrees of a large bucket on several threads gives
+// the same stats as a single walk.
+TEST(BucketTest, StatsParallel) {
+  DB *db = must_open_db();
+  std::vector<std::string> keys, names;
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(key(i));
+    names.push_back(keys.back() + "/");
+  }
+  std::string value(200, 'v');
+
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  for (int i = 0; i < 1000; i++) {
+    b->put(slice(keys[i]), slice(value));
+
+    // Spread nested buckets, some inline, over the subtrees.
+    if (i % 100 == 50) {
+      Bucket *child = b->create_bucket(slice(names[i]));
+      for (int j = 0; j < (i / 100) * 10; j++) {
+        child->put(slice(keys[j]), slice(value));
+      }
+    }
+  }
+  tx->commit();
+  delete tx;
+
+  tx = db->begin(false);
+  b = tx->bucket("widgets");
+  ASSERT_GE(static_cast<int>(tx->page(b->root())->count()), ParallelStatsMinChildren);
+  BucketStats serial = b->stats(1);
+  ASSERT_EQ(serial.key_n, 1000 + 10 + 450);
+  ASSERT_GT(serial.inline_bucket_n, 0);
+  ASSERT_LT(serial.inline_bucket_n, 10);
+  for (int threads : {2, 4, 16}) {
+    BucketStats s = b->stats(threads);
+    ASSERT_EQ(s.branch_page_n, serial.branch_page_n);
+    ASSERT_EQ(s.branch_overflow_n, serial.branch_overflow_n);
+    ASSERT_EQ(s.leaf_page_n, serial.leaf_page_n);
+    ASSERT_EQ(s.leaf_overflow_n, serial.leaf_overflow_n);
+    ASSERT_EQ(s.key_n, serial.key_n);
+    ASSERT_EQ(s.depth, serial.depth);
+    ASSERT_EQ(s.branch_alloc, serial.branch_alloc);
+    ASSERT_EQ(s.branch_inuse, serial.branch_inuse);
+    ASSERT_EQ(s.leaf_alloc, serial.leaf_alloc);
+    ASSERT_EQ(s.leaf_inuse, serial.leaf_inuse);
+    ASSERT_EQ(s.bucket_n, serial.bucket_n);
+    ASSERT_EQ(s.inline_bucket_n, serial.inline_bucket_n);
+    ASSERT_EQ(s.inline_bucket_inuse, serial.inline_bucket_inuse);
+  }
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// expect_get_many checks that get_many() agrees with get() for every key, in
+// the order they were requested.
+static void expect_get_many(Bucket *b, const std::vector<std::string> &requested) {
+  std::vector<Slice> keys;
+  for (auto &k : requested) {
+    keys.push_back(slice(k));
+  }
+  std::vector<std::optional<Slice>> values;
+  b->get_many(keys, &values);
+  ASSERT_EQ(values.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    Slice v = b->get(keys[i]);
+    if (v.empty()) {
+      ASSERT_FALSE(values[i]) << requested[i];
+    } else {
+      ASSERT_TRUE(values[i]) << requested[i];
+      ASSERT_EQ(values[i]->ToString(), v.ToString()) << requested[i];
+    }
+  }
+}
+
+// Ensure that get_many() returns values in request order across a tree of
+// several levels, for committed pages and dirty nodes alike, and whatever
+// order the bucket's keys sort in.
+TEST(BucketTest, GetMany) {
+  DB *db = must_open_db();
+  std::vector<std::string> keys, values;
+  for (int i = 0; i < 20000; i++) {
+    keys.push_back(key(i * 2));
+    values.push_back(std::to_string(i));
+  }
+
+  std::string nested = keys[0] + "/";
+  Tx *tx = db->begin(true);
+  tx->create_bucket("widgets")->create_bucket(slice(nested));
+  tx->create_bucket<ReverseBytewiseComparator>("reversed");
+  tx->commit();
+  delete tx;
+
+  // Load the keys over several commits, which keeps each split small.
+  Bucket *b, *r;
+  for (size_t i = 0; i < keys.size(); i += 2000) {
+    tx = db->begin(true);
+    b = tx->bucket("widgets");
+    r = tx->bucket("reversed");
+    for (size_t j = i; j < i + 2000; j++) {
+      b->put(slice(keys[j]), slice(values[j]));
+      r->put(slice(keys[j]), slice(values[j]));
+    }
+    tx->commit();
+    delete tx;
+  }
+
+  // Ask for present keys, missing keys in between, before and after them,
+  // duplicates and a nested bucket, shuffled.
+  std::vector<std::string> requested = {"", "0", "~", nested, keys[5], keys[5]};
+  std::mt19937 rng(42);
+  for (int i = 0; i < 1000; i++) {
+    int n = rng() % 40000;
+    requested.push_back(key(n));
+    requested.push_back(key(n) + "0");
+  }
+  std::shuffle(requested.begin(), requested.end(), rng);
+
+  tx = db->begin(false);
+  b = tx->bucket("widgets");
+  BucketStats s = b->stats();
+  ASSERT_GE(s.depth, 3);
+  expect_get_many(b, requested);
+  expect_get_many(b, keys);
+  expect_get_many(tx->bucket("reversed"), requested);
+  tx->rollback();
+  delete tx;
+
+  // Dirty nodes are looked up through the same cursor.
+  tx = db->begin(true);
+  b = tx->bucket("widgets");
+  r = tx->bucket("reversed");
+  for (int i = 0; i < 20000; i += 3) {
+    b->delete_by_key(slice(keys[i]));
+    r->delete_by_key(slice(keys[i]));
+  }
+  expect_get_many(b, requested);
+  expect_get_many(r, requested);
+
+  std::vector<std::optional<Slice>> empty;
+  b->get_many({}, &empty);
+  ASSERT_TRUE(empty.empty());
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that delete_range over a multi-level bucket drops the subtrees inside
+// the range by page, and that the remaining keys survive the commit.
+TEST(BucketTest, DeleteRange) {
+  DB *db = must_open_db();
+  std::vector<std::string> keys;
+  for (int i = 0; i < 20000; i++) {
+    keys.push_back(key(i));
+  }
+  Tx *tx = db->begin(true);
+  tx->create_bucket("widgets");
+  tx->commit();
+  delete tx;
+  for (size_t i = 0; i < keys.size(); i += 2000) {
+    tx = db->begin(true);
+    Bucket *b = tx->bucket("widgets");
+    for (size_t j = i; j < i + 2000; j++) {
+      b->put(slice(keys[j]), slice(keys[j]));
+    }
+    tx->commit();
+    delete tx;
+  }
+
+  tx = db->begin(false);
+  BucketStats before = tx->bucket("widgets")->stats();
+  ASSERT_GE(before.depth, 3);
+  tx->rollback();
+  delete tx;
+  Stats db_before = db->stats();
+
+  tx = db->begin(true);
+  tx->bucket("widgets")->delete_range(slice(keys[1000]), slice(keys[15000]));
+  tx->commit();
+  // Only the nodes along the paths to both ends were read and rebalanced.
+  ASSERT_LT(tx->stats().rebalance, 20);
+  delete tx;
+
+  tx = db->begin(false);
+  Bucket *b = tx->bucket("widgets");
+  BucketStats after = b->stats();
+  ASSERT_EQ(after.key_n, 6000);
+  for (int i = 0; i < 20000; i += 7) {
+    std::string v = b->get(slice(keys[i])).ToString();
+    ASSERT_EQ(v, i >= 1000 && i < 15000 ? "" : keys[i]) << i;
+  }
+  tx->rollback();
+  delete tx;
+
+  // Every dropped leaf went to the freelist.
+  Stats db_after = db->stats();
+  int freed = db_after.free_page_n + db_after.pending_page_n - db_before.free_page_n - db_before.pending_page_n;
+  ASSERT_GT(before.leaf_page_n - after.leaf_page_n, 50);
+  ASSERT_GE(freed, before.leaf_page_n - after.leaf_page_n);
+  delete db;
+}
+
+// Ensure that the pages a nested bucket dropped, and the nested buckets it
+// deleted, are freed only once when the bucket itself is deleted by the same
+// transaction.
+TEST(BucketTest, DeleteRangeThenDeleteBucket) {
+  Option option = DefaultOption;
+  option.ReclaimBudget = 16;
+  DB *db = new DB(temp_file(), 0666, &option);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 5000; i++) {
+    keys.push_back(key(i));
+  }
+  Tx *tx = db->begin(true);
+  Bucket *child = tx->create_bucket("widgets")->create_bucket("child");
+  for (auto &k : keys) {
+    child->put(slice(k), slice(k));
+  }
+  Bucket *grandchild = child->create_bucket("grandchild");
+  for (auto &k : keys) {
+    grandchild->put(slice(k), slice(k));
+  }
+  tx->commit();
+  delete tx;
+
+  tx = db->begin(false);
+  BucketStats s = tx->bucket("widgets")->bucket("child")->stats();
+  int pages = s.branch_page_n + s.leaf_page_n;
+  ASSERT_GE(s.depth, 2);
+  tx->rollback();
+  delete tx;
+  Stats before = db->stats();
+
+  tx = db->begin(true);
+  Bucket *widgets = tx->bucket("widgets");
+  child = widgets->bucket("child");
+  child->delete_range(slice(keys[500]), slice(keys[4500]));
+  child->delete_bucket("grandchild");
+  widgets->delete_bucket("child");
+  tx->commit();
+  delete tx;
+
+  // Every page of both buckets is reclaimed by the following commits.
+  for (int i = 0; i < pages; i++) {
+    tx = db->begin(true);
+    tx->commit();
+    delete tx;
+  }
+  Stats after = db->stats();
+  int freed = after.free_page_n + after.pending_page_n - before.free_page_n - before.pending_page_n;
+  ASSERT_GE(freed, pages);
+
+  tx = db->begin(false);
+  ASSERT_EQ(tx->bucket("widgets")->bucket("child"), nullptr);
+  tx->rollback();
+  delete tx;
+  delete db;
+}
@@ -0,0 +1,128 @@
+#include "bolt/bucket.h"
+#include "bolt/page.h"
+#include "bolt/tx.h"
+#include "bolt/u64_keys.h"
+#include "util.h"
+#include <algorithm>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// dump appends every key/value pair under a bucket, including the ones of its
+// nested buckets, keyed by their path.
+static void dump(Bucket *b, const std::string &prefix, std::map<std::string, std::string> &m) {
+  b->for_each([&](Slice k, Slice v) {
+    std::string path = prefix + "/" + k.ToString();
+    if (Bucket *child = b->bucket(k)) {
+      dump(child, path, m);
+    } else {
+      m[path] = v.ToString();
+    }
+  });
+}
+
+// last_page returns the highest pgid used by the tree under a page.
+static pgid_t last_page(Tx *tx, pgid_t id) {
+  Page *p = tx->page(id);
+  pgid_t last = p->id() + p->overflow();
+  for (std::uint32_t i = 0; (p->flags() & BranchPageFlag) && i < p->count(); i++) {
+    last = std::max(last, last_page(tx, p->branchPageElement(i)->id));
+  }
+  return last;
+}
+
+// contents returns every key/value pair of a database.
+static std::map<std::string, std::string> contents(DB *db) {
+  std::map<std::string, std::string> m;
+  Tx *tx = db->begin(false);
+  tx->for_each([&](Slice name, Bucket *b) { dump(b, name.ToString(), m); });
+  tx->rollback();
+  delete tx;
+  return m;
+}
+
+// Ensure that a compacted copy reopens with the same contents as the source,
+// lays every bucket out before its nested buckets and accepts new commits.
+TEST(CompactTest, CopyFileReopen) {
+  DB *db = must_open_db();
+  std::vector<std::string> keys;
+  keys.reserve(3000);
+  auto key = [&](const char *fmt, int i) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), fmt, i);
+    keys.emplace_back(buf);
+    return Slice(keys.back().data(), keys.back().size());
+  };
+
+  // The nested buckets sit between the keys of their parent: a large one, an
+  // inline one and one with integer keys.
+  Tx *tx = db->begin(true);
+  Bucket *widgets = tx->create_bucket("widgets");
+  for (int i = 0; i < 1000; i++) {
+    widgets->put(key("%08d", i), "0123456789abcdef");
+  }
+  Bucket *large = widgets->create_bucket("00000500x");
+  for (int i = 0; i < 500; i++) {
+    large->put(key("k%06d", i), "0123456789abcdef");
+  }
+  widgets->create_bucket("00000600x")->put("foo", "bar");
+  Bucket *ints = widgets->create_bucket("00000700x", BucketU64KeysFlag);
+  for (int i = 0; i < 500; i++) {
+    char buf[U64KeySize];
+    keys.emplace_back(encode_u64_key(i, buf).ToString());
+    ints->put(Slice(keys.back().data(), keys.back().size()), "v");
+  }
+  tx->commit();
+  delete tx;
+
+  // Leave free pages behind for the compaction to drop.
+  tx = db->begin(true);
+  widgets = tx->bucket("widgets");
+  for (int i = 0; i < 1000; i += 2) {
+    widgets->delete_by_key(key("%08d", i));
+  }
+  tx->commit();
+  delete tx;
+
+  std::string path = temp_file();
+  tx = db->begin(false);
+  txid_t txid = tx->meta()->txid;
+  std::int64_t size = tx->size();
+  tx->copy_file(path, 0666, true);
+  tx->rollback();
+  delete tx;
+
+  DB *copy = new DB(path, 0666, nullptr);
+  ASSERT_EQ(contents(copy).size(), 500 + 500 + 1 + 500);
+  ASSERT_EQ(contents(copy), contents(db));
+
+  // The copy is at the source's txid, is smaller, and the pages of the parent
+  // come before the ones of its nested buckets.
+  tx = copy->begin(false);
+  ASSERT_EQ(tx->meta()->txid, txid);
+  ASSERT_LT(tx->size(), size);
+  widgets = tx->bucket("widgets");
+  pgid_t last = last_page(tx, widgets->root());
+  ASSERT_GT(widgets->bucket("00000500x")->root(), last);
+  ASSERT_GT(widgets->bucket("00000700x")->root(), last);
+  tx->rollback();
+  delete tx;
+
+  // The copy can be written to and reopened.
+  tx = copy->begin(true);
+  tx->bucket("widgets")->bucket("00000500x")->put("new", "value");
+  tx->commit();
+  delete tx;
+  delete copy;
+
+  copy = new DB(path, 0666, nullptr);
+  tx = copy->begin(false);
+  ASSERT_EQ(tx->bucket("widgets")->bucket("00000500x")->get("new").ToString(), "value");
+  ASSERT_EQ(tx->bucket("widgets")->bucket("00000600x")->get("foo").ToString(), "bar");
+  tx->rollback();
+  delete tx;
+  delete copy;
+  delete db;
+}
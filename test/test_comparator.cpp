@@ -0,0 +1,57 @@
+#include "bolt/comparator.h"
+#include "bolt/node.h"
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <vector>
+
+// Ensure that the built-in comparators order keys as documented.
+TEST(ComparatorTest, CompareFunc) {
+  ASSERT_LT(BytewiseComparator::compare("a", "b"), 0);
+  ASSERT_GT(ReverseBytewiseComparator::compare("a", "b"), 0);
+  ASSERT_LT(ReverseBytewiseComparator::compare("ab", "a"), 0);
+
+  ASSERT_EQ(CaseInsensitiveComparator::compare("Key", "kEY"), 0);
+  ASSERT_LT(CaseInsensitiveComparator::compare("apple", "Banana"), 0);
+  ASSERT_LT(CaseInsensitiveComparator::compare("KEY", "keys"), 0);
+
+  std::uint64_t a = 255, b = 256;
+  Slice sa(reinterpret_cast<const char *>(&a), sizeof(a)), sb(reinterpret_cast<const char *>(&b), sizeof(b));
+  ASSERT_LT(NativeU64Comparator::compare(sa, sb), 0);
+  ASSERT_GT(NativeU64Comparator::compare(sb, sa), 0);
+  ASSERT_EQ(NativeU64Comparator::compare(sa, sa), 0);
+}
+
+// Ensure that a runtime id selects the comparator with that id.
+TEST(ComparatorTest, WithComparatorFunc) {
+  for (std::uint32_t id : {BytewiseComparator::id, ReverseBytewiseComparator::id, CaseInsensitiveComparator::id,
+                           NativeU64Comparator::id}) {
+    ASSERT_EQ(with_comparator(id, [](auto cmp) { return decltype(cmp)::id; }), id);
+  }
+}
+
+// Ensure that inodes are searched in the comparator's order.
+TEST(ComparatorTest, SearchInodesFunc) {
+  std::vector<INode> inodes(3);
+  inodes[0].key = "c";
+  inodes[1].key = "b";
+  inodes[2].key = "a";
+
+  auto r = search_inodes<ReverseBytewiseComparator>(inodes, "b");
+  ASSERT_EQ(r.first, 1u);
+  ASSERT_TRUE(r.second);
+
+  r = search_inodes<ReverseBytewiseComparator>(inodes, "bb");
+  ASSERT_EQ(r.first, 1u);
+  ASSERT_FALSE(r.second);
+
+  r = search_inodes<ReverseBytewiseComparator>(inodes, "0");
+  ASSERT_EQ(r.first, 3u);
+
+  inodes[0].key = "Apple";
+  inodes[1].key = "banana";
+  inodes[2].key = "Cherry";
+  r = search_inodes<CaseInsensitiveComparator>(inodes, "BANANA");
+  ASSERT_EQ(r.first, 1u);
+  ASSERT_TRUE(r.second);
+}
@@ -11,4 +11,5 @@ TEST(CursorTest, BucketFunc) {
   std::cout << "TO test mustopen" << std::endl;
   DB *db = must_open_db();
   ASSERT_TRUE(db != nullptr);
+  delete db;
 }
\ No newline at end of file
@@ -1,6 +1,20 @@
+#include "bolt/bucket.h"
+#include "bolt/exception.h"
+#include "bolt/meta.h"
+#include "bolt/page.h"
 #include "bolt/tx.h"
 #include "util.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fcntl.h>
+#include <functional>
+#include <future>
 #include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 /*
 TEST(DBTest, Begin_DatabaseNotOpenException) {
@@ -18,4 +32,228 @@ TEST(DBTest, BeginRW) {
   ASSERT_TRUE(tx->writable());
 
   tx->commit();
-}
\ No newline at end of file
+  delete tx;
+  delete db;
+}
+
+// Ensure that an in-memory database doesn't create a file at its path.
+TEST(DBTest, OpenInMemory) {
+  std::string path = temp_file();
+  Option option = DefaultOption;
+  option.InMemory = true;
+  DB *db = new DB(path, 0666, &option);
+  ASSERT_NE(::access(path.c_str(), F_OK), 0);
+
+  Tx *tx = db->begin(true);
+  ASSERT_TRUE(tx->writable());
+  tx->commit();
+  delete tx;
+  delete db;
+}
+
+// Ensure that a small initial mmap size, including the default of 0, is
+// rounded up to the minimum mapping for files and in-memory databases.
+TEST(DBTest, OpenInitialMmapSize) {
+  for (bool in_memory : {false, true}) {
+    for (int sz : {0, 1, 1 << 20}) {
+      Option option = DefaultOption;
+      option.InMemory = in_memory;
+      option.InitialMmapSize = sz;
+      DB *db = new DB(temp_file(), 0666, &option);
+      Tx *tx = db->begin(false);
+      ASSERT_EQ(tx->meta()->pgid, 4u);
+      tx->rollback();
+      delete tx;
+      delete db;
+    }
+  }
+}
+
+// Ensure that a database can be created with a larger page size, which it
+// keeps when it is reopened.
+TEST(DBTest, OpenPageSize) {
+  std::string path = temp_file();
+  Option option = DefaultOption;
+  option.PageSize = 16 * 1024;
+  DB *db = new DB(path, 0666, &option);
+  ASSERT_EQ(db->page_size(), 16 * 1024);
+  delete db;
+
+  db = new DB(path, 0666, nullptr);
+  ASSERT_EQ(db->page_size(), 16 * 1024);
+  delete db;
+
+  option.PageSize = 32 * 1024;
+  ASSERT_THROW(new DB(path, 0666, &option), PageSizeMismatchException);
+}
+
+// Ensure that a file written with an older format version is rejected.
+TEST(DBTest, OpenVersionMismatch) {
+  std::string path = temp_file();
+  DB *db = new DB(path, 0666, nullptr);
+  int page_size = db->page_size();
+  delete db;
+
+  // Rewrite the version of both meta pages.
+  std::uint32_t version = 2;
+  int fd = ::open(path.c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  for (int i = 0; i < 2; i++) {
+    off_t off = i * page_size + pageHeaderSize + offsetof(Meta, version);
+    ASSERT_EQ(::pwrite(fd, &version, sizeof(version), off), sizeof(version));
+  }
+  ::close(fd);
+  ASSERT_THROW(new DB(path, 0666, nullptr), DatabaseVersionMismatchException);
+}
+
+// Ensure that commits write pages from the page pool, carved out of a huge
+// page arena, as well as overflow pages, which don't fit in a pooled buffer.
+TEST(DBTest, CommitHugePages) {
+  std::string path = temp_file();
+  Option option = DefaultOption;
+  option.HugePages = true;
+  DB *db = new DB(path, 0666, &option);
+  std::string large(3 * db->page_size(), 'x');
+  std::vector<std::string> keys;
+  keys.reserve(3000);
+  for (int n = 0; n < 3; n++) {
+    Tx *tx = db->begin(true);
+    Bucket *b = tx->create_bucket_if_not_exists("widgets");
+    for (int i = 0; i < 1000; i++) {
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "%d-%06d", n, i);
+      keys.emplace_back(buf);
+      b->put(Slice(keys.back().data(), keys.back().size()), "value");
+    }
+    b->put("large", Slice(large.data(), large.size()));
+    tx->commit();
+    delete tx;
+  }
+
+  // A rolled back transaction returns its pages too.
+  Tx *tx = db->begin(true);
+  tx->bucket("widgets")->put("foo", "bar");
+  tx->rollback();
+  delete tx;
+  delete db;
+
+  db = new DB(path, 0666, nullptr);
+  tx = db->begin(false);
+  Bucket *b = tx->bucket("widgets");
+  for (auto &k : keys) {
+    ASSERT_EQ(b->get(Slice(k.data(), k.size())).ToString(), "value");
+  }
+  ASSERT_EQ(b->get("large").size(), large.size());
+  ASSERT_TRUE(b->get("foo").empty());
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that the stats count read transactions while they are open and
+// merge the stats of commits, including from transactions on other threads.
+TEST(DBTest, Stats) {
+  DB *db = must_open_db();
+  Stats before = db->stats();
+
+  std::vector<Tx *> txs;
+  for (int i = 0; i < 3; i++) {
+    txs.push_back(db->begin(false));
+  }
+  Stats s = db->stats();
+  ASSERT_EQ(s.tx_n - before.tx_n, 3);
+  ASSERT_EQ(s.open_tx_n, 3);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([db] {
+      for (int i = 0; i < 100; i++) {
+        Tx *tx = db->begin(false);
+        tx->rollback();
+        delete tx;
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  // Readers opened on this thread may be closed on another one.
+  std::thread([&txs] {
+    for (Tx *tx : txs) {
+      tx->rollback();
+      delete tx;
+    }
+  }).join();
+  s = db->stats();
+  ASSERT_EQ(s.tx_n - before.tx_n, 403);
+  ASSERT_EQ(s.open_tx_n, 0);
+
+  // Write transactions aren't counted in tx_n but their stats are merged.
+  Tx *tx = db->begin(true);
+  tx->create_bucket("widgets")->put("foo", "bar");
+  tx->commit();
+  delete tx;
+  Stats after = db->stats();
+  ASSERT_EQ(after.tx_n, s.tx_n);
+  ASSERT_GT(after.tx_stats.page_count, s.tx_stats.page_count);
+  ASSERT_GT(after.tx_stats.write, s.tx_stats.write);
+  delete db;
+}
+
+// Ensure that opening a database locked by another handle times out, and
+// succeeds once the lock is released.
+TEST(DBTest, OpenTimeout) {
+  std::string path = temp_file();
+  DB *db = new DB(path, 0666, nullptr);
+
+  Option option = DefaultOption;
+  option.Timeout = 100;
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_THROW(new DB(path, 0666, &option), TimeoutException);
+  ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+  delete db;
+
+  db = new DB(path, 0666, &option);
+  delete db;
+}
+
+// Ensure that invalid page sizes are rejected.
+TEST(DBTest, OpenInvalidPageSize) {
+  Option option = DefaultOption;
+  option.PageSize = 12 * 1024;
+  ASSERT_THROW(new DB(temp_file(), 0666, &option), InvalidPageSizeException);
+  option.PageSize = 2 * MaxPageSize;
+  ASSERT_THROW(new DB(temp_file(), 0666, &option), InvalidPageSizeException);
+}
+
+// Ensure that a writer started asynchronously waits for the current writer
+// without blocking, and that its commit reports back through the executor.
+TEST(DBTest, BeginAsync) {
+  DB *db = must_open_db();
+  std::vector<std::function<void()>> queue;
+  Executor exec = [&queue](std::function<void()> fn) { queue.push_back(fn); };
+
+  Tx *tx = db->begin(true);
+  Tx *async_tx = nullptr;
+  db->begin_async(true, exec, [&async_tx](Tx *tx, std::exception_ptr err) {
+    ASSERT_FALSE(err);
+    async_tx = tx;
+  });
+  ASSERT_TRUE(queue.empty());
+
+  // Closing the first writer hands the lock over.
+  tx->commit();
+  ASSERT_EQ(queue.size(), 1u);
+  queue.front()();
+  ASSERT_NE(async_tx, nullptr);
+  ASSERT_TRUE(async_tx->writable());
+
+  std::promise<std::exception_ptr> committed;
+  async_tx->commit_async([](std::function<void()> fn) { fn(); },
+                         [&committed](std::exception_ptr err) { committed.set_value(err); });
+  ASSERT_FALSE(committed.get_future().get());
+  delete async_tx;
+  delete tx;
+  delete db;
+}
@@ -0,0 +1,145 @@
+#include "bolt/freelist.h"
+#include "bolt/page.h"
+#include <gtest/gtest.h>
+#include <new>
+#include <vector>
+
+// Ensure that a page is added to a transaction's freelist.
+TEST(FreeListTest, FreeFunc) {
+  FreeList f;
+  Page p(12, 0);
+  f.free(100, &p);
+  ASSERT_EQ(f.pending[100], std::vector<pgid_t>({12}));
+}
+
+// Ensure that a page and its overflow is added to a transaction's freelist.
+TEST(FreeListTest, FreeOverflow) {
+  FreeList f;
+  Page p(12, 0);
+  p.setOverflow(3);
+  f.free(100, &p);
+  ASSERT_EQ(f.pending[100], std::vector<pgid_t>({12, 13, 14, 15}));
+}
+
+// Ensure that a transaction's free pages can be released.
+TEST(FreeListTest, ReleaseFunc) {
+  FreeList f;
+  Page p12(12, 0), p9(9, 0), p39(39, 0);
+  p12.setOverflow(1);
+  f.free(100, &p12);
+  f.free(100, &p9);
+  f.free(102, &p39);
+  f.release(100);
+  f.release(101);
+  ASSERT_EQ(f.ids, std::vector<pgid_t>({9, 12, 13}));
+
+  f.release(102);
+  ASSERT_EQ(f.ids, std::vector<pgid_t>({9, 12, 13, 39}));
+}
+
+// Ensure that a freelist can find contiguous blocks of pages.
+TEST(FreeListTest, AllocateFunc) {
+  FreeList f;
+  f.ids = {3, 4, 5, 6, 7, 9, 12, 13, 18};
+  f.reindex();
+  ASSERT_EQ(f.allocate(1, 3), 3u);
+  ASSERT_EQ(f.allocate(1, 1), 6u);
+  ASSERT_EQ(f.allocate(1, 3), 0u);
+  ASSERT_EQ(f.allocate(1, 2), 12u);
+  ASSERT_EQ(f.allocate(1, 1), 7u);
+  ASSERT_EQ(f.allocate(1, 0), 0u);
+  ASSERT_EQ(f.allocate(1, 0), 0u);
+  ASSERT_EQ(f.ids, std::vector<pgid_t>({9, 18}));
+
+  ASSERT_EQ(f.allocate(1, 1), 9u);
+  ASSERT_EQ(f.allocate(1, 1), 18u);
+  ASSERT_EQ(f.allocate(1, 1), 0u);
+  ASSERT_TRUE(f.ids.empty());
+  ASSERT_FALSE(f.freed(9));
+}
+
+// Ensure that pages allocated and freed between two open readers are released
+// while pages an open reader can see are kept.
+TEST(FreeListTest, ReleaseRangeFunc) {
+  FreeList f;
+  f.ids = {3, 4, 5, 6, 7, 8};
+  f.reindex();
+
+  // Readers are open at txids 2 and 8.
+  ASSERT_EQ(f.allocate(1, 3), 3u); // pages 3-5: allocated at 1, freed at 4
+  ASSERT_EQ(f.allocate(3, 1), 6u); // page 6: allocated at 3, freed at 5
+  ASSERT_EQ(f.allocate(5, 1), 7u); // page 7: allocated at 5, freed at 9
+  ASSERT_EQ(f.allocate(9, 1), 8u); // page 8: allocated at 9, freed at 10
+  Page p3(3, 0), p6(6, 0), p7(7, 0), p8(8, 0);
+  p3.setOverflow(2);
+  f.free(4, &p3);
+  f.free(5, &p6);
+  f.free(9, &p7);
+  f.free(10, &p8);
+
+  // Reader 2 still sees pages 3-5, reader 8 sees page 7.
+  f.release_range(3, 7);
+  ASSERT_EQ(f.ids, std::vector<pgid_t>({6}));
+  f.release_range(9, 0xFFFFFFFFFFFFFFFF);
+  ASSERT_EQ(f.ids, std::vector<pgid_t>({6, 8}));
+  ASSERT_EQ(f.pending_count(), 4);
+
+  // Once the readers are gone everything is released.
+  f.release(10);
+  ASSERT_EQ(f.ids, std::vector<pgid_t>({3, 4, 5, 6, 7, 8}));
+  ASSERT_TRUE(f.allocs.empty());
+}
+
+// Ensure that rolling back a transaction drops its pending pages.
+TEST(FreeListTest, RollbackFunc) {
+  FreeList f;
+  Page p(12, 0);
+  f.free(100, &p);
+  ASSERT_TRUE(f.freed(12));
+  f.rollback(100);
+  ASSERT_FALSE(f.freed(12));
+  ASSERT_EQ(f.pending_count(), 0);
+}
+
+// Ensure that a freelist can serialize into a freelist page and back.
+TEST(FreeListTest, WriteReadFunc) {
+  FreeList f;
+  f.ids = {12, 39};
+  f.pending[100] = {28, 11};
+  f.pending[101] = {3};
+  ASSERT_EQ(f.count(), 5);
+
+  std::vector<char> buf(4096);
+  Page &p = *new (buf.data()) Page(0, 0);
+  f.write(&p);
+  ASSERT_EQ(p.flags(), FreelistPageFlag);
+
+  // Read the page back out. All pending ids become free.
+  FreeList f2;
+  f2.read(&p);
+  ASSERT_EQ(f2.ids, std::vector<pgid_t>({3, 11, 12, 28, 39}));
+}
+
+// Ensure that the orphan queue is saved with the freelist and read back.
+TEST(FreeListTest, WriteReadOrphans) {
+  FreeList f;
+  f.ids = {12, 39};
+  f.orphan(7);
+  f.orphan(21);
+
+  std::vector<char> buf(4096);
+  Page &p = *new (buf.data()) Page(0, 0);
+  f.write(&p);
+  ASSERT_EQ(p.flags(), FreelistPageFlag | FreelistOrphansPageFlag);
+  ASSERT_EQ(f.size(), static_cast<int>(pageHeaderSize + sizeof(pgid_t) * 5));
+
+  FreeList f2;
+  f2.read(&p);
+  ASSERT_EQ(f2.ids, std::vector<pgid_t>({12, 39}));
+  ASSERT_EQ(f2.orphans, std::vector<pgid_t>({7, 21}));
+
+  // Reloading the page, as a rollback does, restores the queue.
+  f2.orphans.pop_back();
+  f2.reload(&p);
+  ASSERT_EQ(f2.orphans, std::vector<pgid_t>({7, 21}));
+}
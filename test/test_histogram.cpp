@@ -0,0 +1,60 @@
+#include "bolt/histogram.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using std::chrono::microseconds;
+
+TEST(HistogramTest, EmptyFunc) {
+  LatencyHistogram h;
+  LatencySnapshot s = h.snapshot();
+  ASSERT_EQ(s.count, 0);
+  ASSERT_EQ(s.p50.count(), 0);
+  ASSERT_EQ(s.max.count(), 0);
+}
+
+TEST(HistogramTest, PercentileFunc) {
+  LatencyHistogram h;
+  for (int i = 1; i <= 1000; i++) {
+    h.record(microseconds(i));
+  }
+  LatencySnapshot s = h.snapshot();
+  ASSERT_EQ(s.count, 1000);
+  ASSERT_EQ(s.max.count(), 1000);
+
+  // Reported percentiles are within 1/16 of the exact values.
+  ASSERT_GE(s.p50.count(), 500);
+  ASSERT_LE(s.p50.count(), 500 + 500 / 16);
+  ASSERT_GE(s.p99.count(), 990);
+  ASSERT_LE(s.p99.count(), 1000);
+  ASSERT_GE(s.p999.count(), 999);
+  ASSERT_LE(s.p999.count(), 1000);
+}
+
+TEST(HistogramTest, TailFunc) {
+  LatencyHistogram h;
+  for (int i = 0; i < 10000; i++) {
+    h.record(microseconds(10));
+  }
+  h.record(microseconds(5000000));
+  LatencySnapshot s = h.snapshot();
+  ASSERT_EQ(s.p50.count(), 10);
+  ASSERT_EQ(s.p999.count(), 10);
+  ASSERT_EQ(s.max.count(), 5000000);
+}
+
+TEST(HistogramTest, ConcurrentRecordFunc) {
+  LatencyHistogram h;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&h] {
+      for (int i = 0; i < 10000; i++) {
+        h.record(microseconds(i % 100));
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(h.snapshot().count, 40000);
+}
@@ -1,9 +1,13 @@
 #include "bolt/bucket.h"
+#include "bolt/exception.h"
 #include "bolt/node.h"
 #include "bolt/page.h"
 #include "bolt/tx.h"
-#include <cstdlib>
+#include "bolt/u64_keys.h"
+#include "util.h"
 #include <gtest/gtest.h>
+#include <new>
+#include <vector>
 
 void assert_value(Node *n, const char *key, const char *expected_value) {
   std::string value("");
@@ -12,10 +16,30 @@ void assert_value(Node *n, const char *key, const char *expected_value) {
   ASSERT_EQ(value, expected_value);
 }
 
-TEST(NodeTest, PutKey) {
-  Tx tx(nullptr);
-  Bucket bucket(&tx);
-  Node n(&bucket, true, nullptr);
+// NodeTest gives the nodes under test a bucket in a writable transaction of
+// a real database, which node operations reach for the meta and page size.
+class NodeTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    db = must_open_db();
+    tx = db->begin(true);
+    bucket = new Bucket(tx);
+  }
+
+  void TearDown() override {
+    delete bucket;
+    tx->rollback();
+    delete tx;
+    delete db;
+  }
+
+  DB *db;
+  Tx *tx;
+  Bucket *bucket;
+};
+
+TEST_F(NodeTest, PutKey) {
+  Node n(bucket, true, nullptr);
   n.put("aa", "aa", "value_aa", 1, 0);
   n.put("ab", "ab", "value_ab", 1, 0);
   ASSERT_EQ(n.numChildren(), 2);
@@ -38,16 +62,14 @@ TEST(NodeTest, PutKey) {
   ASSERT_EQ(n.numChildren(), 0);
 }
 
-TEST(NodeTest, WriteFunc) {
-  Tx tx(nullptr);
-  Bucket bucket(&tx);
-  Node n(&bucket, true, nullptr);
+TEST_F(NodeTest, WriteFunc) {
+  Node n(bucket, true, nullptr);
   n.put("a", "a", "value_a", 1, 0);
   n.put("ab", "ab", "value_ab", 1, 0);
   n.put("abc", "abc", "value_abc", 1, 0);
 
-  char *p1 = (char *)std::malloc(100 * sizeof(char));
-  Page p(1, 0, (std::uintptr_t)(p1));
+  std::vector<char> buf(4096);
+  Page &p = *new (buf.data()) Page(1, 0);
   n.write(&p);
   ASSERT_EQ(p.flags(), LeafPageFlag);
   ASSERT_EQ(p.count(), 3);
@@ -64,25 +86,126 @@ TEST(NodeTest, WriteFunc) {
   ASSERT_EQ(elem->key(), "abc");
   ASSERT_EQ(elem->value(), "value_abc");
 
-  std::free(p1);
 }
 
-TEST(NodeTest, ReadFunc) {
-  Tx tx(nullptr);
-  Bucket bucket(&tx);
-  Node n(&bucket, true, nullptr);
+TEST_F(NodeTest, ReadFunc) {
+  Node n(bucket, true, nullptr);
   n.put("a", "a", "value_a", 1, 0);
   n.put("ab", "ab", "value_ab", 1, 0);
   n.put("abc", "abc", "value_abc", 1, 0);
 
-  char *p1 = (char *)std::malloc(100 * sizeof(char));
-  Page p(1, 0, (std::uintptr_t)(p1));
+  std::vector<char> buf(4096);
+  Page &p = *new (buf.data()) Page(1, 0);
   n.write(&p);
-  Node nn(&bucket, true, nullptr);
+  Node nn(bucket, true, nullptr);
   nn.read(&p);
   assert_value(&nn, "a", "value_a");
   assert_value(&nn, "ab", "value_ab");
   assert_value(&nn, "abc", "value_abc");
 
-  std::free(p1);
-}
\ No newline at end of file
+}
+
+// Ensure that the keys of an integer-key bucket are packed in front of the
+// elements and read back.
+TEST_F(NodeTest, WriteReadU64Keys) {
+  bucket->set_bucket({0, 0, BucketU64KeysFlag, BytewiseComparator::id});
+  Node n(bucket, true, nullptr);
+  char k1[U64KeySize], k2[U64KeySize], k3[U64KeySize];
+  n.put(encode_u64_key(300, k3), encode_u64_key(300, k3), "value_300", 0, 0);
+  n.put(encode_u64_key(1, k1), encode_u64_key(1, k1), "value_1", 0, 0);
+  n.put(encode_u64_key(256, k2), encode_u64_key(256, k2), "value_256", 0, 0);
+
+  std::vector<char> buf(4096);
+  Page &p = *new (buf.data()) Page(1, 0);
+  n.write(&p);
+  ASSERT_EQ(p.flags(), LeafPageFlag | U64KeyPageFlag);
+  ASSERT_EQ(p.count(), 3);
+  const char *keys = reinterpret_cast<const char *>(p.ptr());
+  ASSERT_EQ(decode_u64_key(keys), 1u);
+  ASSERT_EQ(decode_u64_key(keys + U64KeySize), 256u);
+  ASSERT_EQ(decode_u64_key(keys + 2 * U64KeySize), 300u);
+  ASSERT_EQ(p.leafPageElement(1)->ksize, 0u);
+  ASSERT_EQ(p.leafPageElement(1)->value(), "value_256");
+
+  Node nn(bucket, true, nullptr);
+  nn.read(&p);
+  ASSERT_EQ(nn.numChildren(), 3);
+  std::string value;
+  ASSERT_EQ(nn.get(Slice(k2, U64KeySize), &value), 0);
+  ASSERT_EQ(value, "value_256");
+  ASSERT_EQ(nn.get(Slice(k3, U64KeySize), &value), 0);
+  ASSERT_EQ(value, "value_300");
+}
+
+// Ensure that a node keeps its inodes in the order of its bucket's
+// comparator.
+TEST_F(NodeTest, PutComparator) {
+  bucket->set_bucket({0, 0, 0, ReverseBytewiseComparator::id});
+  Node n(bucket, true, nullptr);
+  n.put("a", "a", "value_a", 0, 0);
+  n.put("c", "c", "value_c", 0, 0);
+  n.put("b", "b", "value_b", 0, 0);
+  ASSERT_EQ(n.numChildren(), 3);
+  ASSERT_EQ(n.search("c"), std::make_pair(size_t(0), true));
+  ASSERT_EQ(n.search("a"), std::make_pair(size_t(2), true));
+  assert_value(&n, "b", "value_b");
+
+  n.del("c");
+  ASSERT_EQ(n.numChildren(), 2);
+  ASSERT_EQ(n.search("b"), std::make_pair(size_t(0), true));
+}
+
+// Ensure that a sorted batch is merged into a node, replacing existing keys.
+TEST_F(NodeTest, MergeFunc) {
+  Node n(bucket, true, nullptr);
+  n.put("b", "b", "value_b", 0, 0);
+  n.put("d", "d", "value_d", 0, 0);
+
+  KV kvs[] = {{"a", "new_a"}, {"b", "new_b"}, {"c", "new_c"}, {"e", "new_e"}};
+  n.merge(kvs, 4);
+  ASSERT_EQ(n.numChildren(), 5);
+  ASSERT_EQ(n.search("c"), std::make_pair(size_t(2), true));
+  assert_value(&n, "a", "new_a");
+  assert_value(&n, "b", "new_b");
+  assert_value(&n, "d", "value_d");
+  assert_value(&n, "e", "new_e");
+
+  n.put("f", "f", "", 0, BucketLeafFlag);
+  KV bucketKey[] = {{"f", "value_f"}};
+  ASSERT_THROW(n.merge(bucketKey, 1), IncompatibleValueException);
+}
+
+// Ensure that a range of keys is removed from a leaf, the end excluded.
+TEST_F(NodeTest, DeleteRangeFunc) {
+  Node n(bucket, true, nullptr);
+  n.put("a", "a", "value_a", 0, 0);
+  n.put("b", "b", "value_b", 0, 0);
+  n.put("c", "c", "value_c", 0, 0);
+  n.put("d", "d", "value_d", 0, 0);
+
+  n.delete_range("b", "d");
+  ASSERT_EQ(n.numChildren(), 2);
+  assert_value(&n, "a", "value_a");
+  assert_value(&n, "d", "value_d");
+
+  n.delete_range("0", "aa");
+  ASSERT_EQ(n.numChildren(), 1);
+
+  n.put("e", "e", "", 0, BucketLeafFlag);
+  ASSERT_THROW(n.delete_range("d", "f"), IncompatibleValueException);
+}
+
+// Ensure that a separator is the shortest prefix of the right key that still
+// sorts after the left key.
+TEST(ShortestSeparatorTest, Separates) {
+  ASSERT_EQ(shortest_separator("apple", "banana"), Slice("b"));
+  ASSERT_EQ(shortest_separator("user:1000:name", "user:1001:email"), Slice("user:1001"));
+  ASSERT_EQ(shortest_separator("abc", "abcd"), Slice("abcd"));
+  ASSERT_EQ(shortest_separator("ab", "abcdef"), Slice("abc"));
+  ASSERT_EQ(shortest_separator("a", "b"), Slice("b"));
+
+  // The separator always lies in (left, right].
+  Slice s = shortest_separator("user:1000:name", "user:1001:email");
+  ASSERT_TRUE(Slice("user:1000:name") < s);
+  ASSERT_FALSE(Slice("user:1001:email") < s);
+}
@@ -0,0 +1,79 @@
+#include "bolt/bucket.h"
+#include "bolt/node.h"
+#include "bolt/node_cache.h"
+#include "bolt/page.h"
+#include "bolt/tx.h"
+#include "util.h"
+#include <gtest/gtest.h>
+#include <new>
+#include <vector>
+
+// NodeCacheTest gives the nodes it encodes a bucket in a writable
+// transaction of a real database.
+class NodeCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    db = must_open_db();
+    tx = db->begin(true);
+    bucket = new Bucket(tx);
+  }
+
+  void TearDown() override {
+    delete bucket;
+    tx->rollback();
+    delete tx;
+    delete db;
+  }
+
+  DB *db;
+  Tx *tx;
+  Bucket *bucket;
+};
+
+TEST_F(NodeCacheTest, GetFunc) {
+  Node n(bucket, true, nullptr);
+  n.put("a", "a", "value_a", 1, 0);
+  n.put("ab", "ab", "value_ab", 1, 0);
+
+  std::vector<char> buf(4096);
+  Page &p = *new (buf.data()) Page(1, 0);
+  n.write(&p);
+
+  NodeCache cache(1024 * 1024);
+  auto d = cache.get(&p);
+  ASSERT_TRUE(d->isLeaf);
+  ASSERT_EQ(d->inodes.size(), 2);
+  ASSERT_EQ(d->inodes[0].key, "a");
+  ASSERT_EQ(d->inodes[1].value, "value_ab");
+
+  // A second lookup is served from the cache.
+  ASSERT_EQ(cache.get(&p).get(), d.get());
+  ASSERT_EQ(cache.charge(), d->charge());
+
+  // Invalidated pages are decoded again.
+  cache.invalidate(1);
+  ASSERT_EQ(cache.charge(), 0);
+  ASSERT_NE(cache.get(&p).get(), d.get());
+
+  cache.clear();
+  ASSERT_EQ(cache.charge(), 0);
+}
+
+TEST_F(NodeCacheTest, EvictFunc) {
+  Node n(bucket, true, nullptr);
+  n.put("a", "a", "value_a", 1, 0);
+
+  std::vector<char> buf(4096), buf2(4096);
+  Page &p = *new (buf.data()) Page(1, 0);
+  n.write(&p);
+  Page &q = *new (buf2.data()) Page(17, 0);
+  n.write(&q);
+
+  // With no budget every shard only keeps its most recent page, and
+  // page 1 and page 17 share a shard.
+  NodeCache cache(0);
+  auto d = cache.get(&p);
+  cache.get(&q);
+  ASSERT_NE(cache.get(&p).get(), d.get());
+
+}
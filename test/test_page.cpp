@@ -2,21 +2,14 @@
 #include <gtest/gtest.h>
 
 TEST(PageTest, TypeFunc) {
-  Page p(0, PageFlag::BranchPageFlag, 0);
-  ASSERT_EQ(p.type(), "branch");
-
-  p = Page(0, PageFlag::LeafPageFlag, 0);
-  ASSERT_EQ(p.type(), "leaf");
-
-  p = Page(0, PageFlag::MetaPageFlag, 0);
-  ASSERT_EQ(p.type(), "meta");
-
-  p = Page(0, 20000, 0);
-  ASSERT_EQ(p.type(), "unknown<20000>");
+  ASSERT_EQ(Page(0, PageFlag::BranchPageFlag).type(), "branch");
+  ASSERT_EQ(Page(0, PageFlag::LeafPageFlag).type(), "leaf");
+  ASSERT_EQ(Page(0, PageFlag::MetaPageFlag).type(), "meta");
+  ASSERT_EQ(Page(0, 20000).type(), "unknown<20000>");
 }
 
 TEST(PageTest, DumpFunc) {
-  Page p(256, PageFlag::BranchPageFlag, 0);
+  Page p(256, PageFlag::BranchPageFlag);
   p.hexdump(16);
 }
 
@@ -0,0 +1,84 @@
+#include "bolt/exception.h"
+#include "bolt/page_log.h"
+#include "util.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+TEST(PageLogTest, PagesSinceFunc) {
+  std::string path = temp_file();
+  PageLog log(path, 1);
+  log.append(2, {{4, 1}, {5, 2}});
+  log.append(3, {{4, 1}, {9, 1}});
+  log.append(4, {{12, 1}});
+  log.sync();
+
+  auto runs = log.pages_since(2, 3);
+  ASSERT_EQ(runs.size(), 2);
+  ASSERT_EQ(runs[4], 1);
+  ASSERT_EQ(runs[9], 1);
+
+  runs = log.pages_since(1, 4);
+  ASSERT_EQ(runs.size(), 4);
+  ASSERT_EQ(runs[5], 2);
+
+  // Trimmed records are gone but later ones are kept.
+  log.trim(3);
+  ASSERT_THROW(log.pages_since(2, 4), DeltaMismatchException);
+  runs = log.pages_since(3, 4);
+  ASSERT_EQ(runs.size(), 1);
+  ASSERT_EQ(runs[12], 1);
+  std::remove(path.c_str());
+}
+
+TEST(PageLogTest, TornRecordFunc) {
+  std::string path = temp_file();
+  {
+    PageLog log(path, 1);
+    log.append(2, {{4, 1}});
+    log.append(3, {{5, 1}});
+  }
+
+  // Cut the last record in half as a crash during append would.
+  int fd = ::open(path.c_str(), O_RDWR);
+  off_t sz = ::lseek(fd, 0, SEEK_END);
+  ASSERT_EQ(::ftruncate(fd, sz - 12), 0);
+  ::close(fd);
+
+  PageLog log(path, 2);
+  auto runs = log.pages_since(1, 3);
+  ASSERT_EQ(runs.size(), 1);
+  ASSERT_EQ(runs[4], 1);
+
+  // Appends after recovery are readable.
+  log.append(3, {{6, 1}});
+  runs = log.pages_since(2, 3);
+  ASSERT_EQ(runs.size(), 1);
+  ASSERT_EQ(runs[6], 1);
+  std::remove(path.c_str());
+}
+
+// Ensure that a log only covers the commits after the txid it was created at,
+// and restarts when it misses commits made without it.
+TEST(PageLogTest, CoverageFunc) {
+  std::string path = temp_file();
+  {
+    PageLog log(path, 5);
+    log.append(6, {{4, 1}});
+    ASSERT_THROW(log.pages_since(4, 6), DeltaMismatchException);
+    ASSERT_EQ(log.pages_since(5, 6).size(), 1);
+  }
+
+  // Reopened at the last logged txid, the log still covers txid 6.
+  {
+    PageLog log(path, 6);
+    ASSERT_EQ(log.pages_since(5, 6).size(), 1);
+  }
+
+  // Txids 7 and 8 were committed while the log was disabled.
+  PageLog log(path, 8);
+  ASSERT_THROW(log.pages_since(5, 8), DeltaMismatchException);
+  ASSERT_TRUE(log.pages_since(8, 8).empty());
+  std::remove(path.c_str());
+}
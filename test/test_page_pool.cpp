@@ -0,0 +1,51 @@
+#include "bolt/page_pool.h"
+#include <cstring>
+#include <gtest/gtest.h>
+#include <set>
+
+// Ensure that an arena hands out distinct, writable pages across chunks.
+TEST(PageArenaTest, AllocFunc) {
+  const int page_size = 4096;
+  PageArena arena(page_size, false);
+  std::set<const char *> seen;
+  for (size_t i = 0; i < 2 * HugePageSize / page_size + 1; i++) {
+    Slice s = arena.alloc();
+    ASSERT_EQ(s.size(), static_cast<size_t>(page_size));
+    ASSERT_TRUE(seen.insert(s.data()).second);
+    std::memset(const_cast<char *>(s.data()), 0xff, s.size());
+  }
+}
+
+// Ensure that a pool recycles the pages put back into it.
+TEST(PagePoolTest, GetPutFunc) {
+  PageArena arena(4096, true);
+  PagePool pool([&arena]() { return arena.alloc(); });
+  Slice a = pool.get();
+  pool.put(a);
+  ASSERT_EQ(pool.get().data(), a.data());
+  ASSERT_NE(pool.get().data(), a.data());
+}
+
+// Ensure that a pool releases the pages it holds when it is destroyed.
+TEST(PagePoolTest, FreePageFunc) {
+  int made = 0, freed = 0;
+  {
+    PagePool pool(
+        [&made]() {
+          made++;
+          return Slice(new char[4096], 4096);
+        },
+        [&freed](const Slice &s) {
+          freed++;
+          delete[] s.data();
+        });
+    Slice a = pool.get(), b = pool.get();
+    pool.put(a);
+    pool.put(b);
+    Slice c = pool.get();
+    ASSERT_EQ(c.data(), b.data());
+    pool.put(c);
+  }
+  ASSERT_EQ(made, 2);
+  ASSERT_EQ(freed, 2);
+}
@@ -0,0 +1,69 @@
+#include "bolt/bucket.h"
+#include "bolt/exception.h"
+#include "bolt/sharded_db.h"
+#include "bolt/tx.h"
+#include "util.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <system_error>
+
+// Ensure that keys are routed to the shard owning their range.
+TEST(ShardedDBTest, ShardOfRange) {
+  ShardedOption option = {/* .Shards */ 3, /* .Bounds */ {"g", "p"}, /* .TwoPhaseCommit */ false,
+                          /* .DBOption */ nullptr};
+  ShardedDB db(temp_file(), 0666, &option);
+  ASSERT_EQ(db.size(), 3);
+  ASSERT_EQ(db.shard_of(Slice("a")), 0);
+  ASSERT_EQ(db.shard_of(Slice("g")), 1);
+  ASSERT_EQ(db.shard_of(Slice("o")), 1);
+  ASSERT_EQ(db.shard_of(Slice("p")), 2);
+  ASSERT_EQ(db.shard_of(Slice("z")), 2);
+}
+
+// Ensure that a write to one shard doesn't take the writer lock of another.
+TEST(ShardedDBTest, ParallelWriters) {
+  ShardedOption option = {/* .Shards */ 2, /* .Bounds */ {"m"}, /* .TwoPhaseCommit */ false, /* .DBOption */ nullptr};
+  ShardedDB db(temp_file(), 0666, &option);
+  db.update(Slice("a"), [&db](Tx *) {
+    Tx *tx = db.shard(1)->begin(true);
+    tx->commit();
+    delete tx;
+  });
+}
+
+// Ensure that a failed commit releases the writer lock of its shard.
+TEST(ShardedDBTest, UpdateCommitError) {
+  ShardedOption option = {/* .Shards */ 2, /* .Bounds */ {"m"}, /* .TwoPhaseCommit */ false, /* .DBOption */ nullptr};
+  ShardedDB db(temp_file(), 0666, &option);
+  std::string value(4 << 20, 'x');
+  {
+    FileSizeLimit limit(1 << 20);
+    ASSERT_THROW(db.update(Slice("a"),
+                           [&value](Tx *tx) {
+                             tx->create_bucket("widgets")->put("foo", Slice(value.data(), value.size()));
+                           }),
+                 std::system_error);
+  }
+  db.update(Slice("a"), [](Tx *tx) { tx->create_bucket("widgets")->put("foo", "bar"); });
+}
+
+// Ensure that invalid shard layouts are rejected.
+TEST(ShardedDBTest, OpenInvalidShards) {
+  ShardedOption option = {/* .Shards */ 0, /* .Bounds */ {}, /* .TwoPhaseCommit */ false, /* .DBOption */ nullptr};
+  ASSERT_THROW(ShardedDB(temp_file(), 0666, &option), InvalidShardCountException);
+
+  option.Shards = 3;
+  option.Bounds = {"a"};
+  ASSERT_THROW(ShardedDB(temp_file(), 0666, &option), InvalidShardCountException);
+
+  option.Bounds = {"b", "a"};
+  ASSERT_THROW(ShardedDB(temp_file(), 0666, &option), InvalidShardCountException);
+}
+
+// Ensure that two-phase commit refuses shards with a write-ahead log.
+TEST(ShardedDBTest, OpenTwoPhaseCommitWal) {
+  Option db_option = DefaultOption;
+  db_option.Wal = true;
+  ShardedOption option = {/* .Shards */ 2, /* .Bounds */ {}, /* .TwoPhaseCommit */ true, /* .DBOption */ &db_option};
+  ASSERT_THROW(ShardedDB(temp_file(), 0666, &option), TwoPhaseCommitWalException);
+}
@@ -16,3 +16,25 @@ TEST(SliceTest, SizeFunc) {
   ASSERT_TRUE(ok);
   ASSERT_EQ(str2, "cpp");
 }
+
+// Ensure that the word-at-a-time and vector kernels agree with memcmp and a
+// byte loop for every length and position of the first difference.
+TEST(SliceTest, CompareKernels) {
+  std::string a(200, 'x');
+  for (size_t n = 0; n <= a.size(); n++) {
+    for (size_t d = 0; d <= n; d++) {
+      std::string b = a;
+      if (d < n) {
+        b[d] = (d % 2) ? 'a' : '\xf0';
+      }
+      Slice x(a.data(), n), y(b.data(), n);
+      int expected = ::memcmp(a.data(), b.data(), n);
+      ASSERT_EQ(x.compare(y) < 0, expected < 0) << n << " " << d;
+      ASSERT_EQ(x.compare(y) > 0, expected > 0) << n << " " << d;
+      ASSERT_EQ(x < y, expected < 0) << n << " " << d;
+      ASSERT_EQ(x.difference_offset(y), d) << n << " " << d;
+    }
+  }
+  ASSERT_TRUE(Slice("abc") < Slice("abcd"));
+  ASSERT_EQ(Slice("abcd").difference_offset(Slice("abc")), 3u);
+}
@@ -0,0 +1,66 @@
+#include "bolt/stats.h"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+// Ensure that transactions counted on many threads, and so on several
+// shards, add up when the stats are read.
+TEST(StatCountersTest, SumFunc) {
+  StatCounters c;
+  TxStats s = {};
+  s.page_count = 1;
+  s.node_deref = 2;
+  s.write_time = std::chrono::microseconds(3);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&c, s] {
+      for (int i = 0; i < 1000; i++) {
+        c.begin_tx();
+        c.close_tx(s);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  Stats sum = c.sum();
+  ASSERT_EQ(sum.tx_n, 8000);
+  ASSERT_EQ(sum.open_tx_n, 0);
+  ASSERT_EQ(sum.tx_stats.page_count, 8000);
+  ASSERT_EQ(sum.tx_stats.node_deref, 16000);
+  ASSERT_EQ(sum.tx_stats.write_time, std::chrono::microseconds(24000));
+}
+
+// Ensure that a transaction begun on one thread and closed on another is
+// no longer counted as open.
+TEST(StatCountersTest, CloseOnOtherThreadFunc) {
+  StatCounters c;
+  std::thread([&c] { c.begin_tx(); }).join();
+  ASSERT_EQ(c.sum().open_tx_n, 1);
+  c.close_tx(TxStats());
+  ASSERT_EQ(c.sum().open_tx_n, 0);
+  ASSERT_EQ(c.sum().tx_n, 1);
+}
+
+// Ensure that commits merge their transaction stats and replace the
+// freelist stats.
+TEST(StatCountersTest, CommitFunc) {
+  StatCounters c;
+  TxStats s = {};
+  s.write = 2;
+  s.spill_time = std::chrono::microseconds(5);
+  c.commit(s, 1, 2, 3, 4);
+  c.commit(s, 5, 6, 7, 8);
+
+  Stats sum = c.sum();
+  ASSERT_EQ(sum.tx_n, 0);
+  ASSERT_EQ(sum.tx_stats.write, 4);
+  ASSERT_EQ(sum.tx_stats.spill_time, std::chrono::microseconds(10));
+  ASSERT_EQ(sum.free_page_n, 5);
+  ASSERT_EQ(sum.pending_page_n, 6);
+  ASSERT_EQ(sum.free_alloc, 7);
+  ASSERT_EQ(sum.freelist_inuse, 8);
+}
@@ -1,7 +1,14 @@
+#include "bolt/bucket.h"
 #include "bolt/exception.h"
 #include "bolt/tx.h"
 #include "util.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
 
 TEST(TxTest, Commit_ErrTxClosed) {
   DB *db = must_open_db();
@@ -12,6 +19,200 @@ TEST(TxTest, Commit_ErrTxClosed) {
   ASSERT_NO_THROW(tx->commit());
 
   ASSERT_THROW(tx->commit(), TxClosedException);
+  delete tx;
+  delete db;
 }
 
-TEST(TxTest, Rollback_ErrTxClosed) {}
\ No newline at end of file
+TEST(TxTest, Rollback_ErrTxClosed) {}
+// Ensure that a commit times its rebalance and spill phases and that the
+// database histograms record them.
+TEST(TxTest, CommitPhaseTimes) {
+  DB *db = must_open_db();
+  std::vector<std::string> keys;
+  for (int i = 0; i < 2000; i++) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%08d", i);
+    keys.push_back(std::string(buf) + std::string(56, 'x'));
+  }
+
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  for (auto &k : keys) {
+    b->put(Slice(k.data(), k.size()), "v");
+  }
+  tx->commit();
+  ASSERT_GT(tx->stats().spill, 0);
+  ASSERT_GT(tx->stats().spill_time.count(), 0);
+  delete tx;
+
+  tx = db->begin(true);
+  b = tx->bucket("widgets");
+  for (auto &k : keys) {
+    b->delete_by_key(Slice(k.data(), k.size()));
+  }
+  tx->commit();
+  ASSERT_GT(tx->stats().rebalance, 0);
+  ASSERT_GT(tx->stats().rebalance_time.count(), 0);
+  delete tx;
+
+  // A rollback isn't sampled.
+  tx = db->begin(true);
+  tx->create_bucket("gadgets");
+  tx->rollback();
+  delete tx;
+
+  CommitLatency latency = db->stats().latency;
+  ASSERT_EQ(latency.spill.count, 2u);
+  ASSERT_EQ(latency.lock.count, 2u);
+  ASSERT_GT(latency.spill.max.count(), 0);
+  ASSERT_GT(latency.rebalance.max.count(), 0);
+  delete db;
+}
+
+// Ensure that the pages of a deleted bucket are reclaimed a budget at a time
+// by the following commits, including after the database is reopened with
+// pages still queued.
+TEST(TxTest, ReclaimAcrossReopen) {
+  std::string path = temp_file();
+  Option option = DefaultOption;
+  option.ReclaimBudget = 4;
+  DB *db = new DB(path, 0666, &option);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i++) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%08d", i);
+    keys.push_back(std::string(buf) + std::string(56, 'x'));
+  }
+
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  for (auto &k : keys) {
+    b->put(Slice(k.data(), k.size()), "v");
+  }
+  tx->commit();
+  delete tx;
+
+  tx = db->begin(false);
+  BucketStats s = tx->bucket("widgets")->stats();
+  int pages = s.branch_page_n + s.leaf_page_n;
+  ASSERT_GT(pages, 8);
+  tx->rollback();
+  delete tx;
+
+  // Deleting the bucket only frees the first few pages.
+  tx = db->begin(true);
+  tx->delete_bucket("widgets");
+  tx->commit();
+  delete tx;
+  Stats st = db->stats();
+  int freed = st.free_page_n + st.pending_page_n;
+  ASSERT_LT(freed, pages);
+  delete db;
+
+  // The rest are freed after a restart.
+  db = new DB(path, 0666, &option);
+  for (int i = 0; i < pages; i++) {
+    tx = db->begin(true);
+    tx->commit();
+    delete tx;
+  }
+  st = db->stats();
+  ASSERT_GE(st.free_page_n + st.pending_page_n, pages);
+
+  tx = db->begin(false);
+  ASSERT_EQ(tx->bucket("widgets"), nullptr);
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// read_file returns the contents of a file.
+static std::string read_file(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+// Ensure that write_to copies the data pages of the source verbatim and that
+// the copy opens at the transaction's snapshot.
+TEST(TxTest, WriteTo) {
+  std::string path = temp_file();
+  DB *db = new DB(path, 0666, nullptr);
+  std::vector<std::string> keys;
+  keys.reserve(1000);
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  for (int i = 0; i < 1000; i++) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%08d", i);
+    keys.emplace_back(buf);
+    b->put(Slice(keys.back().data(), keys.back().size()), Slice(keys.back().data(), keys.back().size()));
+  }
+  tx->commit();
+  delete tx;
+
+  std::string copy = temp_file();
+  os::File f(copy, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  tx = db->begin(false);
+  std::int64_t n = tx->write_to(&f);
+  f.close();
+  ASSERT_EQ(n, tx->size());
+  txid_t txid = tx->meta()->txid;
+  tx->rollback();
+  delete tx;
+
+  // Only the meta pages are rewritten.
+  std::size_t meta_sz = 2 * db->page_size();
+  std::string src = read_file(path), dst = read_file(copy);
+  ASSERT_EQ(dst.size(), n);
+  ASSERT_EQ(dst.substr(meta_sz), src.substr(meta_sz, n - meta_sz));
+  delete db;
+
+  db = new DB(copy, 0666, nullptr);
+  tx = db->begin(false);
+  ASSERT_EQ(tx->meta()->txid, txid);
+  b = tx->bucket("widgets");
+  for (auto &k : keys) {
+    ASSERT_EQ(b->get(Slice(k.data(), k.size())).ToString(), k);
+  }
+  tx->rollback();
+  delete tx;
+  delete db;
+}
+
+// Ensure that the copy through the aligned buffer, which write_to uses when
+// the kernel can't copy or the caller asks for O_DIRECT, is verbatim too.
+TEST(TxTest, WriteToDirect) {
+  std::string path = temp_file();
+  DB *db = new DB(path, 0666, nullptr);
+  std::vector<std::string> keys;
+  keys.reserve(1000);
+  std::string value(1000, 'x');
+  Tx *tx = db->begin(true);
+  Bucket *b = tx->create_bucket("widgets");
+  for (int i = 0; i < 1000; i++) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%08d", i);
+    keys.emplace_back(buf);
+    b->put(Slice(keys.back().data(), keys.back().size()), Slice(value.data(), value.size()));
+  }
+  tx->commit();
+  delete tx;
+
+  std::string copy = temp_file();
+  os::File f(copy, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  tx = db->begin(false);
+  tx->writeFlag = O_DIRECT;
+  std::int64_t n = tx->write_to(&f);
+  f.close();
+  ASSERT_EQ(n, tx->size());
+  tx->rollback();
+  delete tx;
+
+  std::size_t meta_sz = 2 * db->page_size();
+  std::string src = read_file(path), dst = read_file(copy);
+  ASSERT_EQ(dst.size(), n);
+  ASSERT_EQ(dst.substr(meta_sz), src.substr(meta_sz, n - meta_sz));
+  delete db;
+}
@@ -0,0 +1,33 @@
+#include "bolt/u64_keys.h"
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+// Ensure that encoded keys sort like the integers they hold.
+TEST(U64KeysTest, EncodeFunc) {
+  char a[U64KeySize], b[U64KeySize];
+  ASSERT_TRUE(encode_u64_key(255, a) < encode_u64_key(256, b));
+  ASSERT_TRUE(encode_u64_key(1, a) < encode_u64_key(0xFFFFFFFFFFFFFFFF, b));
+  encode_u64_key(0x0102030405060708, a);
+  ASSERT_EQ(a[0], 0x01);
+  ASSERT_EQ(a[7], 0x08);
+  ASSERT_EQ(decode_u64_key(a), 0x0102030405060708u);
+}
+
+// Ensure that the branchless search agrees with std::lower_bound.
+TEST(U64KeysTest, LowerBoundFunc) {
+  std::mt19937_64 rng(42);
+  for (size_t n : {0, 1, 2, 15, 16, 17, 33, 100, 1000}) {
+    std::vector<std::uint64_t> keys(n);
+    for (auto &k : keys) {
+      k = rng() % 500;
+    }
+    std::sort(keys.begin(), keys.end());
+    for (std::uint64_t key = 0; key <= 501; key++) {
+      size_t expected = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+      ASSERT_EQ(u64_lower_bound(keys.data(), keys.size(), key), expected) << "n=" << n << " key=" << key;
+    }
+  }
+}
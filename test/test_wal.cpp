@@ -0,0 +1,108 @@
+#include "bolt/meta.h"
+#include "bolt/page.h"
+#include "bolt/wal.h"
+#include "util.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <new>
+#include <unistd.h>
+#include <vector>
+
+const int TestPageSize = 4096;
+
+// make_page creates a leaf page image whose data is filled with c.
+static Page *make_page(std::vector<char> *buf, pgid_t id, char c) {
+  buf->assign(TestPageSize, c);
+  Page *p = new (buf->data()) Page(id, LeafPageFlag);
+  p->setCount(1);
+  return p;
+}
+
+static Meta make_meta(txid_t txid, pgid_t pgid) {
+  Meta m;
+  std::memset(&m, 0, sizeof(m));
+  m.magic = Magic;
+  m.version = Version;
+  m.page_size = TestPageSize;
+  m.freelist = 2;
+  m.pgid = pgid;
+  m.txid = txid;
+  return m;
+}
+
+TEST(WalTest, AppendFunc) {
+  std::string path = temp_file();
+  Wal wal(path, TestPageSize);
+  ASSERT_TRUE(wal.empty());
+
+  std::vector<char> a, b;
+  wal.append(make_meta(2, 6), {{4, make_page(&a, 4, 'a')}, {5, make_page(&b, 5, 'b')}}, true);
+  ASSERT_EQ(wal.meta(), nullptr);
+  wal.publish(make_meta(2, 6));
+  ASSERT_EQ(wal.meta()->txid, 2u);
+
+  // Logged pages are copies of the images.
+  Page *p = wal.page(4);
+  ASSERT_NE(p, nullptr);
+  ASSERT_NE(reinterpret_cast<char *>(p), a.data());
+  ASSERT_EQ(std::memcmp(p, a.data(), TestPageSize), 0);
+  a.assign(TestPageSize, 'x');
+  ASSERT_EQ(p->count(), 1u);
+  ASSERT_EQ(wal.page(6), nullptr);
+  std::remove(path.c_str());
+}
+
+// Ensure that complete records are replayed and a torn one is dropped.
+TEST(WalTest, RecoverFunc) {
+  std::string path = temp_file();
+  std::int64_t sz;
+  {
+    Wal wal(path, TestPageSize);
+    std::vector<char> a, b;
+    wal.append(make_meta(2, 6), {{4, make_page(&a, 4, 'a')}}, true);
+    sz = wal.size();
+    wal.append(make_meta(3, 7), {{6, make_page(&b, 6, 'b')}}, true);
+  }
+  ASSERT_EQ(::truncate(path.c_str(), sz + 100), 0);
+
+  Wal wal(path, TestPageSize);
+  ASSERT_EQ(wal.size(), sz);
+  ASSERT_EQ(wal.meta()->txid, 2u);
+  ASSERT_NE(wal.page(4), nullptr);
+  ASSERT_EQ(wal.page(6), nullptr);
+  std::remove(path.c_str());
+}
+
+// Ensure that a checkpoint copies pages and meta to the data file.
+TEST(WalTest, CheckpointFunc) {
+  std::string path = temp_file();
+  std::string data = temp_file();
+  Wal wal(path, TestPageSize);
+  std::vector<char> a;
+  wal.append(make_meta(3, 5), {{4, make_page(&a, 4, 'a')}}, true);
+  wal.publish(make_meta(3, 5));
+
+  int fd = ::open(data.c_str(), O_RDWR | O_CREAT, 0644);
+  ASSERT_GE(fd, 0);
+  wal.write_to(fd);
+
+  char c;
+  ASSERT_EQ(::pread(fd, &c, 1, 5 * TestPageSize - 1), 1);
+  ASSERT_EQ(c, 'a');
+
+  // txid 3 goes to meta page 1.
+  Meta m;
+  ASSERT_EQ(::pread(fd, &m, sizeof(m), TestPageSize + pageHeaderSize), static_cast<ssize_t>(sizeof(m)));
+  ASSERT_EQ(m.txid, 3u);
+  m.validate();
+  ::close(fd);
+
+  wal.reset();
+  ASSERT_TRUE(wal.empty());
+  ASSERT_EQ(wal.size(), 0);
+  ASSERT_EQ(wal.page(4), nullptr);
+  std::remove(path.c_str());
+  std::remove(data.c_str());
+}
@@ -0,0 +1,58 @@
+#include "bolt/writer_lock.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+// Ensure that a queued callback is handed the lock when it is released.
+TEST(WriterLockTest, LockAsyncFunc) {
+  WriterLock l;
+  int acquired = 0;
+  ASSERT_TRUE(l.lock_async([&acquired] { acquired++; }));
+  ASSERT_EQ(acquired, 0);
+
+  ASSERT_FALSE(l.lock_async([&acquired] { acquired++; }));
+  ASSERT_FALSE(l.lock_async([&acquired] { acquired++; }));
+  ASSERT_EQ(acquired, 0);
+
+  // Each release hands the lock to the next waiter, which keeps it held.
+  l.unlock();
+  ASSERT_EQ(acquired, 1);
+  ASSERT_FALSE(l.try_lock());
+  l.unlock();
+  ASSERT_EQ(acquired, 2);
+  l.unlock();
+  ASSERT_EQ(acquired, 2);
+  ASSERT_TRUE(l.try_lock());
+  l.unlock();
+}
+
+// Ensure that the lock can be released by another thread than the one that
+// took it.
+TEST(WriterLockTest, UnlockOtherThread) {
+  WriterLock l;
+  l.lock();
+  std::thread t([&l] { l.unlock(); });
+  t.join();
+  ASSERT_TRUE(l.try_lock());
+  l.unlock();
+}
+
+// Ensure that the lock excludes blocking lockers from each other.
+TEST(WriterLockTest, LockFunc) {
+  WriterLock l;
+  int n = 0;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&l, &n] {
+      for (int j = 0; j < 10000; j++) {
+        l.lock();
+        n++;
+        l.unlock();
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(n, 40000);
+}
@@ -17,4 +17,18 @@ DB *must_open_db() {
   std::string name = temp_file();
   DB *db = new DB(name, 0666, nullptr);
   return db;
-}
\ No newline at end of file
+}
+
+FileSizeLimit::FileSizeLimit(rlim_t size) {
+  // Without ignoring SIGXFSZ the process is killed instead.
+  this->handler_ = std::signal(SIGXFSZ, SIG_IGN);
+  getrlimit(RLIMIT_FSIZE, &this->old_);
+  struct rlimit limit = this->old_;
+  limit.rlim_cur = size;
+  setrlimit(RLIMIT_FSIZE, &limit);
+}
+
+FileSizeLimit::~FileSizeLimit() {
+  setrlimit(RLIMIT_FSIZE, &this->old_);
+  std::signal(SIGXFSZ, this->handler_);
+}
@@ -2,8 +2,25 @@
 #define __UTIL_H
 
 #include "bolt/db.h"
+#include <csignal>
 #include <string>
+#include <sys/resource.h>
+
+// temp_file returns a temporary file path
+std::string temp_file();
 
 DB *must_open_db();
 
+// FileSizeLimit makes writes past the given file size fail with EFBIG until it
+// is destroyed, so that a commit which grows the database throws.
+class FileSizeLimit {
+public:
+  explicit FileSizeLimit(rlim_t size);
+  ~FileSizeLimit();
+
+private:
+  struct rlimit old_;
+  void (*handler_)(int);
+};
+
 #endif
\ No newline at end of file